@@ -3,6 +3,9 @@
 layout (location = 0) in vec3 position;
 layout (location = 1) in vec3 normal;
 layout (location = 2) in vec2 textureCoord;
+// per instance
+layout (location = 3) in vec3 instancePosition;
+layout (location = 4) in float instanceFrame;
 
 out VS_OUT {
 	vec2 textureCoordinate;
@@ -14,20 +17,23 @@ layout(std140, binding = 0) uniform CBPerFrame
     mat4 proj;
     mat4 proj_ortho;
     mat4 view;
-    mat4 world;
     float width;
     float height;
 } cbPerFrame;
 
-layout(std140, binding = 1) uniform CBPerObject
+layout(std140, binding = 2) uniform CBSpriteSheet
 {
-    mat4 world;
-    float opacity;
-} cbPerObject;
+    vec2 frameSize; // one frame in uv units
+    float columns;
+    float frameCount;
+} cbSpriteSheet;
 
 void main() {
 
-	mat4 modelView = cbPerFrame.view * cbPerObject.world;
+	mat4 world = mat4(1.0);
+	world[3] = vec4(instancePosition, 1.0);
+
+	mat4 modelView = cbPerFrame.view * world;
 
     int spherical = 0; // 1 for spherical; 0 for cylindrical
 
@@ -50,7 +56,12 @@ void main() {
     modelView[2][2] = 1.0; 
 
 	gl_Position = cbPerFrame.proj * modelView * vec4(position, 1.0);
-	vs_out.textureCoordinate = textureCoord;
+	// frames go left to right, top to bottom
+	int columns = int(cbSpriteSheet.columns);
+	int frame = clamp(int(instanceFrame), 0, int(cbSpriteSheet.frameCount) - 1);
+	vec2 cell = vec2(frame % columns, frame / columns);
+
+	vs_out.textureCoordinate = (cell + textureCoord) * cbSpriteSheet.frameSize;
 	vs_out.normal = normal;
 }
 
@@ -5,6 +5,11 @@
 #include <stb/stb_image.h>
 
 #define WHITESPACE " \t\n\r"
+
+// the parser keeps its place per call, so files can be parsed on several threads
+#ifdef _WIN32
+#define strtok_r strtok_s
+#endif
 #define OBJ_FILENAME_LENGTH 500
 #define MATERIAL_NAME_SIZE 255
 #define OBJ_LINE_SIZE 500
@@ -21,23 +26,28 @@ char contains(const char *haystack, const char *needle) {
 	return 1;
 }
 
-// Caller must free the returned string buffer
-char* read_file_full(const char* filename) {
-    FILE* file = fopen(filename, "rb");
-    if (file) {
-        fseek(file, 0, SEEK_END);
-        long fsize = ftell(file);
-        fseek(file, 0, SEEK_SET);  /* same as rewind(f); */
+void texture_cubemap_create(struct texture_t* tex) {
+    glGenTextures(1, &tex->texture_id);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, tex->texture_id);
 
-        char* buf = malloc(fsize + 1);
-        fread(buf, fsize, 1, file);
-        fclose(file);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+}
 
-        buf[fsize] = 0;
+// One face of a cube map texture_cubemap_create made, an RGB image
+void texture_upload_cubemap_face(struct texture_t* tex, int face, struct texture_image_t* image) {
+    tex->width = image->width;
+    tex->height = image->height;
 
-        return buf;
-    }
-    return NULL;
+    glBindTexture(GL_TEXTURE_CUBE_MAP, tex->texture_id);
+    glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face,
+                 0, GL_RGB, image->width, image->height, 0, GL_RGB, GL_UNSIGNED_BYTE, image->pixels
+    );
+    glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
 }
 
 int texture_load_cubemap(struct texture_t* tex, const char* filenames[]) {
@@ -45,89 +55,283 @@ int texture_load_cubemap(struct texture_t* tex, const char* filenames[]) {
     tex->height = 0;
     tex->width = 0;
 
-    glGenTextures(1, &tex->texture_id);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, tex->texture_id);
+    texture_cubemap_create(tex);
 
-    int color_bit;
     for (unsigned int i = 0; i < 6; i++) {
-        unsigned char *data = stbi_load(filenames[i], &tex->width, &tex->height, &color_bit, 0);
-        if (data) {
-            glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i,
-                         0, GL_RGB, tex->width, tex->height, 0, GL_RGB, GL_UNSIGNED_BYTE, data
-            );
-            stbi_image_free(data);
+        struct texture_image_t image;
+        if (texture_image_load(&image, filenames[i], 3, 0)) {
+            texture_upload_cubemap_face(tex, i, &image);
+            texture_image_free(&image);
         }
         else {
             printf("CubeMap texture failed to load at path: %s\n", filenames[i]);
-            stbi_image_free(data);
         }
     }
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-    glBindTexture(GL_TEXTURE_2D, 0);
 
-    printf("CubeMap Texture Loaded: %d X %d\n", tex->width, tex->height);
+    printf("CubeMap Texture Loaded: %zu X %zu\n", tex->width, tex->height);
     return 1;
 }
 
-int texture_convert_dev(const char* filename) {
-    int color_bit;
-    int height = 0;
-    int width = 0;
+// 64 bit FNV-1a, for telling files apart by their content
+unsigned long long hash_bytes(const void* data, size_t size) {
+    const unsigned char* bytes = data;
+    unsigned long long hash = 14695981039346656037ull;
+    for(size_t i = 0;i < size;i++) {
+        hash = (hash ^ bytes[i]) * 1099511628211ull;
+    }
+    return hash;
+}
+
+// Levels down to 1x1, each half the size of the one before
+int texture_mip_count(int width, int height) {
+    int count = 1;
+    while (width > 1 || height > 1) {
+        width = width > 1 ? width / 2 : 1;
+        height = height > 1 ? height / 2 : 1;
+        count++;
+    }
+    return count;
+}
+
+// Bytes of mip_count levels packed one after the other
+size_t texture_levels_size(int width, int height, int channels, int mip_count) {
+    size_t size = 0;
+    for(int level = 0;level < mip_count;level++) {
+        size += (size_t)width * height * channels;
+        width = width > 1 ? width / 2 : 1;
+        height = height > 1 ? height / 2 : 1;
+    }
+    return size;
+}
+
+// Box filters src into the next level, the last odd row and column are dropped
+// like the GL sizes do
+void texture_mip_halve(unsigned char* dst, unsigned char* src, int width, int height, int channels) {
+    int dst_width = width > 1 ? width / 2 : 1;
+    int dst_height = height > 1 ? height / 2 : 1;
+
+    for(int y = 0;y < dst_height;y++) {
+        int y0 = y * 2;
+        int y1 = y0 + 1 < height ? y0 + 1 : y0;
+        for(int x = 0;x < dst_width;x++) {
+            int x0 = x * 2;
+            int x1 = x0 + 1 < width ? x0 + 1 : x0;
+            for(int c = 0;c < channels;c++) {
+                int sum = src[(y0 * width + x0) * channels + c] + src[(y0 * width + x1) * channels + c] +
+                          src[(y1 * width + x0) * channels + c] + src[(y1 * width + x1) * channels + c];
+                dst[(y * dst_width + x) * channels + c] = (sum + 2) / 4;
+            }
+        }
+    }
+}
+
+// Cooked texture cache, written next to the image ("floor2.png" ->
+// "floor2.png.tex") the first time it is decoded. The pixels are stored exactly
+// as glTexImage2D takes them, so a cached load is a file mapping plus the upload
+// and stb is never called.
+//
+//   struct texture_cache_header_t
+//   mip_count levels of width * height * channels bytes, halving  (at data_offset)
+//
+// The cache is stale when the image's size changes, or its mtime changes and the
+// content hash doesn't match anymore. A touched but unchanged image (a fresh
+// checkout) costs a hash of the file, not a decode.
+
+#define TEXTURE_CACHE_MAGIC 0x58544d44 // "DMTX"
+#define TEXTURE_CACHE_VERSION 1
+
+struct texture_cache_header_t {
+    unsigned int magic;
+    unsigned int version;
+    unsigned long long source_mtime;
+    unsigned long long source_size;
+    unsigned long long source_hash; // hash_bytes of the whole image file
+    unsigned int width, height;
+    unsigned int channels; // 4 = RGBA8, 3 = RGB8
+    unsigned int mip_count;
+    unsigned int data_offset;
+    unsigned int data_size;
+    unsigned int pad[2]; // header is 64 bytes, keeps the pixels aligned
+};
 
-    unsigned char* data = stbi_load(filename, &width, &height, &color_bit, STBI_rgb_alpha);
-    if (data) {
-        int data_size = width * height * color_bit;
+void texture_cache_filename(char* out, size_t size, const char* filename) {
+    snprintf(out, size, "%s.tex", filename);
+}
 
-        FILE* f = fopen("./assets/textures/dev.dat", "wb");
+int texture_cache_source_hash(const char* filename, unsigned long long* hash) {
+    struct file_map_t map;
+    if (!file_map(filename, &map)) {
+        return 0;
+    }
+    *hash = hash_bytes(map.data, map.size);
+    file_unmap(&map);
+    return 1;
+}
 
-        fwrite(&width, sizeof(int), 1, f);
-        fwrite(&height, sizeof(int), 1, f);
-        fwrite(&color_bit, sizeof(int), 1, f);
+// On success the image points into the cache, texture_image_free closes it.
+// A cache in the asset pack is taken as it is, the pack is built from up to
+// date caches and the image may not even be around.
+int texture_cache_map(const char* filename, int channels, int mips, struct texture_image_t* image) {
+    char cache_filename[OBJ_FILENAME_LENGTH];
+    texture_cache_filename(cache_filename, sizeof(cache_filename), filename);
 
-        fwrite(data, sizeof(char), data_size, f);
+    struct asset_view_t view;
+    unsigned long long source_mtime = 0, source_size = 0;
 
-        fclose(f);
+    int packed = asset_open_packed(cache_filename, &view);
+    if (!packed) {
+        if (!file_stat(filename, &source_mtime, &source_size)) {
+            return 0;
+        }
+        if (!asset_open_loose(cache_filename, &view)) {
+            return 0;
+        }
+    }
 
-        // we don't need to keep the data in ram, it's a GPU resource
-        stbi_image_free(data);
+    const struct texture_cache_header_t* header = view.data;
+
+    int valid = view.size >= sizeof(struct texture_cache_header_t) &&
+                header->magic == TEXTURE_CACHE_MAGIC &&
+                header->version == TEXTURE_CACHE_VERSION &&
+                header->channels == (unsigned int)channels &&
+                // the whole chain with mips, even if that is one level (1x1)
+                header->mip_count == (mips ? (unsigned int)texture_mip_count(header->width, header->height) : 1) &&
+                header->data_size == texture_levels_size(header->width, header->height, channels, header->mip_count) &&
+                (size_t)header->data_offset + header->data_size <= view.size;
+
+    if (valid && !packed) {
+        valid = header->source_size == source_size;
+        if (valid && header->source_mtime != source_mtime) {
+            unsigned long long source_hash;
+            valid = texture_cache_source_hash(filename, &source_hash) && source_hash == header->source_hash;
+        }
+    }
 
-        return 1;
+    if (!valid) {
+        asset_close(&view);
+        return 0;
     }
-    return 0;
+
+    image->pixels = (unsigned char*)view.data + header->data_offset;
+    image->width = header->width;
+    image->height = header->height;
+    image->channels = channels;
+    image->mip_count = header->mip_count;
+    image->cached = 1;
+    image->view = view;
+    return 1;
 }
 
-int texture_load_dev(struct texture_t* tex, const char* filename) {
+int texture_cache_write(const char* filename, struct texture_image_t* image, unsigned long long source_hash) {
+    char cache_filename[OBJ_FILENAME_LENGTH];
+    texture_cache_filename(cache_filename, sizeof(cache_filename), filename);
+
+    struct texture_cache_header_t header;
+    memset(&header, 0, sizeof(header));
 
-    FILE* f = fopen(filename, "rb");
+    if (!file_stat(filename, &header.source_mtime, &header.source_size)) {
+        return 0;
+    }
 
+    header.magic = TEXTURE_CACHE_MAGIC;
+    header.version = TEXTURE_CACHE_VERSION;
+    header.source_hash = source_hash;
+    header.width = image->width;
+    header.height = image->height;
+    header.channels = image->channels;
+    header.mip_count = image->mip_count;
+    header.data_offset = sizeof(struct texture_cache_header_t);
+    header.data_size = texture_levels_size(image->width, image->height, image->channels, image->mip_count);
+
+    FILE* f = fopen(cache_filename, "wb");
     if (!f) {
+        log_info2("Can't write texture cache", cache_filename);
         return 0;
     }
 
-    int color_bit;
+    fwrite(&header, sizeof(header), 1, f);
+    fwrite(image->pixels, 1, header.data_size, f);
+    int ok = !ferror(f);
+    ok &= fclose(f) == 0;
+    if (!ok) {
+        log_info2("Can't write texture cache", cache_filename);
+        remove(cache_filename);
+    }
+    return ok;
+}
+
+// Decodes the image and writes its texture cache whether there is an up to date
+// one or not, see texture_image_load
+int texture_image_cook(struct texture_image_t* image, const char* filename, int channels, int mips) {
+    memset(image, 0, sizeof(struct texture_image_t));
 
-    tex->texture_id = 0;
-    tex->height = 0;
-    tex->width = 0;
+    // one read for the hash and the decode
+    struct asset_view_t source;
+    if (!asset_open(filename, &source)) {
+        return 0;
+    }
+
+    int width, height, color_bit;
+    unsigned char* data = stbi_load_from_memory(source.data, source.size, &width, &height, &color_bit, channels);
+    unsigned long long source_hash = hash_bytes(source.data, source.size);
+    asset_close(&source);
+
+    if (!data) {
+        return 0;
+    }
+
+    image->width = width;
+    image->height = height;
+    image->channels = channels;
+    image->mip_count = mips ? texture_mip_count(width, height) : 1;
+    image->pixels = malloc(texture_levels_size(width, height, channels, image->mip_count));
+    memcpy(image->pixels, data, (size_t)width * height * channels);
+    stbi_image_free(data);
+
+    unsigned char* level = image->pixels;
+    for(int i = 1;i < image->mip_count;i++) {
+        unsigned char* next = level + (size_t)width * height * channels;
+        texture_mip_halve(next, level, width, height, channels);
+        width = width > 1 ? width / 2 : 1;
+        height = height > 1 ? height / 2 : 1;
+        level = next;
+    }
+
+    // no cache for an image that only is in the pack
+    texture_cache_write(filename, image, source_hash);
+    return 1;
+}
 
-    fread(&tex->width, sizeof(int), 1, f);
-    fread(&tex->height, sizeof(int), 1, f);
-    fread(&color_bit, sizeof(int), 1, f);
+// Loads an image with channels per pixel (4 or 3) and, with mips set, its whole
+// mip chain. From the texture cache when it is up to date, otherwise decoded and
+// cooked into the cache for the next time. Touches no GL state, so any thread
+// can call it. Free the image with texture_image_free.
+int texture_image_load(struct texture_image_t* image, const char* filename, int channels, int mips) {
+    memset(image, 0, sizeof(struct texture_image_t));
 
-    assert(tex->width == 141);
-    assert(tex->height == 10);
-    assert(color_bit == 4);
+    if (texture_cache_map(filename, channels, mips, image)) {
+        return 1;
+    }
+    return texture_image_cook(image, filename, channels, mips);
+}
 
-    int data_size = tex->width * tex->height * color_bit;
+void texture_image_free(struct texture_image_t* image) {
+    if (image->cached) {
+        asset_close(&image->view);
+    } else {
+        free(image->pixels);
+    }
+    image->pixels = NULL;
+}
 
-    unsigned char* data = malloc(sizeof(char) * data_size);
-    fread(data, sizeof(char), data_size, f);
+// Makes tex a 2D texture of an RGBA image, on the thread with the GL context.
+// An image with a mip chain is sampled with it.
+void texture_upload(struct texture_t* tex, struct texture_image_t* image) {
+    int width = image->width;
+    int height = image->height;
 
-    fclose(f);
+    tex->width = width;
+    tex->height = height;
 
     glGenTextures(1, &tex->texture_id);
     glBindTexture(GL_TEXTURE_2D, tex->texture_id);
@@ -137,59 +341,79 @@ int texture_load_dev(struct texture_t* tex, const char* filename) {
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_R,  GL_REPEAT);
 
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
 
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, tex->width, tex->height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
+    if (image->mip_count > 1) {
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        // Also enable the mighty ANISOTROPY FILTER!
+        glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY_EXT, 16.0f);
 
-    glBindTexture(GL_TEXTURE_2D, 0);
+    } else {
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, image->mip_count - 1);
+
+    unsigned char* level = image->pixels;
+    for(int i = 0;i < image->mip_count;i++) {
+        glTexImage2D(GL_TEXTURE_2D, i, GL_RGBA8, width, height, 0,
+                  GL_RGBA, GL_UNSIGNED_BYTE, level);
 
-    free(data);
+        level += (size_t)width * height * 4;
+        width = width > 1 ? width / 2 : 1;
+        height = height > 1 ? height / 2 : 1;
+    }
+
+    glBindTexture(GL_TEXTURE_2D, 0);
 }
 
 // Caller must free the returned texture
 int texture_load(struct texture_t* tex, const char* filename) {
-    int color_bit;
+    struct texture_image_t image;
 
     tex->texture_id = 0;
     tex->height = 0;
     tex->width = 0;
 
-    unsigned char* data = stbi_load(filename, &tex->width, &tex->height, &color_bit, STBI_rgb_alpha);
-    if (data) {
-        int do_mipmap = 0;
+    if (texture_image_load(&image, filename, 4, TEXTURE_MIPMAP)) {
+        texture_upload(tex, &image);
 
-        glGenTextures(1, &tex->texture_id);
-        glBindTexture(GL_TEXTURE_2D, tex->texture_id);
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T,  GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_R,  GL_REPEAT);
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        // we don't need to keep the data in ram, it's a GPU resource
+        texture_image_free(&image);
 
-        if (do_mipmap) {
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-            // Also enable the mighty ANISOTROPY FILTER!
-            glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY_EXT, 16.0f);
+        printf("Texture Loaded: %zu X %zu\n", tex->width, tex->height);
 
-        } else {
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-        }
+        return 1;
+    }
+    return 0;
+}
 
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, tex->width, tex->height, 0,
-                  GL_RGBA, GL_UNSIGNED_BYTE, data);
+// Only reads the image size, no decoding and no GL texture
+int texture_load_info(struct texture_t* tex, const char* filename) {
+    int width, height, color_bit;
+    struct texture_image_t image;
 
-        if (do_mipmap) {
-            glGenerateMipmap(GL_TEXTURE_2D);
-        }
+    tex->texture_id = 0;
+    tex->height = 0;
+    tex->width = 0;
 
-        glBindTexture(GL_TEXTURE_2D, 0);
+    // the header of an up to date cache, the pages with the pixels are never read
+    if (texture_cache_map(filename, 4, TEXTURE_MIPMAP, &image)) {
+        tex->width = image.width;
+        tex->height = image.height;
+        texture_image_free(&image);
+        return 1;
+    }
 
-        // we don't need to keep the data in ram, it's a GPU resource
-        stbi_image_free(data);
+    struct asset_view_t source;
+    if (!asset_open(filename, &source)) {
+        return 0;
+    }
 
-        printf("Texture Loaded: %d X %d\n", tex->width, tex->height);
+    int found = stbi_info_from_memory(source.data, source.size, &width, &height, &color_bit);
+    asset_close(&source);
 
+    if (found) {
+        tex->width = width;
+        tex->height = height;
         return 1;
     }
     return 0;
@@ -201,15 +425,15 @@ void texture_free(struct texture_t* tex) {
     }
 }
 
-void obj_parse_vector(struct vec3_t* v) {
-	v->x = atof( strtok(NULL, WHITESPACE));
-	v->y = atof( strtok(NULL, WHITESPACE));
-	v->z = atof( strtok(NULL, WHITESPACE));
+void obj_parse_vector(struct vec3_t* v, char** save) {
+	v->x = atof( strtok_r(NULL, WHITESPACE, save));
+	v->y = atof( strtok_r(NULL, WHITESPACE, save));
+	v->z = atof( strtok_r(NULL, WHITESPACE, save));
 }
 
-void obj_parse_vector2(struct vec2_t* v) {
-	v->x = atof( strtok(NULL, WHITESPACE));
-	v->y = atof( strtok(NULL, WHITESPACE));
+void obj_parse_vector2(struct vec2_t* v, char** save) {
+	v->x = atof( strtok_r(NULL, WHITESPACE, save));
+	v->y = atof( strtok_r(NULL, WHITESPACE, save));
 }
 
 struct obj_face_t {
@@ -218,12 +442,12 @@ struct obj_face_t {
     int uv_index[3];
 };
 
-void obj_parse_face(struct obj_face_t* face) {
+void obj_parse_face(struct obj_face_t* face, char** save) {
     char *temp_str;
 	char *token;
 	int vertex_count = 0;
 
-	while( (token = strtok(NULL, WHITESPACE)) != NULL) {
+	while( (token = strtok_r(NULL, WHITESPACE, save)) != NULL) {
 	    if (vertex_count >= 3) {
             assert(0);
 	    }
@@ -250,44 +474,138 @@ void obj_parse_face(struct obj_face_t* face) {
 	}
 }
 
-struct mesh_t* load_obj(const char* filename) {
+// Open addressing hash table of vertex indices, used to weld identical
+// position/normal/uv corners into a single vertex while parsing
+struct vertex_weld_t {
+    unsigned int* slots; // vertex index + 1, 0 = empty
+    size_t capacity; // power of two
+};
+
+unsigned int vertex_hash_float(unsigned int hash, float f) {
+    unsigned int bits;
+    f += 0.0f; // -0.0 and 0.0 compare equal, so they must hash equal too
+    memcpy(&bits, &f, sizeof(bits));
+    return (hash ^ bits) * 16777619u;
+}
+
+unsigned int vertex_hash(struct vertex_t* v) {
+    unsigned int hash = 2166136261u;
+    hash = vertex_hash_float(hash, v->pos.x);
+    hash = vertex_hash_float(hash, v->pos.y);
+    hash = vertex_hash_float(hash, v->pos.z);
+    hash = vertex_hash_float(hash, v->norm.x);
+    hash = vertex_hash_float(hash, v->norm.y);
+    hash = vertex_hash_float(hash, v->norm.z);
+    hash = vertex_hash_float(hash, v->uv.x);
+    hash = vertex_hash_float(hash, v->uv.y);
+    return hash;
+}
+
+int vertex_equal(struct vertex_t* a, struct vertex_t* b) {
+    return a->pos.x == b->pos.x && a->pos.y == b->pos.y && a->pos.z == b->pos.z &&
+           a->norm.x == b->norm.x && a->norm.y == b->norm.y && a->norm.z == b->norm.z &&
+           a->uv.x == b->uv.x && a->uv.y == b->uv.y;
+}
+
+void vertex_weld_init(struct vertex_weld_t* weld, size_t capacity) {
+    weld->capacity = capacity;
+    weld->slots = calloc(capacity, sizeof(unsigned int));
+}
+
+void vertex_weld_free(struct vertex_weld_t* weld) {
+    free(weld->slots);
+}
+
+void vertex_weld_insert(struct vertex_weld_t* weld, struct vertex_t* v, unsigned int index) {
+    size_t mask = weld->capacity - 1;
+    size_t slot = vertex_hash(v) & mask;
+    while (weld->slots[slot] != 0) {
+        slot = (slot + 1) & mask;
+    }
+    weld->slots[slot] = index + 1;
+}
+
+// keeps the table at most half full
+void vertex_weld_grow(struct vertex_weld_t* weld, struct vertex_t* vertices, size_t count) {
+    if (count * 2 < weld->capacity) {
+        return;
+    }
+    vertex_weld_free(weld);
+    vertex_weld_init(weld, weld->capacity * 2);
+    for(size_t i = 0;i < count;i++) {
+        vertex_weld_insert(weld, &vertices[i], i);
+    }
+}
+
+// returns the index of an equal vertex or -1
+long vertex_weld_find(struct vertex_weld_t* weld, struct vertex_t* vertices, struct vertex_t* v) {
+    size_t mask = weld->capacity - 1;
+    size_t slot = vertex_hash(v) & mask;
+    while (weld->slots[slot] != 0) {
+        unsigned int index = weld->slots[slot] - 1;
+        if (vertex_equal(&vertices[index], v)) {
+            return index;
+        }
+        slot = (slot + 1) & mask;
+    }
+    return -1;
+}
+
+void mesh_data_free(struct mesh_data_t* data) {
+    free(data->vertices);
+    free(data->indices);
+    data->vertices = NULL;
+    data->indices = NULL;
+    data->vertex_count = 0;
+    data->index_count = 0;
+}
+
+// Parses a triangulated OBJ file into welded vertex/index arrays (CPU only).
+// Caller must free the arrays with mesh_data_free
+int obj_parse_file(const char* filename, struct mesh_data_t* data) {
     FILE* obj_file_stream;
 	int current_material = -1;
 	char *current_token = NULL;
 	char current_line[OBJ_LINE_SIZE];
+	char* save = NULL;
 	int line_number = 0;
 	// open scene
 	obj_file_stream = fopen(filename, "r");
 	if(obj_file_stream == 0) {
 		fprintf(stderr, "Error reading file: %s\n", filename);
-		return NULL;
+		return 0;
 	}
 
-	struct mesh_t* mesh = malloc(sizeof(struct mesh_t));
-
-	size_t pos_array_alloc = 100;
+	// all the arrays grow by doubling, so appending stays amortized O(1)
+	size_t pos_array_alloc = 128;
 	size_t pos_array_count = 0;
 	struct vec3_t* pos_array = malloc(sizeof(struct vec3_t) * pos_array_alloc);
 
-	size_t norm_array_alloc = 100;
+	size_t norm_array_alloc = 128;
 	size_t norm_array_count = 0;
 	struct vec3_t* norm_array = malloc(sizeof(struct vec3_t) * norm_array_alloc);
 
-	size_t uv_array_alloc = 100;
+	size_t uv_array_alloc = 128;
 	size_t uv_array_count = 0;
 	struct vec2_t* uv_array = malloc(sizeof(struct vec2_t) * uv_array_alloc);
 
-	size_t vertex_array_alloc = 100;
+	size_t vertex_array_alloc = 128;
 	size_t vertex_array_count = 0;
 	struct vertex_t* vertex_array = malloc(sizeof(struct vertex_t) * vertex_array_alloc);
 
-	size_t index_array_alloc = 100;
+	size_t index_array_alloc = 128;
 	size_t index_array_count = 0;
 	unsigned int* index_array = malloc(sizeof(unsigned int) * index_array_alloc);
 
+	struct vertex_weld_t weld;
+	vertex_weld_init(&weld, 256);
+
+	struct vec3_t zero3 = {0, 0, 0};
+	struct vec2_t zero2 = {0, 0};
+
 	//parser loop
 	while( fgets(current_line, OBJ_LINE_SIZE, obj_file_stream) ) {
-		current_token = strtok( current_line, " \t\n\r");
+		current_token = strtok_r( current_line, " \t\n\r", &save);
 		line_number++;
 
 		//skip comments
@@ -296,45 +614,43 @@ struct mesh_t* load_obj(const char* filename) {
 		//process vertex
 		else if( strequal(current_token, "v") ) {
 		    struct vec3_t pos;
-		    obj_parse_vector(&pos);
-
-		    //printf("pos %f, %f, %f\n", pos.x, pos.y, pos.z);
+		    obj_parse_vector(&pos, &save);
 
 		    pos_array[pos_array_count] = pos;
 		    pos_array_count++;
 		    if (pos_array_count >= pos_array_alloc) {
-                pos_array_alloc += 50;
+                pos_array_alloc *= 2;
                 pos_array = realloc(pos_array, sizeof(struct vec3_t) * pos_array_alloc);
 		    }
 		}
 		//process vertex normal
 		else if( strequal(current_token, "vn") ) {
             struct vec3_t norm;
-		    obj_parse_vector(&norm);
+		    obj_parse_vector(&norm, &save);
 
 		    norm_array[norm_array_count] = norm;
 		    norm_array_count++;
 		    if (norm_array_count >= norm_array_alloc) {
-                norm_array_alloc += 50;
+                norm_array_alloc *= 2;
                 norm_array = realloc(norm_array, sizeof(struct vec3_t) * norm_array_alloc);
 		    }
 		}
 		//process vertex texture
 		else if( strequal(current_token, "vt") ) {
 		    struct vec2_t uv;
-		    obj_parse_vector2(&uv);
+		    obj_parse_vector2(&uv, &save);
 
 		    uv_array[uv_array_count] = uv;
 		    uv_array_count++;
 		    if (uv_array_count >= uv_array_alloc) {
-                uv_array_alloc += 50;
+                uv_array_alloc *= 2;
                 uv_array = realloc(uv_array, sizeof(struct vec2_t) * uv_array_alloc);
 		    }
 		}
 		 //process face
 		else if( strequal(current_token, "f") ){
             struct obj_face_t face;
-			obj_parse_face(&face);
+			obj_parse_face(&face, &save);
 
             // must be a triangle (3 indices)
             for(int f = 0;f < 3;f++) {
@@ -344,49 +660,31 @@ struct mesh_t* load_obj(const char* filename) {
 
                 struct vertex_t v;
 
-                //printf("pos index %d\n", pos_idx);
-
                 v.pos = pos_array[pos_idx];
-                v.norm = norm_array[norm_idx];
-                v.uv = uv_array[uv_idx];
-
-                size_t vertex_index = -1;
-
-                // TODO: Need faster algorithm
-                for(int j = 0;j < vertex_array_count;j++) {
-                    struct vertex_t* v_ptr = &vertex_array[j];
+                v.norm = norm_idx >= 0 ? norm_array[norm_idx] : zero3;
+                v.uv = uv_idx >= 0 ? uv_array[uv_idx] : zero2;
 
-                    if (v_ptr->pos.x == v.pos.x && v_ptr->pos.y == v.pos.y && v_ptr->pos.z == v.pos.z &&
-                        v_ptr->norm.x == v.norm.x && v_ptr->norm.y == v.norm.y && v_ptr->norm.z == v.norm.z) {
-                        vertex_index = j;
-                        //printf("found!\n");
-                        break;
-                    }
-                }
+                long vertex_index = vertex_weld_find(&weld, vertex_array, &v);
 
                 if (vertex_index == -1) {
                     vertex_array[vertex_array_count] = v;
                     vertex_index = vertex_array_count;
                     vertex_array_count++;
                     if (vertex_array_count >= vertex_array_alloc) {
-                        vertex_array_alloc += 50;
+                        vertex_array_alloc *= 2;
                         vertex_array = realloc(vertex_array, sizeof(struct vertex_t) * vertex_array_alloc);
                     }
+                    vertex_weld_insert(&weld, &v, vertex_index);
+                    vertex_weld_grow(&weld, vertex_array, vertex_array_count);
                 }
 
-                //printf("index %d\n", vertex_index);
-
                 index_array[index_array_count] = vertex_index;
                 index_array_count++;
                 if (index_array_count >= index_array_alloc) {
-                    index_array_alloc += 50;
+                    index_array_alloc *= 2;
                     index_array = realloc(index_array, sizeof(unsigned int) * index_array_alloc);
                 }
             }
-
-            //printf("face %d, %d, %d\n", face.pos_index[0], face.pos_index[1], face.pos_index[2]);
-			//face->material_index = current_material;
-			//list_add_item(&growable_data->face_list, face, NULL);
 		}
 		else if( strequal(current_token, "usemtl") ) // usemtl
 		{
@@ -402,17 +700,199 @@ struct mesh_t* load_obj(const char* filename) {
 		}
 	}
 
-	mesh->vertex_buffer = vertex_buffer_new(&vertex_array[0], vertex_array_count);
-    mesh->index_buffer = index_buffer_new(&index_array[0], index_array_count);
-
-	free(index_array);
-	free(vertex_array);
+	vertex_weld_free(&weld);
 	free(uv_array);
 	free(norm_array);
 	free(pos_array);
 
 	fclose(obj_file_stream);
-	return mesh;
+
+	data->vertices = vertex_array;
+	data->vertex_count = vertex_array_count;
+	data->indices = index_array;
+	data->index_count = index_array_count;
+	return 1;
+}
+
+// Binary mesh cache, written next to the OBJ file ("main.obj" -> "main.obj.mesh")
+// after the first parse. The vertex/index arrays are stored exactly as
+// vertex_buffer_new/index_buffer_new take them, so a cached load is a file
+// mapping plus the GPU upload.
+//
+//   struct mesh_cache_header_t
+//   struct vertex_t * vertex_count   (at vertex_offset)
+//   unsigned int * index_count       (at index_offset)
+
+#define MESH_CACHE_MAGIC 0x48534d44 // "DMSH"
+#define MESH_CACHE_VERSION 2 // 2: vertices in the order the indices use them
+
+struct mesh_cache_header_t {
+    unsigned int magic;
+    unsigned int version;
+    unsigned long long source_mtime; // the cache is stale when the OBJ changes
+    unsigned long long source_size;
+    unsigned int vertex_size; // sizeof(struct vertex_t) when written
+    unsigned int vertex_count;
+    unsigned int vertex_offset;
+    unsigned int index_count;
+    unsigned int index_offset;
+    unsigned int pad[5]; // header is 64 bytes, keeps the arrays aligned
+};
+
+void mesh_cache_filename(char* out, size_t size, const char* obj_filename) {
+    snprintf(out, size, "%s.mesh", obj_filename);
 }
 
+// On success `view` points into the cache, nothing to free but the cache with
+// asset_close. A cache in the asset pack is taken as it is, like the textures.
+int mesh_cache_map(const char* obj_filename, struct asset_view_t* cache, struct mesh_data_t* view) {
+    char cache_filename[OBJ_FILENAME_LENGTH];
+    mesh_cache_filename(cache_filename, sizeof(cache_filename), obj_filename);
 
+    unsigned long long source_mtime = 0, source_size = 0;
+
+    int packed = asset_open_packed(cache_filename, cache);
+    if (!packed) {
+        if (!file_stat(obj_filename, &source_mtime, &source_size)) {
+            return 0;
+        }
+        if (!asset_open_loose(cache_filename, cache)) {
+            return 0;
+        }
+    }
+
+    const struct mesh_cache_header_t* header = cache->data;
+
+    int valid = cache->size >= sizeof(struct mesh_cache_header_t) &&
+                header->magic == MESH_CACHE_MAGIC &&
+                header->version == MESH_CACHE_VERSION &&
+                header->vertex_size == sizeof(struct vertex_t) &&
+                (packed || (header->source_mtime == source_mtime && header->source_size == source_size)) &&
+                header->vertex_offset + (size_t)header->vertex_count * sizeof(struct vertex_t) <= cache->size &&
+                header->index_offset + (size_t)header->index_count * sizeof(unsigned int) <= cache->size;
+
+    if (!valid) {
+        asset_close(cache);
+        return 0;
+    }
+
+    unsigned char* base = (unsigned char*)cache->data;
+    view->vertices = (struct vertex_t*)(base + header->vertex_offset);
+    view->vertex_count = header->vertex_count;
+    view->indices = (unsigned int*)(base + header->index_offset);
+    view->index_count = header->index_count;
+
+    // the sizes can be right and the content still not, an index past the
+    // vertices would go straight to glDrawElements
+    for(size_t i = 0;i < view->index_count;i++) {
+        if (view->indices[i] >= view->vertex_count) {
+            log_info2("Mesh cache has an index out of range", cache_filename);
+            asset_close(cache);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int mesh_cache_write(const char* obj_filename, struct mesh_data_t* data) {
+    char cache_filename[OBJ_FILENAME_LENGTH];
+    mesh_cache_filename(cache_filename, sizeof(cache_filename), obj_filename);
+
+    struct mesh_cache_header_t header;
+    memset(&header, 0, sizeof(header));
+
+    if (!file_stat(obj_filename, &header.source_mtime, &header.source_size)) {
+        return 0;
+    }
+
+    header.magic = MESH_CACHE_MAGIC;
+    header.version = MESH_CACHE_VERSION;
+    header.vertex_size = sizeof(struct vertex_t);
+    header.vertex_count = data->vertex_count;
+    header.vertex_offset = sizeof(struct mesh_cache_header_t);
+    header.index_count = data->index_count;
+    header.index_offset = header.vertex_offset + data->vertex_count * sizeof(struct vertex_t);
+
+    FILE* f = fopen(cache_filename, "wb");
+    if (!f) {
+        log_info2("Can't write mesh cache", cache_filename);
+        return 0;
+    }
+
+    fwrite(&header, sizeof(header), 1, f);
+    fwrite(data->vertices, sizeof(struct vertex_t), data->vertex_count, f);
+    fwrite(data->indices, sizeof(unsigned int), data->index_count, f);
+    int ok = !ferror(f);
+    ok &= fclose(f) == 0;
+    if (!ok) {
+        log_info2("Can't write mesh cache", cache_filename);
+        remove(cache_filename);
+    }
+    return ok;
+}
+
+// Renumbers the vertices in the order the triangles first use them, so drawing
+// walks the vertex buffer front to back instead of jumping around in it. The
+// triangles and their order stay the same.
+void mesh_data_optimize(struct mesh_data_t* data) {
+    unsigned int* remap = malloc(sizeof(unsigned int) * (data->vertex_count ? data->vertex_count : 1));
+    struct vertex_t* vertices = malloc(sizeof(struct vertex_t) * (data->vertex_count ? data->vertex_count : 1));
+    memset(remap, 0xff, sizeof(unsigned int) * data->vertex_count);
+
+    unsigned int count = 0;
+    for(size_t i = 0;i < data->index_count;i++) {
+        unsigned int index = data->indices[i];
+        if (remap[index] == 0xffffffff) {
+            remap[index] = count;
+            vertices[count] = data->vertices[index];
+            count++;
+        }
+        data->indices[i] = remap[index];
+    }
+
+    // vertices no triangle uses are dropped
+    free(data->vertices);
+    free(remap);
+    data->vertices = vertices;
+    data->vertex_count = count;
+}
+
+// Parses, welds and optimizes the OBJ file and writes its mesh cache. The mesh
+// stays in data for the caller to free with mesh_data_free.
+int mesh_cook(const char* obj_filename, struct mesh_data_t* data) {
+    if (!obj_parse_file(obj_filename, data)) {
+        return 0;
+    }
+    mesh_data_optimize(data);
+    mesh_cache_write(obj_filename, data);
+    return 1;
+}
+
+struct mesh_t* load_obj(const char* filename) {
+    struct mesh_t* mesh = NULL;
+    struct mesh_data_t data;
+    struct asset_view_t cache;
+
+    // straight from the cache to the GPU, no parsing and no copies
+    if (mesh_cache_map(filename, &cache, &data)) {
+        mesh = malloc(sizeof(struct mesh_t));
+        mesh->vertex_buffer = vertex_buffer_new(&data.vertices[0], data.vertex_count);
+        mesh->index_buffer = index_buffer_new(&data.indices[0], data.index_count);
+        asset_close(&cache);
+
+        log_info2("Mesh loaded from cache", filename);
+        return mesh;
+    }
+
+    if (!mesh_cook(filename, &data)) {
+        return NULL;
+    }
+
+	mesh = malloc(sizeof(struct mesh_t));
+
+	mesh->vertex_buffer = vertex_buffer_new(&data.vertices[0], data.vertex_count);
+    mesh->index_buffer = index_buffer_new(&data.indices[0], data.index_count);
+
+    mesh_data_free(&data);
+	return mesh;
+}
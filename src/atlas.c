@@ -0,0 +1,217 @@
+#include "doom.h"
+
+// Texture atlas: many small images in one texture, so the quads that use them
+// can share a draw
+//
+// The images are loaded by a texture batch (texture_batch_add_atlas) like any
+// other texture, atlas_build then packs them on shelves: tallest first, each
+// placed right of the last one on the current shelf or on a new shelf below.
+// The width that gives the smallest atlas wins. Every image gets ATLAS_PADDING
+// pixels around it that repeat its edge, so a sample on the border of its rect
+// never picks up the neighbour.
+//
+// An image is addressed by its index, rects[index] has where it went.
+
+#define ATLAS_PADDING 1
+#define ATLAS_MIN_WIDTH 64
+#define ATLAS_MAX_SIZE 4096
+
+void atlas_init(struct atlas_t* atlas, size_t count) {
+    memset(atlas, 0, sizeof(struct atlas_t));
+    atlas->count = count;
+    atlas->rects = calloc(count, sizeof(struct atlas_rect_t));
+    atlas->images = calloc(count, sizeof(struct texture_image_t));
+}
+
+void atlas_free(struct atlas_t* atlas) {
+    for(size_t i = 0;i < atlas->count;i++) {
+        if (atlas->images[i].pixels) {
+            texture_image_free(&atlas->images[i]);
+        }
+    }
+    texture_free(&atlas->texture);
+    free(atlas->images);
+    free(atlas->rects);
+    memset(atlas, 0, sizeof(struct atlas_t));
+}
+
+struct atlas_order_t {
+    size_t index;
+    int width, height;
+};
+
+// Tallest first, then widest, then by index so every run packs the same
+int atlas_order_compare(const void* a, const void* b) {
+    const struct atlas_order_t* oa = a;
+    const struct atlas_order_t* ob = b;
+
+    if (oa->height != ob->height) {
+        return oa->height > ob->height ? -1 : 1;
+    }
+    if (oa->width != ob->width) {
+        return oa->width > ob->width ? -1 : 1;
+    }
+    return (oa->index > ob->index) - (oa->index < ob->index);
+}
+
+// Shelves width wide, returns the height they take or 0 if an image is wider
+int atlas_pack_shelves(struct atlas_rect_t* rects, struct atlas_order_t* order, size_t count, int padding, int width) {
+    int x = 0, y = 0, shelf_height = 0;
+
+    for(size_t i = 0;i < count;i++) {
+        int w = order[i].width + padding * 2;
+        int h = order[i].height + padding * 2;
+        if (w > width) {
+            return 0;
+        }
+
+        if (x + w > width) {
+            x = 0;
+            y += shelf_height;
+            shelf_height = 0;
+        }
+
+        struct atlas_rect_t* rect = &rects[order[i].index];
+        rect->x = x + padding;
+        rect->y = y + padding;
+
+        x += w;
+        if (h > shelf_height) {
+            shelf_height = h;
+        }
+    }
+    return y + shelf_height;
+}
+
+// Places the rects by their width and height, the smallest width * height that
+// fits them all comes back. The width is a power of two, the height isn't.
+int atlas_pack(struct atlas_rect_t* rects, size_t count, int padding, int* width, int* height) {
+    struct atlas_order_t* order = malloc(sizeof(struct atlas_order_t) * (count ? count : 1));
+    for(size_t i = 0;i < count;i++) {
+        order[i].index = i;
+        order[i].width = rects[i].width;
+        order[i].height = rects[i].height;
+    }
+    qsort(order, count, sizeof(struct atlas_order_t), atlas_order_compare);
+
+    size_t best_area = 0;
+    int best_width = 0;
+    for(int w = ATLAS_MIN_WIDTH;w <= ATLAS_MAX_SIZE;w *= 2) {
+        int h = atlas_pack_shelves(rects, order, count, padding, w);
+        if (h > 0 && h <= ATLAS_MAX_SIZE && (best_width == 0 || (size_t)w * h < best_area)) {
+            best_area = (size_t)w * h;
+            best_width = w;
+        }
+    }
+
+    int ok = best_width > 0;
+    if (ok) {
+        *width = best_width;
+        *height = atlas_pack_shelves(rects, order, count, padding, best_width);
+    }
+
+    free(order);
+    return ok;
+}
+
+// Copies an RGBA image into the atlas pixels at rect, its edges repeated into the padding
+void atlas_blit(unsigned char* pixels, int atlas_width, struct atlas_rect_t* rect, struct texture_image_t* image, int padding) {
+    for(int y = -padding;y < rect->height + padding;y++) {
+        int src_y = y < 0 ? 0 : (y >= rect->height ? rect->height - 1 : y);
+        unsigned char* src = image->pixels + (size_t)src_y * image->width * 4;
+        unsigned char* dst = pixels + ((size_t)(rect->y + y) * atlas_width + rect->x) * 4;
+
+        memcpy(dst, src, (size_t)rect->width * 4);
+        for(int x = 1;x <= padding;x++) {
+            memcpy(dst - x * 4, src, 4);
+            memcpy(dst + (rect->width - 1 + x) * 4, src + (rect->width - 1) * 4, 4);
+        }
+    }
+}
+
+// Packs the images the texture batch loaded into the atlas texture, on the
+// thread with the GL context. Returns 0 if any image is missing, those have
+// an empty rect.
+int atlas_build(struct atlas_t* atlas) {
+    PROFILE_BEGIN("atlas_build");
+    double start = timer_now();
+    int missing = 0;
+
+    size_t used = 0;
+    for(size_t i = 0;i < atlas->count;i++) {
+        struct texture_image_t* image = &atlas->images[i];
+        struct atlas_rect_t* rect = &atlas->rects[i];
+
+        missing |= image->pixels == NULL;
+        rect->width = image->pixels ? image->width : 0;
+        rect->height = image->pixels ? image->height : 0;
+        used += (size_t)rect->width * rect->height;
+    }
+
+    int width, height;
+    if (!atlas_pack(atlas->rects, atlas->count, ATLAS_PADDING, &width, &height)) {
+        printf("atlas: %zu images don't fit in %dx%d\n", atlas->count, ATLAS_MAX_SIZE, ATLAS_MAX_SIZE);
+        PROFILE_END();
+        return 0;
+    }
+
+    struct texture_image_t packed;
+    memset(&packed, 0, sizeof(struct texture_image_t));
+    packed.width = width;
+    packed.height = height;
+    packed.channels = 4;
+    packed.mip_count = 1;
+    packed.pixels = calloc((size_t)width * height, 4);
+
+    for(size_t i = 0;i < atlas->count;i++) {
+        struct texture_image_t* image = &atlas->images[i];
+        struct atlas_rect_t* rect = &atlas->rects[i];
+
+        if (image->pixels) {
+            atlas_blit(packed.pixels, width, rect, image, ATLAS_PADDING);
+            texture_image_free(image);
+        }
+    }
+
+    // the uvs are made from the pixel rects and the final size
+    atlas->texture.width = width;
+    atlas->texture.height = height;
+    for(size_t i = 0;i < atlas->count;i++) {
+        struct atlas_rect_t* rect = &atlas->rects[i];
+        rect->uv_rect = atlas_uv_rect(atlas, i, 0, 0, rect->width, rect->height);
+    }
+
+    texture_upload(&atlas->texture, &packed);
+    texture_image_free(&packed);
+
+    printf("atlas: %zu images in %dx%d (%.0f%% used) in %.2f ms\n", atlas->count, width, height,
+           100.0 * used / ((double)width * height), (timer_now() - start) * 1000.0);
+
+    PROFILE_END();
+    return !missing;
+}
+
+// Only the size of image index, the atlas gets no texture (for the simulation)
+int atlas_load_info(struct atlas_t* atlas, int index, const char* filename) {
+    struct texture_t tex;
+    struct atlas_rect_t* rect = &atlas->rects[index];
+
+    int ok = texture_load_info(&tex, filename);
+    rect->width = tex.width;
+    rect->height = tex.height;
+    return ok;
+}
+
+// The uv_rect of a part of image index, x/y/width/height in pixels of the image
+struct vec4_t atlas_uv_rect(struct atlas_t* atlas, int index, int x, int y, int width, int height) {
+    struct atlas_rect_t* rect = &atlas->rects[index];
+    float atlas_width = atlas->texture.width;
+    float atlas_height = atlas->texture.height;
+
+    return (struct vec4_t){
+        (rect->x + x) / atlas_width,
+        (rect->y + y) / atlas_height,
+        width / atlas_width,
+        height / atlas_height,
+    };
+}
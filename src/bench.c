@@ -0,0 +1,733 @@
+#include "game.h"
+
+// Micro benchmarks, run through doom_sim --bench-*
+
+// results are stored here so the compiler can't drop the measured work
+volatile unsigned int bench_sink = 0;
+
+// Writes a flat grid with (cells * cells * 2) triangles, every inner
+// position is shared by six triangles so the weld has real work to do
+void bench_write_grid_obj(const char* filename, int cells) {
+    FILE* f = fopen(filename, "w");
+
+    for(int z = 0;z <= cells;z++) {
+        for(int x = 0;x <= cells;x++) {
+            fprintf(f, "v %f 0.0 %f\n", (float)x, (float)z);
+        }
+    }
+    for(int z = 0;z <= cells;z++) {
+        for(int x = 0;x <= cells;x++) {
+            fprintf(f, "vt %f %f\n", (float)x / cells, (float)z / cells);
+        }
+    }
+    fprintf(f, "vn 0.0 1.0 0.0\n");
+
+    int row = cells + 1;
+    for(int z = 0;z < cells;z++) {
+        for(int x = 0;x < cells;x++) {
+            int a = z * row + x + 1;
+            int b = a + 1;
+            int c = a + row;
+            int d = c + 1;
+            fprintf(f, "f %d/%d/1 %d/%d/1 %d/%d/1\n", a, a, c, c, b, b);
+            fprintf(f, "f %d/%d/1 %d/%d/1 %d/%d/1\n", b, b, c, c, d, d);
+        }
+    }
+    fclose(f);
+}
+
+void bench_obj_load(int max_triangles) {
+    const char* filename = "./bench_synthetic.obj";
+
+    printf("%12s %12s %12s %12s %12s\n", "triangles", "vertices", "parse ms", "ns/tri", "cached ms");
+
+    for(int div = 8;div >= 1;div /= 2) {
+        int cells = (int)sqrt((max_triangles / div) / 2.0);
+        if (cells < 1) {
+            cells = 1;
+        }
+        bench_write_grid_obj(filename, cells);
+
+        struct mesh_data_t data;
+        double start = timer_now();
+        obj_parse_file(filename, &data);
+        double elapsed = timer_now() - start;
+
+        // same mesh through the binary cache, touching every page like an upload would
+        mesh_cache_write(filename, &data);
+
+        struct asset_view_t cache;
+        struct mesh_data_t view;
+        unsigned int checksum = 0;
+        double cache_start = timer_now();
+        if (mesh_cache_map(filename, &cache, &view)) {
+            for(size_t i = 0;i < view.index_count;i++) {
+                checksum += view.indices[i];
+            }
+            for(size_t i = 0;i < view.vertex_count;i++) {
+                checksum += (unsigned int)view.vertices[i].pos.x;
+            }
+            asset_close(&cache);
+        }
+        bench_sink += checksum;
+        double cache_elapsed = timer_now() - cache_start;
+
+        size_t triangles = data.index_count / 3;
+        printf("%12zu %12zu %12.2f %12.1f %12.2f\n", triangles, data.vertex_count,
+               elapsed * 1000.0, (elapsed * 1000000000.0) / triangles, cache_elapsed * 1000.0);
+
+        mesh_data_free(&data);
+    }
+
+    char cache_filename[256];
+    snprintf(cache_filename, sizeof(cache_filename), "%s.mesh", filename);
+    remove(cache_filename);
+    remove(filename);
+}
+
+// Boxes shaped like the imp (2.5 x 3.2) and the projectile (0.5 x 0.5) sprites
+void bench_random_boxes(struct rng_t* rng, struct aabb_t* boxes, size_t count, float arena, float half_w, float height) {
+    for(size_t i = 0;i < count;i++) {
+        struct vec3_t p = vec3(rng_float(rng, -arena, arena), rng_float(rng, 0.0f, 2.0f), rng_float(rng, -arena, arena));
+        boxes[i].min = vec3(p.x - half_w, p.y, p.z - half_w);
+        boxes[i].max = vec3(p.x + half_w, p.y + height, p.z + half_w);
+    }
+}
+
+// The demon vs projectile pass of game_play_update_demons: every demon
+// takes the first projectile it touches that no other demon took yet
+void bench_collision(int count) {
+    printf("%10s %10s %14s %14s %14s %10s\n", "demons", "projectiles", "brute ms", "grid ms", "sweep ms", "hits");
+
+    for(int n = 100;n <= count;n *= 10) {
+        // keep the density of a crowded round as the counts grow
+        float arena = 20.0f * sqrtf(n / 100.0f);
+
+        struct aabb_t* demons = malloc(sizeof(struct aabb_t) * n);
+        struct aabb_t* projectiles = malloc(sizeof(struct aabb_t) * n);
+        char* taken = malloc(n);
+
+        struct rng_t rng;
+        rng_seed(&rng, 1, 0);
+        bench_random_boxes(&rng, demons, n, arena, 1.25f, 3.2f);
+        bench_random_boxes(&rng, projectiles, n, arena, 0.25f, 0.5f);
+
+        memset(taken, 0, n);
+        int brute_hits = 0;
+        double start = timer_now();
+        for(int i = 0;i < n;i++) {
+            for(int j = 0;j < n;j++) {
+                if (!taken[j] && aabb_intersect(&demons[i], &projectiles[j])) {
+                    taken[j] = 1;
+                    brute_hits++;
+                    break;
+                }
+            }
+        }
+        double brute_elapsed = timer_now() - start;
+
+        struct spatial_hash_t grid;
+        spatial_hash_init(&grid, 4.0f);
+
+        memset(taken, 0, n);
+        int grid_hits = 0;
+        start = timer_now();
+        spatial_hash_build(&grid, projectiles, n, sizeof(struct aabb_t));
+        for(int i = 0;i < n;i++) {
+            size_t candidates = spatial_hash_query(&grid, &demons[i]);
+            for(size_t c = 0;c < candidates;c++) {
+                unsigned int j = grid.results[c];
+                if (!taken[j] && aabb_intersect(&demons[i], &projectiles[j])) {
+                    taken[j] = 1;
+                    grid_hits++;
+                    break;
+                }
+            }
+        }
+        double grid_elapsed = timer_now() - start;
+
+        spatial_hash_free(&grid);
+
+        // every demon against all projectiles with the batch test
+        struct aabb_soa_t boxes;
+        memset(&boxes, 0, sizeof(struct aabb_soa_t));
+        unsigned int* hits = malloc(sizeof(unsigned int) * n);
+
+        memset(taken, 0, n);
+        int sweep_hits = 0;
+        start = timer_now();
+        for(int j = 0;j < n;j++) {
+            aabb_soa_push(&boxes, &projectiles[j]);
+        }
+        for(int i = 0;i < n;i++) {
+            size_t hit_count = aabb_soa_overlap(&boxes, &demons[i], hits);
+            for(size_t h = 0;h < hit_count;h++) {
+                if (!taken[hits[h]]) {
+                    taken[hits[h]] = 1;
+                    sweep_hits++;
+                    break;
+                }
+            }
+        }
+        double sweep_elapsed = timer_now() - start;
+
+        free(hits);
+        aabb_soa_free(&boxes);
+
+        printf("%10d %10d %14.3f %14.3f %14.3f %10d%s\n", n, n, brute_elapsed * 1000.0, grid_elapsed * 1000.0,
+               sweep_elapsed * 1000.0, grid_hits, grid_hits == brute_hits && sweep_hits == brute_hits ? "" : " (MISMATCH)");
+
+        free(taken);
+        free(projectiles);
+        free(demons);
+    }
+}
+
+// The demon layout before the store, hot and cold fields mixed in one struct
+struct bench_demon_t {
+    struct sprite3d_t* sprite;
+    struct vec3_t position;
+    float speed;
+    float health;
+    int state;
+    int type;
+    struct aabb_t world_aabb;
+    float animation_frame;
+    int animation_reverse;
+    int marked_for_removal;
+};
+
+// Same random demons in both layouts, a quarter of them attacking (standing still)
+void bench_demons_spawn(struct bench_demon_t* aos, struct demon_store_t* store, struct sprite3d_t* sprite, int n) {
+    float arena = 20.0f * sqrtf(n / 100.0f);
+
+    struct rng_t rng;
+    rng_seed(&rng, 1, 0);
+    for(int i = 0;i < n;i++) {
+        struct vec3_t p = vec3(rng_float(&rng, -arena, arena), 0.0f, rng_float(&rng, -arena, arena));
+        float speed = rng_float(&rng, 3.0f, 4.5f);
+        int state = (i % 4) ? DEMON_STATE_WALKING : DEMON_STATE_ATTACKING;
+
+        if (aos) {
+            memset(&aos[i], 0, sizeof(struct bench_demon_t));
+            aos[i].sprite = sprite;
+            aos[i].position = p;
+            aos[i].speed = speed;
+            aos[i].state = state;
+            aos[i].world_aabb = sprite->local_aabb;
+            aabb_translate(&aos[i].world_aabb, &p);
+        }
+        if (store) {
+            size_t d = demon_store_add(store);
+            demon_store_set_sprite(store, d, sprite);
+            demon_store_set_position(store, d, &p);
+            store->speed[d] = speed;
+            store->state[d] = state;
+        }
+    }
+}
+
+// The player walks in a circle, so the demons keep turning
+struct vec3_t bench_demons_target(int tick) {
+    return vec3(sinf(tick * 0.01f) * 5.0f, 1.6f, cosf(tick * 0.01f) * 5.0f);
+}
+
+// The chase part of game_play_update_demons: the old per demon vec3_* code over
+// the struct array against the demon store kernels. Every kernel has to end up
+// with the same bits as the old code.
+void bench_demons(int count) {
+    const float dt = 1.0f / 60.0f;
+
+    // imp sized box
+    struct sprite3d_t sprite;
+    memset(&sprite, 0, sizeof(struct sprite3d_t));
+    sprite.local_aabb.min = vec3(-1.25f, 0.0f, -1.25f);
+    sprite.local_aabb.max = vec3(1.25f, 3.2f, 1.25f);
+
+    printf("%10s %8s %14s %14s %14s %14s %10s\n", "demons", "ticks", "aos us/tick",
+           "scalar us/tick", "sse2 us/tick", "avx2 us/tick", "speedup");
+
+    for(int n = 1000;n <= count;n *= 10) {
+        // about the same total work at every size
+        int ticks = 2000000 / n;
+        if (ticks < 20) {
+            ticks = 20;
+        }
+
+        struct bench_demon_t* aos = malloc(sizeof(struct bench_demon_t) * n);
+        float* aos_dist = malloc(sizeof(float) * n);
+        bench_demons_spawn(aos, 0, &sprite, n);
+
+        double start = timer_now();
+        for(int t = 0;t < ticks;t++) {
+            struct vec3_t target = bench_demons_target(t);
+
+            for(int i = 0;i < n;i++) {
+                struct bench_demon_t* demon = &aos[i];
+
+                if (demon->state == DEMON_STATE_WALKING) {
+                    struct vec3_t dir = vec3_sub(&target, &demon->position);
+                    vec3_normalize(&dir);
+
+                    struct vec3_t velocity = vec3_mulf(&dir, demon->speed * dt);
+
+                    demon->position = vec3_add(&demon->position, &velocity);
+
+                    demon->world_aabb = demon->sprite->local_aabb;
+                    aabb_translate(&demon->world_aabb, &demon->position);
+                }
+                aos_dist[i] = vec3_distance(&demon->position, &target);
+            }
+        }
+        double aos_elapsed = timer_now() - start;
+
+        double kernel_elapsed[3] = {0};
+        int mismatch = 0;
+
+        for(int kernel = DEMON_KERNEL_SCALAR;kernel <= DEMON_KERNEL_AVX2;kernel++) {
+            // not in this build or on this CPU
+            if (kernel > demon_kernel_best()) {
+                continue;
+            }
+
+            struct demon_store_t store;
+            demon_store_init(&store, 0);
+            bench_demons_spawn(0, &store, &sprite, n);
+
+            start = timer_now();
+            for(int t = 0;t < ticks;t++) {
+                struct vec3_t target = bench_demons_target(t);
+                demon_store_chase_kernel(&store, kernel, 0, store.count, &target, dt);
+            }
+            kernel_elapsed[kernel] = timer_now() - start;
+
+            for(int i = 0;i < n;i++) {
+                struct aabb_t box;
+                demon_store_box(&store, i, &box);
+                struct vec3_t position = vec3(store.pos_x[i], store.pos_y[i], store.pos_z[i]);
+
+                if (memcmp(&position, &aos[i].position, sizeof(struct vec3_t)) ||
+                    memcmp(&box, &aos[i].world_aabb, sizeof(struct aabb_t)) ||
+                    memcmp(&store.player_dist[i], &aos_dist[i], sizeof(float))) {
+                    mismatch = 1;
+                }
+            }
+            bench_sink += (unsigned int)store.player_dist[n / 2];
+
+            demon_store_free(&store);
+        }
+
+        printf("%10d %8d %14.2f", n, ticks, aos_elapsed * 1000000.0 / ticks);
+        for(int kernel = DEMON_KERNEL_SCALAR;kernel <= DEMON_KERNEL_AVX2;kernel++) {
+            if (kernel_elapsed[kernel] > 0.0) {
+                printf(" %14.2f", kernel_elapsed[kernel] * 1000000.0 / ticks);
+            } else {
+                printf(" %14s", "-");
+            }
+        }
+        printf(" %9.1fx%s\n", aos_elapsed / kernel_elapsed[demon_kernel_best()],
+               mismatch ? " (MISMATCH)" : "");
+
+        free(aos_dist);
+        free(aos);
+    }
+}
+
+// libc rand() the way the game used it (a modulo for ints, a divide for floats)
+// against the rng_* streams, count numbers each
+void bench_rng(int count) {
+    const char* names[] = {"rand", "rand int", "rand float", "rng_next", "rng_int", "rng_float"};
+    double elapsed[6];
+
+    struct rng_t rng;
+    rng_seed(&rng, 1, 0);
+    srand(1);
+
+    for(int b = 0;b < 6;b++) {
+        unsigned int sum = 0;
+        double start = timer_now();
+
+        if (b == 0) {
+            for(int i = 0;i < count;i++) {
+                sum += rand();
+            }
+        } else if (b == 1) {
+            for(int i = 0;i < count;i++) {
+                sum += rand()%(20 - 10 + 1) + 10;
+            }
+        } else if (b == 2) {
+            for(int i = 0;i < count;i++) {
+                sum += (unsigned int)(18.0f + ((float) rand()) / (float) RAND_MAX * 32.0f);
+            }
+        } else if (b == 3) {
+            for(int i = 0;i < count;i++) {
+                sum += rng_next(&rng);
+            }
+        } else if (b == 4) {
+            for(int i = 0;i < count;i++) {
+                sum += rng_int(&rng, 10, 20);
+            }
+        } else {
+            for(int i = 0;i < count;i++) {
+                sum += (unsigned int)rng_float(&rng, 18.0f, 50.0f);
+            }
+        }
+
+        elapsed[b] = timer_now() - start;
+        bench_sink += sum;
+    }
+
+    printf("%12s %12s %12s %12s\n", "generator", "numbers", "ns/number", "M/s");
+    for(int b = 0;b < 6;b++) {
+        printf("%12s %12d %12.2f %12.1f\n", names[b], count,
+               elapsed[b] * 1000000000.0 / count, count / elapsed[b] / 1000000.0);
+    }
+}
+
+// The math.c functions from before vecmath.h, kept out of line like they were
+#ifdef _MSC_VER
+#define BENCH_NOINLINE __declspec(noinline)
+#else
+#define BENCH_NOINLINE __attribute__((noinline))
+#endif
+
+BENCH_NOINLINE struct vec3_t bench_old_vec3_add(struct vec3_t* a, struct vec3_t* b) {
+    return vec3(a->x + b->x, a->y + b->y, a->z + b->z);
+}
+
+BENCH_NOINLINE struct vec3_t bench_old_vec3_sub(struct vec3_t* a, struct vec3_t* b) {
+    return vec3(a->x - b->x, a->y - b->y, a->z - b->z);
+}
+
+BENCH_NOINLINE struct vec3_t bench_old_vec3_mulf(struct vec3_t* a, float f) {
+    return vec3(a->x * f, a->y * f, a->z * f);
+}
+
+BENCH_NOINLINE float bench_old_vec3_length(struct vec3_t* v) {
+    return sqrt((v->x * v->x) + (v->y * v->y) + (v->z * v->z));
+}
+
+BENCH_NOINLINE void bench_old_vec3_normalize(struct vec3_t* v) {
+    float length_of_v = bench_old_vec3_length(v);
+    v->x = v->x / length_of_v;
+    v->y = v->y / length_of_v;
+    v->z = v->z / length_of_v;
+}
+
+BENCH_NOINLINE float bench_old_vec3_distance(struct vec3_t* a, struct vec3_t* b) {
+    struct vec3_t d = bench_old_vec3_sub(a, b);
+    return bench_old_vec3_length(&d);
+}
+
+BENCH_NOINLINE struct vec4_t bench_old_mat4_mul_vec4(struct mat4_t* mat, struct vec4_t* v) {
+    struct vec4_t out;
+    float* o = &out.x;
+    for(int i = 0;i < 4;i++) {
+        o[i] = ((mat->m[0][i] * v->x + mat->m[1][i] * v->y) + mat->m[2][i] * v->z) + mat->m[3][i] * v->w;
+    }
+    return out;
+}
+
+BENCH_NOINLINE void bench_old_mat4_mul(struct mat4_t* out, struct mat4_t* a, struct mat4_t* b) {
+    struct mat4_t r;
+    for(int j = 0;j < 4;j++) {
+        for(int i = 0;i < 4;i++) {
+            r.m[j][i] = ((a->m[0][i] * b->m[j][0] + a->m[1][i] * b->m[j][1]) +
+                         a->m[2][i] * b->m[j][2]) + a->m[3][i] * b->m[j][3];
+        }
+    }
+    *out = r;
+}
+
+void bench_math_row(const char* name, int count, double old_elapsed, double new_elapsed, int mismatch) {
+    printf("%14s %10d %12.3f %12.3f %9.1fx%s\n", name, count, old_elapsed * 1000.0, new_elapsed * 1000.0,
+           old_elapsed / new_elapsed, mismatch ? " (MISMATCH)" : "");
+}
+
+// The out of line math.c functions against vecmath.h and the batch ops over
+// count items, the results have to match bit for bit
+void bench_math(int count) {
+    struct rng_t rng;
+    rng_seed(&rng, 1, 0);
+
+    struct vec3_t* points = malloc(sizeof(struct vec3_t) * count);
+    struct vec3_t* old_points = malloc(sizeof(struct vec3_t) * count);
+    struct vec4_t* out = malloc(sizeof(struct vec4_t) * count);
+    struct vec4_t* old_out = malloc(sizeof(struct vec4_t) * count);
+    float* x = malloc(sizeof(float) * count * 3);
+    float* y = x + count;
+    float* z = y + count;
+
+    for(int i = 0;i < count;i++) {
+        points[i] = vec3(rng_float(&rng, -50, 50), rng_float(&rng, 0, 4), rng_float(&rng, -50, 50));
+    }
+
+    // the camera of the first gameplay frame
+    struct mat4_t proj, view, view_proj;
+    struct vec3_t eye = vec3(5, 2.2f, -10);
+    struct vec3_t center = vec3(5.17f, 2.2f, -9.01f);
+    struct vec3_t up = vec3(0, 1, 0);
+    mat4_perspective(&proj, math_deg_to_rad(75.0f), 1280.0f / 720.0f, 0.01f, 1000.0f);
+    mat4_lookAt(&view, &eye, &center, &up);
+
+    printf("%14s %10s %12s %12s %10s\n", "op", "count", "old ms", "new ms", "speedup");
+
+    // the per demon chase step, one call per op before
+    struct vec3_t target = vec3(1, 1.6f, 2);
+    float sum = 0.0f, old_sum = 0.0f;
+    memcpy(old_points, points, sizeof(struct vec3_t) * count);
+    double start = timer_now();
+    for(int i = 0;i < count;i++) {
+        struct vec3_t dir = bench_old_vec3_sub(&target, &old_points[i]);
+        bench_old_vec3_normalize(&dir);
+        struct vec3_t velocity = bench_old_vec3_mulf(&dir, 0.07f);
+        old_points[i] = bench_old_vec3_add(&old_points[i], &velocity);
+        old_sum += bench_old_vec3_distance(&old_points[i], &target);
+    }
+    double old_elapsed = timer_now() - start;
+
+    struct vec3_t* new_points = (struct vec3_t*)old_out; // big enough
+    memcpy(new_points, points, sizeof(struct vec3_t) * count);
+    start = timer_now();
+    for(int i = 0;i < count;i++) {
+        struct vec3_t dir = vec3_sub(&target, &new_points[i]);
+        vec3_normalize(&dir);
+        struct vec3_t velocity = vec3_mulf(&dir, 0.07f);
+        new_points[i] = vec3_add(&new_points[i], &velocity);
+        sum += vec3_distance(&new_points[i], &target);
+    }
+    double new_elapsed = timer_now() - start;
+    bench_math_row("vec3 chase", count, old_elapsed, new_elapsed,
+                   memcmp(old_points, new_points, sizeof(struct vec3_t) * count) || sum != old_sum);
+    bench_sink += (unsigned int)sum;
+
+    // proj * view for 64 different cameras
+    struct mat4_t views[64], view_projs[64], old_view_projs[64];
+    for(int v = 0;v < 64;v++) {
+        views[v] = view;
+        views[v].m[3][0] += v * 0.5f;
+    }
+    start = timer_now();
+    for(int i = 0;i < count;i++) {
+        bench_old_mat4_mul(&old_view_projs[i & 63], &proj, &views[i & 63]);
+    }
+    old_elapsed = timer_now() - start;
+
+    start = timer_now();
+    for(int i = 0;i < count;i++) {
+        mat4_mul(&view_projs[i & 63], &proj, &views[i & 63]);
+    }
+    new_elapsed = timer_now() - start;
+    bench_math_row("mat4 mul", count, old_elapsed, new_elapsed, memcmp(old_view_projs, view_projs, sizeof(view_projs)));
+
+    // points to clip space, both outputs already paged in
+    mat4_mul(&view_proj, &proj, &view);
+    memset(out, 0, sizeof(struct vec4_t) * count);
+    start = timer_now();
+    for(int i = 0;i < count;i++) {
+        struct vec4_t p = vec4(points[i].x, points[i].y, points[i].z, 1.0f);
+        old_out[i] = bench_old_mat4_mul_vec4(&view_proj, &p);
+    }
+    old_elapsed = timer_now() - start;
+
+    start = timer_now();
+    mat4_transform_points(&view_proj, points, out, count);
+    new_elapsed = timer_now() - start;
+    bench_math_row("transform", count, old_elapsed, new_elapsed, memcmp(old_out, out, sizeof(struct vec4_t) * count));
+
+    // one vector at a time against the x, y, z arrays
+    start = timer_now();
+    for(int i = 0;i < count;i++) {
+        old_points[i] = points[i];
+        bench_old_vec3_normalize(&old_points[i]);
+    }
+    old_elapsed = timer_now() - start;
+
+    for(int i = 0;i < count;i++) {
+        x[i] = points[i].x;
+        y[i] = points[i].y;
+        z[i] = points[i].z;
+    }
+    start = timer_now();
+    vec3_normalize_batch(x, y, z, count);
+    new_elapsed = timer_now() - start;
+
+    int mismatch = 0;
+    for(int i = 0;i < count;i++) {
+        struct vec3_t v = vec3(x[i], y[i], z[i]);
+        mismatch |= memcmp(&v, &old_points[i], sizeof(struct vec3_t)) != 0;
+    }
+    bench_math_row("normalize", count, old_elapsed, new_elapsed, mismatch);
+
+    free(x);
+    free(old_out);
+    free(out);
+    free(old_points);
+    free(points);
+}
+
+// One box and one frustum against count boxes, aabb_intersect and
+// frustum_test_aabb on each box against the batch tests in cull.c
+void bench_boxes(int count) {
+    const int queries = 100;
+    float arena = 20.0f * sqrtf(count / 100.0f);
+
+    struct rng_t rng;
+    rng_seed(&rng, 1, 0);
+
+    struct aabb_t* boxes = malloc(sizeof(struct aabb_t) * count);
+    bench_random_boxes(&rng, boxes, count, arena, 1.25f, 3.2f);
+
+    struct aabb_soa_t soa;
+    memset(&soa, 0, sizeof(struct aabb_soa_t));
+    for(int i = 0;i < count;i++) {
+        aabb_soa_push(&soa, &boxes[i]);
+    }
+
+    unsigned int* hits = malloc(sizeof(unsigned int) * count);
+    unsigned int* old_hits = malloc(sizeof(unsigned int) * count);
+
+    printf("%10s %10s %8s %14s %14s %10s %10s\n", "test", "boxes", "queries", "per box ms", "batch ms", "speedup", "hits");
+
+    // reach boxes spread over the arena, punch sized
+    double old_elapsed = 0.0, new_elapsed = 0.0;
+    size_t total = 0;
+    int mismatch = 0;
+    for(int q = 0;q < queries;q++) {
+        struct vec3_t p = vec3(rng_float(&rng, -arena, arena), 0.0f, rng_float(&rng, -arena, arena));
+        struct aabb_t query;
+        query.min = vec3(p.x - 4.0f, p.y - 4.0f, p.z - 4.0f);
+        query.max = vec3(p.x + 4.0f, p.y + 4.0f, p.z + 4.0f);
+
+        double start = timer_now();
+        size_t old_count = 0;
+        for(int i = 0;i < count;i++) {
+            if (aabb_intersect(&query, &boxes[i])) {
+                old_hits[old_count++] = i;
+            }
+        }
+        old_elapsed += timer_now() - start;
+
+        start = timer_now();
+        size_t hit_count = aabb_soa_overlap(&soa, &query, hits);
+        new_elapsed += timer_now() - start;
+
+        mismatch |= hit_count != old_count || memcmp(hits, old_hits, sizeof(unsigned int) * hit_count);
+        total += hit_count;
+    }
+    printf("%10s %10d %8d %14.3f %14.3f %9.1fx %10zu%s\n", "overlap", count, queries, old_elapsed * 1000.0,
+           new_elapsed * 1000.0, old_elapsed / new_elapsed, total, mismatch ? " (MISMATCH)" : "");
+
+    // the game camera turning around in the middle of the arena
+    struct mat4_t proj, view, view_proj;
+    mat4_perspective(&proj, math_deg_to_rad(75.0f), 1280.0f / 720.0f, 0.01f, 1000.0f);
+
+    old_elapsed = 0.0;
+    new_elapsed = 0.0;
+    total = 0;
+    mismatch = 0;
+    for(int q = 0;q < queries;q++) {
+        float yaw = q * (6.2831853f / queries);
+        struct vec3_t eye = vec3(0, 2.2f, 0);
+        struct vec3_t center = vec3(cosf(yaw), 2.2f, sinf(yaw));
+        struct vec3_t up = vec3(0, 1, 0);
+        mat4_lookAt(&view, &eye, &center, &up);
+        mat4_mul(&view_proj, &proj, &view);
+
+        struct frustum_t frustum;
+        frustum_from_matrix(&frustum, &view_proj);
+
+        double start = timer_now();
+        size_t old_count = 0;
+        for(int i = 0;i < count;i++) {
+            if (frustum_test_aabb(&frustum, &boxes[i], DEMON_CULL_PAD)) {
+                old_hits[old_count++] = i;
+            }
+        }
+        old_elapsed += timer_now() - start;
+
+        start = timer_now();
+        size_t hit_count = aabb_soa_frustum(&soa, &frustum, DEMON_CULL_PAD, hits);
+        new_elapsed += timer_now() - start;
+
+        mismatch |= hit_count != old_count || memcmp(hits, old_hits, sizeof(unsigned int) * hit_count);
+        total += hit_count;
+    }
+    printf("%10s %10d %8d %14.3f %14.3f %9.1fx %10zu%s\n", "frustum", count, queries, old_elapsed * 1000.0,
+           new_elapsed * 1000.0, old_elapsed / new_elapsed, total, mismatch ? " (MISMATCH)" : "");
+
+    free(old_hits);
+    free(hits);
+    aabb_soa_free(&soa);
+    free(boxes);
+}
+
+// touches one byte per page, like a loader reading the whole asset
+unsigned int bench_touch(const void* data, size_t size) {
+    const unsigned char* bytes = data;
+    unsigned int sum = 0;
+    for(size_t i = 0;i < size;i += 4096) {
+        sum += bytes[i];
+    }
+    return sum + (size ? bytes[size - 1] : 0);
+}
+
+// Every asset in the pack opened as its loose file, then out of the pack
+void bench_pack(const char* filename) {
+    const int rounds = 20;
+
+    struct pack_t pack;
+    if (!pack_open(&pack, filename)) {
+        printf("can't open %s\n", filename);
+        return;
+    }
+
+    size_t bytes = 0;
+    for(size_t i = 0;i < pack.count;i++) {
+        bytes += pack.entries[i].size;
+    }
+    pack_close(&pack);
+
+    printf("%10s %8s %10s %8s %12s %10s\n", "source", "assets", "bytes", "opens", "ms/round", "speedup");
+
+    unsigned int checksum = 0;
+    double loose_elapsed = 0.0;
+    size_t count = 0, missing = 0;
+    for(int r = 0;r < rounds;r++) {
+        double start = timer_now();
+        pack_open(&pack, filename);
+        count = pack.count;
+        for(size_t i = 0;i < pack.count;i++) {
+            struct asset_view_t view;
+            if (asset_open_loose(pack.names + pack.entries[i].name_offset, &view)) {
+                checksum += bench_touch(view.data, view.size);
+                asset_close(&view);
+            } else {
+                missing++;
+            }
+        }
+        pack_close(&pack);
+        loose_elapsed += timer_now() - start;
+    }
+    printf("%10s %8zu %10zu %8zu %12.3f %10s%s\n", "loose", count, bytes, count,
+           loose_elapsed * 1000.0 / rounds, "", missing ? " (files missing)" : "");
+
+    double pack_elapsed = 0.0;
+    for(int r = 0;r < rounds;r++) {
+        double start = timer_now();
+        pack_open(&pack, filename);
+        // looked up by name like the loaders do, not walked in order
+        for(size_t i = 0;i < pack.count;i++) {
+            struct asset_view_t view;
+            if (pack_view(&pack, pack.names + pack.entries[i].name_offset, &view)) {
+                checksum += bench_touch(view.data, view.size);
+            }
+        }
+        pack_close(&pack);
+        pack_elapsed += timer_now() - start;
+    }
+    printf("%10s %8zu %10zu %8d %12.3f %9.1fx\n", "pack", count, bytes, 1,
+           pack_elapsed * 1000.0 / rounds, loose_elapsed / pack_elapsed);
+
+    bench_sink += checksum;
+}
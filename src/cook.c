@@ -0,0 +1,398 @@
+#include "game.h"
+
+// doom_cook: turns the assets into the forms the game loads without parsing
+// anything, then packs them. Run it from the game directory.
+//
+//   doom_cook [--threads N] [--force] [--no-pack]
+//
+//   images  (*.png, *.jpg)     texture caches, "floor2.png.tex" (texture_image_cook)
+//   scenes  (*.obj)            welded and optimized mesh caches, "main.obj.mesh" (mesh_cook)
+//   shaders (*.vert, *.frag)   the GLSL without comments and blank lines, "sky.vert.glsl"
+//
+// Every input is hashed, cook.manifest keeps the hash each one was last cooked
+// from, so an input is only cooked again when its content changed or its cooked
+// file is gone (--force cooks everything). The inputs are cooked in parallel on
+// the job system, one per job.
+//
+// The pack (GAME_ASSET_PACK) holds the cooked files under the names the game
+// asks for: the caches under their own names, the shaders under the source
+// names. The game takes the pack over the loose files, but not once any of the
+// loose files is newer than the pack (asset_pack_mount), so an edited asset
+// shows up right away and the pack is used again after the next cook.
+// --no-pack deletes the pack, for working on the loose files only.
+
+#define COOK_MANIFEST "./cook.manifest"
+#define COOK_VERSION 1 // cooks everything again when the cooked forms change
+#define COOK_PATH_SIZE 512
+
+enum {
+    COOK_TEXTURE,
+    COOK_MESH,
+    COOK_SHADER,
+};
+
+struct cook_item_t {
+    char path[COOK_PATH_SIZE];
+    char output[COOK_PATH_SIZE];
+    int kind;
+
+    unsigned long long hash; // of the input
+    unsigned long long last_hash; // from the manifest, 0 if it wasn't there
+    int cooked, failed;
+    double ms;
+};
+
+struct cook_t {
+    struct cook_item_t* items;
+    size_t count, capacity;
+    int force;
+};
+
+void platform_capture_cursor(int capture) {
+    // no cursor without a window
+}
+
+int cook_has_suffix(const char* path, const char* suffix) {
+    size_t length = strlen(path);
+    size_t suffix_length = strlen(suffix);
+    return length >= suffix_length && strequal(path + length - suffix_length, suffix);
+}
+
+void cook_add(const char* path, int is_dir, void* data) {
+    struct cook_t* cook = data;
+
+    if (is_dir) {
+        file_list(path, cook_add, cook);
+        return;
+    }
+
+    int kind;
+    const char* suffix;
+    if (cook_has_suffix(path, ".png") || cook_has_suffix(path, ".jpg")) {
+        kind = COOK_TEXTURE;
+        suffix = ".tex";
+    } else if (cook_has_suffix(path, ".obj")) {
+        kind = COOK_MESH;
+        suffix = ".mesh";
+    } else if (cook_has_suffix(path, ".vert") || cook_has_suffix(path, ".frag")) {
+        kind = COOK_SHADER;
+        suffix = ".glsl";
+    } else {
+        return;
+    }
+
+    if (cook->count == cook->capacity) {
+        cook->capacity = cook->capacity ? cook->capacity * 2 : 64;
+        cook->items = realloc(cook->items, sizeof(struct cook_item_t) * cook->capacity);
+    }
+
+    struct cook_item_t* item = &cook->items[cook->count++];
+    memset(item, 0, sizeof(struct cook_item_t));
+    snprintf(item->path, sizeof(item->path), "%s", path);
+    snprintf(item->output, sizeof(item->output), "%s%s", path, suffix);
+    item->kind = kind;
+}
+
+int cook_item_compare(const void* a, const void* b) {
+    return strcmp(((const struct cook_item_t*)a)->path, ((const struct cook_item_t*)b)->path);
+}
+
+// One "hash path" line per input after the version line
+void cook_manifest_read(struct cook_t* cook) {
+    FILE* f = fopen(COOK_MANIFEST, "r");
+    if (!f) {
+        return;
+    }
+
+    char line[COOK_PATH_SIZE + 32];
+    int version = 0, mipmap = -1;
+    if (!fgets(line, sizeof(line), f) || sscanf(line, "doom_cook %d mipmap %d", &version, &mipmap) != 2 ||
+        version != COOK_VERSION || mipmap != TEXTURE_MIPMAP) {
+        fclose(f);
+        return;
+    }
+
+    while (fgets(line, sizeof(line), f)) {
+        unsigned long long hash;
+        if (strlen(line) < 18 || sscanf(line, "%16llx", &hash) != 1) {
+            continue;
+        }
+        char* path = line + 17;
+        path[strcspn(path, "\r\n")] = 0;
+
+        // too long to be one of the inputs
+        struct cook_item_t key;
+        size_t length = strlen(path);
+        if (length >= sizeof(key.path)) {
+            continue;
+        }
+        memcpy(key.path, path, length + 1);
+        struct cook_item_t* item = bsearch(&key, cook->items, cook->count, sizeof(struct cook_item_t), cook_item_compare);
+        if (item) {
+            item->last_hash = hash;
+        }
+    }
+    fclose(f);
+}
+
+void cook_manifest_write(struct cook_t* cook) {
+    FILE* f = fopen(COOK_MANIFEST, "w");
+    if (!f) {
+        log_info2("Can't write", COOK_MANIFEST);
+        return;
+    }
+
+    fprintf(f, "doom_cook %d mipmap %d\n", COOK_VERSION, TEXTURE_MIPMAP);
+    for(size_t i = 0;i < cook->count;i++) {
+        struct cook_item_t* item = &cook->items[i];
+        // a failed input is tried again next time
+        if (!item->failed) {
+            fprintf(f, "%016llx %s\n", item->hash, item->path);
+        }
+    }
+    fclose(f);
+}
+
+// Drops the comments, trailing blanks and empty lines, the rest stays as it is
+int cook_shader(const char* path, const char* output) {
+    struct asset_view_t source;
+    if (!asset_open_loose(path, &source)) {
+        return 0;
+    }
+
+    const char* in = source.data;
+    char* out = malloc(source.size + 1);
+    size_t length = 0, line_start = 0;
+    int block_comment = 0;
+
+    for(size_t i = 0;i < source.size;i++) {
+        char c = in[i];
+
+        if (block_comment) {
+            if (c == '*' && i + 1 < source.size && in[i + 1] == '/') {
+                block_comment = 0;
+                i++;
+            } else if (c == '\n') {
+                out[length++] = c;
+            }
+            continue;
+        }
+
+        if (c == '/' && i + 1 < source.size && in[i + 1] == '/') {
+            while (i + 1 < source.size && in[i + 1] != '\n') {
+                i++;
+            }
+            continue;
+        }
+        if (c == '/' && i + 1 < source.size && in[i + 1] == '*') {
+            block_comment = 1;
+            i++;
+            continue;
+        }
+
+        if (c == '\r') {
+            continue;
+        }
+        if (c == '\n') {
+            while (length > line_start && (out[length - 1] == ' ' || out[length - 1] == '\t')) {
+                length--;
+            }
+            if (length == line_start) {
+                continue;
+            }
+            out[length++] = c;
+            line_start = length;
+            continue;
+        }
+        out[length++] = c;
+    }
+    asset_close(&source);
+
+    int ok = 0;
+    FILE* f = fopen(output, "wb");
+    if (f) {
+        ok = fwrite(out, 1, length, f) == length;
+        ok &= fclose(f) == 0;
+    }
+    if (!ok) {
+        // a disk full or the like, nothing half written is left to be packed
+        log_info2("Can't write shader", output);
+        remove(output);
+    }
+    free(out);
+    return ok;
+}
+
+// The sky faces are RGB cube map faces, everything else an RGBA 2D texture
+int cook_texture(const char* path) {
+    struct texture_image_t image;
+    int ok;
+
+    if (strstr(path, "/sky/")) {
+        ok = texture_image_cook(&image, path, 3, 0);
+    } else {
+        ok = texture_image_cook(&image, path, 4, TEXTURE_MIPMAP);
+    }
+    if (ok) {
+        texture_image_free(&image);
+    }
+    return ok;
+}
+
+int cook_mesh(const char* path) {
+    struct mesh_data_t data;
+    if (!mesh_cook(path, &data)) {
+        return 0;
+    }
+    mesh_data_free(&data);
+    return 1;
+}
+
+void cook_job(void* data, size_t begin, size_t end, int thread) {
+    struct cook_t* cook = data;
+
+    for(size_t i = begin;i < end;i++) {
+        struct cook_item_t* item = &cook->items[i];
+        double start = timer_now();
+
+        struct asset_view_t input;
+        if (!asset_open_loose(item->path, &input)) {
+            item->failed = 1;
+            continue;
+        }
+        item->hash = hash_bytes(input.data, input.size);
+        asset_close(&input);
+
+        unsigned long long mtime, size;
+        if (!cook->force && item->hash == item->last_hash && file_stat(item->output, &mtime, &size)) {
+            continue;
+        }
+
+        // the caches are written on the side (the game cooks while loading too)
+        // and removed when the write fails, so a missing output is a failure
+        remove(item->output);
+
+        int ok = 0;
+        switch (item->kind) {
+            case COOK_TEXTURE: ok = cook_texture(item->path); break;
+            case COOK_MESH: ok = cook_mesh(item->path); break;
+            case COOK_SHADER: ok = cook_shader(item->path, item->output); break;
+        }
+        ok = ok && file_stat(item->output, &mtime, &size);
+
+        item->cooked = 1;
+        item->failed = !ok;
+        item->ms = (timer_now() - start) * 1000.0;
+    }
+}
+
+// Something was cooked now, some cooked file is newer than the pack (cooked
+// with --no-pack before), some input is (touched, asset_pack_mount would turn
+// the pack down) or there is no pack
+int cook_pack_stale(struct cook_t* cook) {
+    unsigned long long pack_mtime, mtime, size;
+    if (!file_stat(GAME_ASSET_PACK, &pack_mtime, &size)) {
+        return 1;
+    }
+
+    for(size_t i = 0;i < cook->count;i++) {
+        struct cook_item_t* item = &cook->items[i];
+        if (item->failed) {
+            continue;
+        }
+        // mtimes are in seconds, only tell apart what was cooked in another run
+        if (item->cooked || (file_stat(item->output, &mtime, &size) && mtime > pack_mtime) ||
+            (file_stat(item->path, &mtime, &size) && mtime > pack_mtime)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int cook_pack(struct cook_t* cook) {
+    const char** names = malloc(sizeof(const char*) * cook->count);
+    const char** files = malloc(sizeof(const char*) * cook->count);
+    size_t count = 0;
+
+    for(size_t i = 0;i < cook->count;i++) {
+        struct cook_item_t* item = &cook->items[i];
+        if (item->failed) {
+            continue;
+        }
+        // the caches are asked for by their own names, the shaders by the source's
+        names[count] = item->kind == COOK_SHADER ? item->path : item->output;
+        files[count] = item->output;
+        count++;
+    }
+
+    int ok = pack_write(GAME_ASSET_PACK, names, files, count);
+    free(files);
+    free(names);
+    return ok;
+}
+
+int main(int argc, char** argv) {
+    int threads = 0;
+    int pack = 1;
+
+    struct cook_t cook;
+    memset(&cook, 0, sizeof(struct cook_t));
+
+    for(int i = 1;i < argc;i++) {
+        if (strequal(argv[i], "--threads") && i + 1 < argc) {
+            threads = atoi(argv[++i]);
+        } else if (strequal(argv[i], "--force")) {
+            cook.force = 1;
+        } else if (strequal(argv[i], "--no-pack")) {
+            pack = 0;
+        } else {
+            printf("usage: %s [--threads N] [--force] [--no-pack]\n", argv[0]);
+            return -1;
+        }
+    }
+
+    double start = timer_now();
+
+    if (!file_list("./assets", cook_add, &cook)) {
+        printf("no ./assets here, run doom_cook from the game directory\n");
+        return -1;
+    }
+    // sorted, so the manifest and the pack come out the same every time
+    qsort(cook.items, cook.count, sizeof(struct cook_item_t), cook_item_compare);
+    cook_manifest_read(&cook);
+
+    jobs_init(threads);
+    threads = jobs_thread_count();
+    parallel_for(cook.count, 1, cook_job, &cook);
+    jobs_shutdown();
+
+    size_t cooked = 0, failed = 0;
+    for(size_t i = 0;i < cook.count;i++) {
+        struct cook_item_t* item = &cook.items[i];
+        if (item->failed) {
+            printf("%10s  %s\n", "FAILED", item->path);
+            failed++;
+        } else if (item->cooked) {
+            printf("%8.2f ms  %s\n", item->ms, item->output);
+            cooked++;
+        }
+    }
+    cook_manifest_write(&cook);
+
+    int pack_failed = 0;
+    if (!pack) {
+        // an old pack would still be mounted over the files cooked now
+        remove(GAME_ASSET_PACK);
+    } else if (cook_pack_stale(&cook)) {
+        pack_failed = !cook_pack(&cook);
+    }
+
+    printf("cooked %zu of %zu inputs (%zu up to date, %zu failed) in %.2f ms on %d threads\n",
+           cooked, cook.count, cook.count - cooked - failed, failed, (timer_now() - start) * 1000.0, threads);
+    if (pack_failed) {
+        printf("%10s  %s\n", "FAILED", GAME_ASSET_PACK);
+    }
+
+    free(cook.items);
+    return failed || pack_failed ? -1 : 0;
+}
@@ -0,0 +1,198 @@
+#include "doom.h"
+
+// Batch box tests: one box or one frustum against a whole array of boxes
+//
+// The array keeps min and max as six float arrays (struct aabb_soa_t), so four
+// boxes are tested with a few SSE compares and the hits come out as a list of
+// indices in ascending order. The demon store already keeps its boxes that way
+// and hands them out with demon_store_boxes, other boxes are copied in with
+// aabb_soa_push.
+//
+// The boxes in the array must not be null (min > max), they are not checked.
+
+void aabb_soa_free(struct aabb_soa_t* soa) {
+    // a view into a store owns nothing
+    if (soa->capacity) {
+        free(soa->min_x);
+    }
+    memset(soa, 0, sizeof(struct aabb_soa_t));
+}
+
+void aabb_soa_clear(struct aabb_soa_t* soa) {
+    assert(soa->capacity || !soa->count);
+    soa->count = 0;
+}
+
+// All six arrays in one block, capacity floats each
+void aabb_soa_grow(struct aabb_soa_t* soa) {
+    size_t capacity = soa->capacity ? soa->capacity * 2 : 64;
+    float* block = malloc(sizeof(float) * 6 * capacity);
+
+    float* old[6] = {soa->min_x, soa->min_y, soa->min_z, soa->max_x, soa->max_y, soa->max_z};
+    float** arrays[6] = {&soa->min_x, &soa->min_y, &soa->min_z, &soa->max_x, &soa->max_y, &soa->max_z};
+
+    for(int a = 0;a < 6;a++) {
+        *arrays[a] = block + a * capacity;
+        if (soa->count) {
+            memcpy(*arrays[a], old[a], sizeof(float) * soa->count);
+        }
+    }
+
+    if (soa->capacity) {
+        free(old[0]);
+    }
+    soa->capacity = capacity;
+}
+
+void aabb_soa_push(struct aabb_soa_t* soa, struct aabb_t* box) {
+    if (soa->count == soa->capacity) {
+        aabb_soa_grow(soa);
+    }
+
+    size_t i = soa->count;
+    soa->min_x[i] = box->min.x;
+    soa->min_y[i] = box->min.y;
+    soa->min_z[i] = box->min.z;
+    soa->max_x[i] = box->max.x;
+    soa->max_y[i] = box->max.y;
+    soa->max_z[i] = box->max.z;
+    soa->count++;
+}
+
+// Writes the indices of the boxes that touch box to hits, which holds soa->count
+// entries. Same answer as aabb_intersect on every box.
+size_t aabb_soa_overlap(struct aabb_soa_t* soa, struct aabb_t* box, unsigned int* hits) {
+    size_t count = 0;
+    size_t i = 0;
+
+    if (aabb_is_null(box)) {
+        return 0;
+    }
+
+#ifdef DOOM_SIMD_SSE
+    __m128 box_min_x = _mm_set1_ps(box->min.x);
+    __m128 box_min_y = _mm_set1_ps(box->min.y);
+    __m128 box_min_z = _mm_set1_ps(box->min.z);
+    __m128 box_max_x = _mm_set1_ps(box->max.x);
+    __m128 box_max_y = _mm_set1_ps(box->max.y);
+    __m128 box_max_z = _mm_set1_ps(box->max.z);
+
+    for(;i + 4 <= soa->count;i += 4) {
+        __m128 x = _mm_and_ps(_mm_cmpge_ps(_mm_loadu_ps(soa->max_x + i), box_min_x),
+                              _mm_cmple_ps(_mm_loadu_ps(soa->min_x + i), box_max_x));
+        __m128 y = _mm_and_ps(_mm_cmpge_ps(_mm_loadu_ps(soa->max_y + i), box_min_y),
+                              _mm_cmple_ps(_mm_loadu_ps(soa->min_y + i), box_max_y));
+        __m128 z = _mm_and_ps(_mm_cmpge_ps(_mm_loadu_ps(soa->max_z + i), box_min_z),
+                              _mm_cmple_ps(_mm_loadu_ps(soa->min_z + i), box_max_z));
+
+        int mask = _mm_movemask_ps(_mm_and_ps(_mm_and_ps(x, y), z));
+        if (!mask) {
+            continue;
+        }
+        // written every time, kept only for a hit
+        for(int b = 0;b < 4;b++) {
+            hits[count] = i + b;
+            count += (mask >> b) & 1;
+        }
+    }
+#endif
+
+    for(;i < soa->count;i++) {
+        if (soa->max_x[i] >= box->min.x && soa->min_x[i] <= box->max.x &&
+            soa->max_y[i] >= box->min.y && soa->min_y[i] <= box->max.y &&
+            soa->max_z[i] >= box->min.z && soa->min_z[i] <= box->max.z) {
+            hits[count++] = i;
+        }
+    }
+    return count;
+}
+
+// The planes of the clip volume of view_proj (Gribb and Hartmann), normalized so
+// the distances are in world units. They point inwards.
+void frustum_from_matrix(struct frustum_t* frustum, struct mat4_t* view_proj) {
+    struct mat4_t* m = view_proj;
+
+    for(int p = 0;p < 6;p++) {
+        int row = p / 2;
+        float sign = (p % 2) ? -1.0f : 1.0f; // left/right, bottom/top, near/far
+
+        struct vec4_t plane = vec4(m->m[0][3] + sign * m->m[0][row],
+                                   m->m[1][3] + sign * m->m[1][row],
+                                   m->m[2][3] + sign * m->m[2][row],
+                                   m->m[3][3] + sign * m->m[3][row]);
+
+        float length = sqrtf(plane.x * plane.x + plane.y * plane.y + plane.z * plane.z);
+        frustum->planes[p] = vec4_mulf(&plane, 1.0f / length);
+    }
+}
+
+// A box is outside when its corner furthest along a plane's normal is still
+// more than pad behind it. Boxes near a corner of the frustum can pass without
+// being visible, nothing visible is ever dropped.
+int frustum_test_aabb(struct frustum_t* frustum, struct aabb_t* box, float pad) {
+    for(int p = 0;p < 6;p++) {
+        struct vec4_t* plane = &frustum->planes[p];
+        float x = plane->x > 0.0f ? box->max.x : box->min.x;
+        float y = plane->y > 0.0f ? box->max.y : box->min.y;
+        float z = plane->z > 0.0f ? box->max.z : box->min.z;
+
+        if (plane->x * x + plane->y * y + plane->z * z + plane->w + pad < 0.0f) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Writes the indices of the boxes frustum_test_aabb keeps to hits, which holds
+// soa->count entries
+size_t aabb_soa_frustum(struct aabb_soa_t* soa, struct frustum_t* frustum, float pad, unsigned int* hits) {
+    // the corner to test is the same for every box, only the arrays change per plane
+    float* corner_x[6];
+    float* corner_y[6];
+    float* corner_z[6];
+    for(int p = 0;p < 6;p++) {
+        corner_x[p] = frustum->planes[p].x > 0.0f ? soa->max_x : soa->min_x;
+        corner_y[p] = frustum->planes[p].y > 0.0f ? soa->max_y : soa->min_y;
+        corner_z[p] = frustum->planes[p].z > 0.0f ? soa->max_z : soa->min_z;
+    }
+
+    size_t count = 0;
+    size_t i = 0;
+
+#ifdef DOOM_SIMD_SSE
+    __m128 zero = _mm_setzero_ps();
+
+    for(;i + 4 <= soa->count;i += 4) {
+        __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+
+        for(int p = 0;p < 6;p++) {
+            struct vec4_t* plane = &frustum->planes[p];
+            __m128 d = _mm_mul_ps(_mm_set1_ps(plane->x), _mm_loadu_ps(corner_x[p] + i));
+            d = _mm_add_ps(d, _mm_mul_ps(_mm_set1_ps(plane->y), _mm_loadu_ps(corner_y[p] + i)));
+            d = _mm_add_ps(d, _mm_mul_ps(_mm_set1_ps(plane->z), _mm_loadu_ps(corner_z[p] + i)));
+            d = _mm_add_ps(d, _mm_set1_ps(plane->w));
+            d = _mm_add_ps(d, _mm_set1_ps(pad));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(d, zero));
+        }
+
+        int mask = _mm_movemask_ps(inside);
+        for(int b = 0;b < 4;b++) {
+            hits[count] = i + b;
+            count += (mask >> b) & 1;
+        }
+    }
+#endif
+
+    for(;i < soa->count;i++) {
+        int inside = 1;
+        for(int p = 0;p < 6 && inside;p++) {
+            struct vec4_t* plane = &frustum->planes[p];
+            float d = plane->x * corner_x[p][i] + plane->y * corner_y[p][i] + plane->z * corner_z[p][i] + plane->w + pad;
+            inside = d >= 0.0f;
+        }
+        if (inside) {
+            hits[count++] = i;
+        }
+    }
+    return count;
+}
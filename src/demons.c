@@ -0,0 +1,435 @@
+#include "game.h"
+
+// Demon store (structure of arrays) and the chase kernel
+//
+// The kernel does the part of the demon update that is the same math for every
+// demon: walking demons step towards the target, every world box is refreshed
+// from the local box and every distance to the target is written to player_dist.
+// The SIMD versions use the same operations in the same order as vec3_normalize
+// and vec3_distance in vecmath.h (sub, sqrt, div, mul, add, no fused multiply-add
+// and no reciprocal estimates), so all kernels give the same bits as the scalar
+// code and replays hold on any CPU.
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(_M_AMD64) || defined(__SSE2__)
+#define DEMON_SSE2
+#include <emmintrin.h>
+
+#if defined(__GNUC__) || defined(_MSC_VER)
+#define DEMON_AVX2
+#include <immintrin.h>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#define DEMON_TARGET_AVX2
+#else
+#define DEMON_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+#endif
+
+// every array of the store and its item size, they grow and compact together
+#define DEMON_ARRAY_COUNT 27
+
+void demon_store_arrays(struct demon_store_t* store, void** arrays[DEMON_ARRAY_COUNT], size_t sizes[DEMON_ARRAY_COUNT]) {
+    float** floats[] = {
+        &store->pos_x, &store->pos_y, &store->pos_z, &store->speed, &store->health,
+        &store->animation_frame, &store->player_dist,
+        &store->min_x, &store->min_y, &store->min_z, &store->max_x, &store->max_y, &store->max_z,
+        &store->prev_x, &store->prev_y, &store->prev_z,
+        &store->local_min_x, &store->local_min_y, &store->local_min_z,
+        &store->local_max_x, &store->local_max_y, &store->local_max_z,
+    };
+    int** ints[] = {
+        &store->state, &store->type, &store->animation_reverse, &store->marked_for_removal,
+    };
+
+    size_t n = 0;
+    for(size_t i = 0;i < sizeof(floats) / sizeof(floats[0]);i++) {
+        arrays[n] = (void**)floats[i];
+        sizes[n++] = sizeof(float);
+    }
+    for(size_t i = 0;i < sizeof(ints) / sizeof(ints[0]);i++) {
+        arrays[n] = (void**)ints[i];
+        sizes[n++] = sizeof(int);
+    }
+    arrays[n] = (void**)&store->sprite;
+    sizes[n++] = sizeof(struct sprite3d_t*);
+
+    assert(n == DEMON_ARRAY_COUNT);
+}
+
+void demon_store_init(struct demon_store_t* store, size_t soft_budget) {
+    memset(store, 0, sizeof(struct demon_store_t));
+    store->soft_budget = soft_budget;
+
+    // picked now, before jobs run the kernel
+    demon_kernel_best();
+}
+
+void demon_store_free(struct demon_store_t* store) {
+    void** arrays[DEMON_ARRAY_COUNT];
+    size_t sizes[DEMON_ARRAY_COUNT];
+    demon_store_arrays(store, arrays, sizes);
+
+    for(int a = 0;a < DEMON_ARRAY_COUNT;a++) {
+        free(*arrays[a]);
+    }
+    memset(store, 0, sizeof(struct demon_store_t));
+}
+
+// Removes every demon, the arrays stay allocated for reuse
+void demon_store_clear(struct demon_store_t* store) {
+    store->count = 0;
+}
+
+int demon_store_grow(struct demon_store_t* store) {
+    size_t capacity = store->capacity ? store->capacity * 2 : 256;
+
+    void** arrays[DEMON_ARRAY_COUNT];
+    size_t sizes[DEMON_ARRAY_COUNT];
+    demon_store_arrays(store, arrays, sizes);
+
+    // a failed realloc keeps the old array, the ones grown before it are just bigger
+    for(int a = 0;a < DEMON_ARRAY_COUNT;a++) {
+        void* array = realloc(*arrays[a], sizes[a] * capacity);
+        if (!array) {
+            return 0;
+        }
+        *arrays[a] = array;
+    }
+
+    store->capacity = capacity;
+    return 1;
+}
+
+// Appends a zeroed demon, returns its index or DEMON_NONE when out of memory
+size_t demon_store_add(struct demon_store_t* store) {
+    if (store->count == store->capacity && !demon_store_grow(store)) {
+        log_info("Out of memory for demons");
+        return DEMON_NONE;
+    }
+
+    size_t i = store->count;
+    store->count++;
+
+    void** arrays[DEMON_ARRAY_COUNT];
+    size_t sizes[DEMON_ARRAY_COUNT];
+    demon_store_arrays(store, arrays, sizes);
+
+    for(int a = 0;a < DEMON_ARRAY_COUNT;a++) {
+        memset((unsigned char*)*arrays[a] + i * sizes[a], 0, sizes[a]);
+    }
+
+    if (store->count > store->high_water) {
+        store->high_water = store->count;
+
+        // once, the first time it happens
+        if (store->soft_budget && store->high_water == store->soft_budget + 1) {
+            printf("WARNING: demons are over their budget of %zu\n", store->soft_budget);
+        }
+    }
+
+    return i;
+}
+
+// Drops the marked demons and closes the gaps, the rest keep their order.
+// Returns how many were removed.
+size_t demon_store_remove_marked(struct demon_store_t* store) {
+    void** arrays[DEMON_ARRAY_COUNT];
+    size_t sizes[DEMON_ARRAY_COUNT];
+    demon_store_arrays(store, arrays, sizes);
+
+    size_t kept = 0;
+    for(size_t i = 0;i < store->count;i++) {
+        if (store->marked_for_removal[i]) {
+            continue;
+        }
+        if (kept != i) {
+            for(int a = 0;a < DEMON_ARRAY_COUNT;a++) {
+                unsigned char* array = *arrays[a];
+                memcpy(array + kept * sizes[a], array + i * sizes[a], sizes[a]);
+            }
+        }
+        kept++;
+    }
+
+    size_t removed = store->count - kept;
+    store->count = kept;
+    return removed;
+}
+
+void demon_store_box(struct demon_store_t* store, size_t i, struct aabb_t* box) {
+    box->min = vec3(store->min_x[i], store->min_y[i], store->min_z[i]);
+    box->max = vec3(store->max_x[i], store->max_y[i], store->max_z[i]);
+}
+
+// The world boxes for the batch tests in cull.c, valid until the store changes
+void demon_store_boxes(struct demon_store_t* store, struct aabb_soa_t* boxes) {
+    boxes->min_x = store->min_x;
+    boxes->min_y = store->min_y;
+    boxes->min_z = store->min_z;
+    boxes->max_x = store->max_x;
+    boxes->max_y = store->max_y;
+    boxes->max_z = store->max_z;
+    boxes->count = store->count;
+    boxes->capacity = 0;
+}
+
+void demon_store_set_sprite(struct demon_store_t* store, size_t i, struct sprite3d_t* sprite) {
+    store->sprite[i] = sprite;
+
+    // the kernel adds the position without the null box check of aabb_translate
+    assert(!aabb_is_null(&sprite->local_aabb));
+
+    store->local_min_x[i] = sprite->local_aabb.min.x;
+    store->local_min_y[i] = sprite->local_aabb.min.y;
+    store->local_min_z[i] = sprite->local_aabb.min.z;
+    store->local_max_x[i] = sprite->local_aabb.max.x;
+    store->local_max_y[i] = sprite->local_aabb.max.y;
+    store->local_max_z[i] = sprite->local_aabb.max.z;
+}
+
+// Moves one demon outside the kernel, the box follows
+void demon_store_set_position(struct demon_store_t* store, size_t i, struct vec3_t* position) {
+    store->pos_x[i] = position->x;
+    store->pos_y[i] = position->y;
+    store->pos_z[i] = position->z;
+
+    store->min_x[i] = store->local_min_x[i] + position->x;
+    store->min_y[i] = store->local_min_y[i] + position->y;
+    store->min_z[i] = store->local_min_z[i] + position->z;
+    store->max_x[i] = store->local_max_x[i] + position->x;
+    store->max_y[i] = store->local_max_y[i] + position->y;
+    store->max_z[i] = store->local_max_z[i] + position->z;
+}
+
+// Start of a tick, the current positions become the ones rendering interpolates from
+void demon_store_save_previous(struct demon_store_t* store) {
+    if (store->count == 0) {
+        return;
+    }
+    memcpy(store->prev_x, store->pos_x, sizeof(float) * store->count);
+    memcpy(store->prev_y, store->pos_y, sizeof(float) * store->count);
+    memcpy(store->prev_z, store->pos_z, sizeof(float) * store->count);
+}
+
+void demon_store_report(struct demon_store_t* store) {
+    void** arrays[DEMON_ARRAY_COUNT];
+    size_t sizes[DEMON_ARRAY_COUNT];
+    demon_store_arrays(store, arrays, sizes);
+
+    size_t bytes = 0;
+    for(int a = 0;a < DEMON_ARRAY_COUNT;a++) {
+        bytes += sizes[a] * store->capacity;
+    }
+
+    printf("demons: %zu live, high water %zu, budget %zu, capacity %zu (%zu KB), %s kernel\n",
+           store->count, store->high_water, store->soft_budget, store->capacity, bytes / 1024,
+           demon_kernel_name(demon_kernel_best()));
+}
+
+// Kernels, demons [begin, end)
+
+void demon_chase_scalar(struct demon_store_t* s, size_t begin, size_t end, struct vec3_t* target, float dt) {
+    for(size_t i = begin;i < end;i++) {
+        float x = s->pos_x[i];
+        float y = s->pos_y[i];
+        float z = s->pos_z[i];
+
+        if (s->state[i] == DEMON_STATE_WALKING) {
+            float dx = target->x - x;
+            float dy = target->y - y;
+            float dz = target->z - z;
+            float length = sqrtf((dx * dx) + (dy * dy) + (dz * dz));
+
+            float step = s->speed[i] * dt;
+            x = x + (dx / length) * step;
+            y = y + (dy / length) * step;
+            z = z + (dz / length) * step;
+
+            s->pos_x[i] = x;
+            s->pos_y[i] = y;
+            s->pos_z[i] = z;
+        }
+
+        s->min_x[i] = s->local_min_x[i] + x;
+        s->min_y[i] = s->local_min_y[i] + y;
+        s->min_z[i] = s->local_min_z[i] + z;
+        s->max_x[i] = s->local_max_x[i] + x;
+        s->max_y[i] = s->local_max_y[i] + y;
+        s->max_z[i] = s->local_max_z[i] + z;
+
+        float ex = x - target->x;
+        float ey = y - target->y;
+        float ez = z - target->z;
+        s->player_dist[i] = sqrtf((ex * ex) + (ey * ey) + (ez * ez));
+    }
+}
+
+#ifdef DEMON_SSE2
+// Returns where the scalar tail starts
+size_t demon_chase_sse2(struct demon_store_t* s, size_t begin, size_t end, struct vec3_t* target, float dt) {
+    __m128 tx = _mm_set1_ps(target->x);
+    __m128 ty = _mm_set1_ps(target->y);
+    __m128 tz = _mm_set1_ps(target->z);
+    __m128 vdt = _mm_set1_ps(dt);
+    __m128i walking_state = _mm_set1_epi32(DEMON_STATE_WALKING);
+
+    size_t i = begin;
+    for(;i + 4 <= end;i += 4) {
+        __m128 x = _mm_loadu_ps(s->pos_x + i);
+        __m128 y = _mm_loadu_ps(s->pos_y + i);
+        __m128 z = _mm_loadu_ps(s->pos_z + i);
+
+        __m128 walking = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_loadu_si128((__m128i*)(s->state + i)), walking_state));
+
+        // the lanes that don't walk compute garbage and keep their position
+        __m128 dx = _mm_sub_ps(tx, x);
+        __m128 dy = _mm_sub_ps(ty, y);
+        __m128 dz = _mm_sub_ps(tz, z);
+        __m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz)));
+
+        __m128 step = _mm_mul_ps(_mm_loadu_ps(s->speed + i), vdt);
+        __m128 nx = _mm_add_ps(x, _mm_mul_ps(_mm_div_ps(dx, length), step));
+        __m128 ny = _mm_add_ps(y, _mm_mul_ps(_mm_div_ps(dy, length), step));
+        __m128 nz = _mm_add_ps(z, _mm_mul_ps(_mm_div_ps(dz, length), step));
+
+        x = _mm_or_ps(_mm_and_ps(walking, nx), _mm_andnot_ps(walking, x));
+        y = _mm_or_ps(_mm_and_ps(walking, ny), _mm_andnot_ps(walking, y));
+        z = _mm_or_ps(_mm_and_ps(walking, nz), _mm_andnot_ps(walking, z));
+
+        _mm_storeu_ps(s->pos_x + i, x);
+        _mm_storeu_ps(s->pos_y + i, y);
+        _mm_storeu_ps(s->pos_z + i, z);
+
+        _mm_storeu_ps(s->min_x + i, _mm_add_ps(_mm_loadu_ps(s->local_min_x + i), x));
+        _mm_storeu_ps(s->min_y + i, _mm_add_ps(_mm_loadu_ps(s->local_min_y + i), y));
+        _mm_storeu_ps(s->min_z + i, _mm_add_ps(_mm_loadu_ps(s->local_min_z + i), z));
+        _mm_storeu_ps(s->max_x + i, _mm_add_ps(_mm_loadu_ps(s->local_max_x + i), x));
+        _mm_storeu_ps(s->max_y + i, _mm_add_ps(_mm_loadu_ps(s->local_max_y + i), y));
+        _mm_storeu_ps(s->max_z + i, _mm_add_ps(_mm_loadu_ps(s->local_max_z + i), z));
+
+        __m128 ex = _mm_sub_ps(x, tx);
+        __m128 ey = _mm_sub_ps(y, ty);
+        __m128 ez = _mm_sub_ps(z, tz);
+        _mm_storeu_ps(s->player_dist + i, _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(ex, ex), _mm_mul_ps(ey, ey)), _mm_mul_ps(ez, ez))));
+    }
+    return i;
+}
+#endif
+
+#ifdef DEMON_AVX2
+DEMON_TARGET_AVX2
+size_t demon_chase_avx2(struct demon_store_t* s, size_t begin, size_t end, struct vec3_t* target, float dt) {
+    __m256 tx = _mm256_set1_ps(target->x);
+    __m256 ty = _mm256_set1_ps(target->y);
+    __m256 tz = _mm256_set1_ps(target->z);
+    __m256 vdt = _mm256_set1_ps(dt);
+    __m256i walking_state = _mm256_set1_epi32(DEMON_STATE_WALKING);
+
+    size_t i = begin;
+    for(;i + 8 <= end;i += 8) {
+        __m256 x = _mm256_loadu_ps(s->pos_x + i);
+        __m256 y = _mm256_loadu_ps(s->pos_y + i);
+        __m256 z = _mm256_loadu_ps(s->pos_z + i);
+
+        __m256 walking = _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_loadu_si256((__m256i*)(s->state + i)), walking_state));
+
+        __m256 dx = _mm256_sub_ps(tx, x);
+        __m256 dy = _mm256_sub_ps(ty, y);
+        __m256 dz = _mm256_sub_ps(tz, z);
+        __m256 length = _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)), _mm256_mul_ps(dz, dz)));
+
+        __m256 step = _mm256_mul_ps(_mm256_loadu_ps(s->speed + i), vdt);
+        __m256 nx = _mm256_add_ps(x, _mm256_mul_ps(_mm256_div_ps(dx, length), step));
+        __m256 ny = _mm256_add_ps(y, _mm256_mul_ps(_mm256_div_ps(dy, length), step));
+        __m256 nz = _mm256_add_ps(z, _mm256_mul_ps(_mm256_div_ps(dz, length), step));
+
+        x = _mm256_blendv_ps(x, nx, walking);
+        y = _mm256_blendv_ps(y, ny, walking);
+        z = _mm256_blendv_ps(z, nz, walking);
+
+        _mm256_storeu_ps(s->pos_x + i, x);
+        _mm256_storeu_ps(s->pos_y + i, y);
+        _mm256_storeu_ps(s->pos_z + i, z);
+
+        _mm256_storeu_ps(s->min_x + i, _mm256_add_ps(_mm256_loadu_ps(s->local_min_x + i), x));
+        _mm256_storeu_ps(s->min_y + i, _mm256_add_ps(_mm256_loadu_ps(s->local_min_y + i), y));
+        _mm256_storeu_ps(s->min_z + i, _mm256_add_ps(_mm256_loadu_ps(s->local_min_z + i), z));
+        _mm256_storeu_ps(s->max_x + i, _mm256_add_ps(_mm256_loadu_ps(s->local_max_x + i), x));
+        _mm256_storeu_ps(s->max_y + i, _mm256_add_ps(_mm256_loadu_ps(s->local_max_y + i), y));
+        _mm256_storeu_ps(s->max_z + i, _mm256_add_ps(_mm256_loadu_ps(s->local_max_z + i), z));
+
+        __m256 ex = _mm256_sub_ps(x, tx);
+        __m256 ey = _mm256_sub_ps(y, ty);
+        __m256 ez = _mm256_sub_ps(z, tz);
+        _mm256_storeu_ps(s->player_dist + i, _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ex, ex), _mm256_mul_ps(ey, ey)), _mm256_mul_ps(ez, ez))));
+    }
+    return i;
+}
+
+int demon_cpu_has_avx2() {
+#ifdef _MSC_VER
+    int regs[4];
+    __cpuid(regs, 1);
+    // the OS has to save the ymm registers too
+    if (!(regs[2] & (1 << 27)) || (_xgetbv(0) & 6) != 6) {
+        return 0;
+    }
+    __cpuidex(regs, 7, 0);
+    return (regs[1] & (1 << 5)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+#endif
+
+int demon_kernel_best() {
+    static int best = -1;
+
+    if (best < 0) {
+        best = DEMON_KERNEL_SCALAR;
+#ifdef DEMON_SSE2
+        best = DEMON_KERNEL_SSE2;
+#endif
+#ifdef DEMON_AVX2
+        if (demon_cpu_has_avx2()) {
+            best = DEMON_KERNEL_AVX2;
+        }
+#endif
+    }
+    return best;
+}
+
+const char* demon_kernel_name(int kernel) {
+    switch (kernel) {
+        case DEMON_KERNEL_SSE2: return "sse2";
+        case DEMON_KERNEL_AVX2: return "avx2";
+    }
+    return "scalar";
+}
+
+// Runs the given kernel over demons [begin, end), one this build or CPU doesn't have
+// falls back to the next best. Every demon only touches its own slots, so threads can
+// run ranges of the same store.
+void demon_store_chase_kernel(struct demon_store_t* store, int kernel, size_t begin, size_t end, struct vec3_t* target, float dt) {
+    size_t i = begin;
+
+#ifdef DEMON_AVX2
+    if (kernel == DEMON_KERNEL_AVX2 && demon_kernel_best() == DEMON_KERNEL_AVX2) {
+        i = demon_chase_avx2(store, i, end, target, dt);
+    }
+#endif
+#ifdef DEMON_SSE2
+    if (kernel != DEMON_KERNEL_SCALAR) {
+        i = demon_chase_sse2(store, i, end, target, dt);
+    }
+#endif
+
+    demon_chase_scalar(store, i, end, target, dt);
+}
+
+void demon_store_chase(struct demon_store_t* store, size_t begin, size_t end, struct vec3_t* target, float dt) {
+    demon_store_chase_kernel(store, demon_kernel_best(), begin, end, target, dt);
+}
@@ -1,263 +1,71 @@
-#include "doom.h"
-
-struct cb_frame_data_t {
-    struct mat4_t proj;
-    struct mat4_t proj_ortho;
-    struct mat4_t view;
-    float width;
-    float height;
-};
-
-struct cb_object_data_t {
-    struct mat4_t world;
-    float opacity;
-};
-
-#define DEMON_STATE_WALKING 1
-#define DEMON_STATE_ATTACKING 2
-#define DEMON_STATE_DYING 3
-
-#define DEMON_TYPE_IMP 1
-#define DEMON_TYPE_ARCH 2
-
-struct demon_t {
-    struct sprite3d_t* sprite;
-    struct vec3_t position;
-    float speed;
-    float health;
-    int state;
-    int type;
-
-    struct aabb_t world_aabb; // world space bounding box
-
-    float animation_frame;
-    int animation_reverse;
-};
-
-#define PICKUP_OBJECT_HEALTH 1
-#define PICKUP_OBJECT_AMMO 2
-#define PICKUP_OBJECT_ARMOR 3
-
-struct pickup_object_t {
-    // TODO: Replace with 3D mesh?
-    struct sprite3d_t* sprite;
-
-    struct vec3_t position;
-    struct aabb_t world_aabb; // world space bounding box
-
-    char type;
-};
-
-#define MAX_PICKUP_OBJECT 100
-
-struct projectile_t {
-    struct sprite3d_t* sprite;
-    struct vec3_t origin; // where it starts
-    struct vec3_t position; // current position
-    struct vec3_t direction;
-    int marked_for_removal;
-
-    struct aabb_t world_aabb; // world space bounding box
-};
-
-#define MAX_PROJECTTILE 100
-
-struct animated_effect_t {
-    struct sprite3d_t* sprite;
-    float frame;
-    int max_frame;
-    struct vec3_t position;
-    int effect_type;
-};
-
-#define EFFECT_IMPACT 1
-#define EFFECT_BLOOD 2
-#define EFFECT_SPAWN 3
-
-#define MAX_ANIMATED_EFFECTS 20
-
-#define GAME_STATE_MENU 1
-#define GAME_STATE_TUTORIAL 2
-#define GAME_STATE_PLAYING 3
-#define GAME_STATE_PAUSE 4
-#define GAME_STATE_DEAD 5
-#define GAME_STATE_SCORE 6
-
-#define WEAPON_HAND 1
-#define WEAPON_PISTOL 2
-
-#define SCREEN_FLASH_RED 1
-#define SCREEN_FLASH_GREEN 2
-
-struct game_t {
-    int width, height;
-    GLFWwindow* window;
-    int quit;
-
-    struct cb_frame_data_t cb_frame_data;
-
-    struct index_buffer_t* quad_ibuf;
-    struct vertex_buffer_t* quad_vbuf;
-
-    struct vertex_buffer_t* sky_vbuf;
-
-    int state;
-    float yaw;
-    float pitch;
-
-    // Dead State stuffs
-    float text_blink_time;
-
-    // Scenes/Objects
-    struct mesh_t* scene;
-
-    // Enemies
-    struct demon_t* demons;
-    size_t demon_count;
-    size_t demon_alloc;
-
-    // Pickup objects
-    struct pickup_object_t* pickup_objects;
-    size_t pickup_objects_count;
-
-    // Effects
-    struct animated_effect_t* animated_effects;
-    size_t animated_effects_count;
-
-    // Projectiles
-    struct projectile_t* player_projectiles;
-    size_t player_projectiles_count;
-
-    // 3D Sprites
-    struct sprite3d_t* sprite_imp;
-    struct sprite3d_t* sprite_arch;
-    struct sprite3d_t* sprite_projectile;
-    struct sprite3d_t* sprite_explosion;
-    struct sprite3d_t* sprite_spawn;
-    struct sprite3d_t* sprite_blood;
-
-    struct sprite3d_t* sprite_pickup_health;
-    struct sprite3d_t* sprite_pickup_ammo;
-    struct sprite3d_t* sprite_pickup_armor;
-    struct sprite3d_t* sprite_pickup_pistol;
-
-    int pickup_ammo_firsttime;
-
-    // Textures
-    struct texture_t texture;
-    struct texture_t dev_texture;
-    struct texture_t menu_texture;
-    struct texture_t menu_play_texture;
-    struct texture_t menu_quit_texture;
-    struct texture_t menu_main_texture;
-    struct texture_t menu_resume_texture;
-    struct texture_t menu_skull_texture;
-    struct texture_t cross_hair_texture;
-    struct texture_t hud_texture_health_ammo;
-    struct texture_t font_texture;
-    struct texture_t skull_texture;
-    struct texture_t red_texture;
-    struct texture_t green_texture;
-    struct texture_t dead_text_texture;
-    struct texture_t total_kill_text_texture;
-    struct texture_t paused_text_texture;
-
-    struct texture_t sky_texture;
-
-    // player
-    struct texture_t player_hand_texture;
-    struct texture_t player_pistol_texture;
-
-    // Shaders
-    GLuint sky_shader;
-    GLuint lighting_shader;
-    GLuint sprite3d_shader;
-    GLuint hud_shader;
-
-    // Constant Buffers
-    struct constant_buffer_t* cb_object;
-
-    // Screen Effect
-    float screen_flash_opacity;
-    int screen_flash_type;
-
-    // player
-    struct vec3_t cam_up;
-    struct vec3_t cam_right;
-    struct vec3_t cam_dir;
-    struct vec3_t cam_pos;
-    struct vec3_t player_pos;
-    struct vec3_t player_velocity;
-    float player_height;
-    int player_health;
-    int player_ammo;
-    int player_armor;
-    int player_state_attacking;
-    int player_kill_count;
-    int player_state_taking_damage;
-
-    int player_weapon_type;
-
-    float pistol_animation_time;
-
-    float demon_spwan_rate;
-    float dead_state_wait_time;
-};
+#include <stddef.h>
+#include "game.h"
 
 struct game_t* game = 0;
 
-struct demon_t* game_spawn_demon(float x, float y, float z) {
-    if (game->demon_count >= game->demon_alloc) {
-        log_error("MAX DEMON LIMIT EXCEEDED");
-        return 0;
-    }
-    struct demon_t* new_demon = &game->demons[game->demon_count];
-    game->demon_count++;
-
-    new_demon->health = 100;
-
-    new_demon->position.x = x;
-    new_demon->position.y = y;
-    new_demon->position.z = z;
+size_t game_spawn_demon(float x, float y, float z) {
+    struct demon_store_t* demons = &game->demons;
 
     int demon_exist = 0;
-    for(int i = 0;i < game->demon_count;i++) {
-        struct demon_t* demon = &game->demons[i];
-        if (demon->type == DEMON_TYPE_ARCH) {
+    for(size_t i = 0;i < demons->count;i++) {
+        if (demons->type[i] == DEMON_TYPE_ARCH) {
             demon_exist = 1;
         }
     }
 
-    int rnd = get_rand(1, 10);
+    size_t new_demon = demon_store_add(demons);
+    if (new_demon == DEMON_NONE) {
+        return DEMON_NONE;
+    }
+
+    demons->health[new_demon] = 100;
+
+    int rnd = rng_int(&game->rng_spawn, 1, 10);
 
     if ((rnd % 2) && rnd > 6 && demon_exist == 0 && game->player_kill_count > 50) {
-        new_demon->type = DEMON_TYPE_ARCH;
+        demons->type[new_demon] = DEMON_TYPE_ARCH;
     } else {
-        new_demon->type = DEMON_TYPE_IMP;
+        demons->type[new_demon] = DEMON_TYPE_IMP;
     }
 
-    if (new_demon->type == DEMON_TYPE_ARCH) {
-        new_demon->sprite = game->sprite_arch;
-        new_demon->speed = get_randf(4.0f, 5.0f);
+    if (demons->type[new_demon] == DEMON_TYPE_ARCH) {
+        demon_store_set_sprite(demons, new_demon, game->sprite_arch);
+        demons->speed[new_demon] = rng_float(&game->rng_spawn, 4.0f, 5.0f);
     } else {
-        new_demon->sprite = game->sprite_imp;
-        new_demon->speed = get_randf(3.0f, 4.5f);
+        demon_store_set_sprite(demons, new_demon, game->sprite_imp);
+        demons->speed[new_demon] = rng_float(&game->rng_spawn, 3.0f, 4.5f);
     }
 
-    new_demon->state = DEMON_STATE_WALKING;
+    demons->state[new_demon] = DEMON_STATE_WALKING;
+
+    demons->animation_frame[new_demon] = 0.0f;
+    demons->animation_reverse[new_demon] = 0;
 
-    new_demon->animation_frame = 0.0f;
-    new_demon->animation_reverse = 0;
+    struct vec3_t position = vec3(x, y, z);
+    demon_store_set_position(demons, new_demon, &position);
 
-    new_demon->world_aabb = new_demon->sprite->local_aabb;
-    aabb_translate(&new_demon->world_aabb, &new_demon->position);
+    // nothing to interpolate from yet
+    demons->prev_x[new_demon] = x;
+    demons->prev_y[new_demon] = y;
+    demons->prev_z[new_demon] = z;
 
     return new_demon;
 }
 
+// game->demon_hits big enough for every demon
+void game_demon_hits_reserve() {
+    if (game->demon_hit_capacity < game->demons.count) {
+        game->demon_hit_capacity = game->demons.capacity;
+        game->demon_hits = realloc(game->demon_hits, sizeof(unsigned int) * game->demon_hit_capacity);
+    }
+}
+
 void render_world() {
+    PROFILE_BEGIN("render_world");
 
     // Render sky
+    gpu_timer_begin(game->gpu_timer, GPU_PASS_SKY, "gpu sky");
+
     glDisable(GL_CULL_FACE);
 	glDisable(GL_DEPTH_TEST);
 
@@ -272,7 +80,11 @@ void render_world() {
 
     glEnable(GL_DEPTH_TEST);
 
+    gpu_timer_end(game->gpu_timer);
+
     // Render the level mesh
+    gpu_timer_begin(game->gpu_timer, GPU_PASS_LEVEL, "gpu level");
+
     glUseProgram(game->lighting_shader);
 
     glActiveTexture(GL_TEXTURE0);
@@ -284,152 +96,143 @@ void render_world() {
 
     glDrawElements(GL_TRIANGLES, game->scene->index_buffer->count, GL_UNSIGNED_INT, 0);
 
+    gpu_timer_end(game->gpu_timer);
+
     // Render 3D sprites/billboards
 
     glUseProgram(game->sprite3d_shader);
 
-    struct cb_object_data_t cb_object_data;
-
-    //Demons
-    for(int i = 0;i < game->demon_count;i++) {
-
-        struct demon_t* demon = &game->demons[i];
-
-        mat4_identity(&cb_object_data.world);
-        mat4_translate(&cb_object_data.world, &demon->position);
-
-        constant_buffer_update(game->cb_object, &cb_object_data);
-
-        sprite3d_render(demon->sprite, demon->animation_frame);
+    // Demons, the ones in view. Their boxes are where the last tick left them,
+    // the pad covers the step back to where they are drawn.
+    struct demon_store_t* demons = &game->demons;
+    struct aabb_soa_t boxes;
+    demon_store_boxes(demons, &boxes);
+    game_demon_hits_reserve();
+    size_t visible_count = aabb_soa_frustum(&boxes, &game->frustum, DEMON_CULL_PAD, game->demon_hits);
+
+    for(size_t v = 0;v < visible_count;v++) {
+        size_t i = game->demon_hits[v];
+        struct vec3_t prev = vec3(demons->prev_x[i], demons->prev_y[i], demons->prev_z[i]);
+        struct vec3_t position = vec3(demons->pos_x[i], demons->pos_y[i], demons->pos_z[i]);
+        position = vec3_lerp(&prev, &position, game->render_alpha);
+        sprite3d_push(demons->sprite[i], &position, demons->animation_frame[i]);
     }
 
     // Pickups
-    for(int i = 0;i < game->pickup_objects_count;i++) {
-
-        struct pickup_object_t* obj = &game->pickup_objects[i];
-
-        mat4_identity(&cb_object_data.world);
-        mat4_translate(&cb_object_data.world, &obj->position);
-
-        constant_buffer_update(game->cb_object, &cb_object_data);
+    for(size_t i = 0;i < game->pickup_objects.slot_count;i++) {
+        struct pickup_object_t* obj = pool_get(&game->pickup_objects, i);
+        if (obj) {
+            sprite3d_push(obj->sprite, &obj->position, 0);
+        }
+    }
 
-        sprite3d_render(obj->sprite, 0);
+    // Effects
+    for(size_t i = 0;i < game->animated_effects.slot_count;i++) {
+        struct animated_effect_t* explosion = pool_get(&game->animated_effects, i);
+        if (explosion) {
+            sprite3d_push(explosion->sprite, &explosion->position, explosion->frame);
+        }
     }
 
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    // Projectiles
+    for(size_t i = 0;i < game->player_projectiles.slot_count;i++) {
+        struct projectile_t* projectile = pool_get(&game->player_projectiles, i);
+        if (projectile) {
+            struct vec3_t position = vec3_lerp(&projectile->prev_position, &projectile->position, game->render_alpha);
+            sprite3d_push(projectile->sprite, &position, 0);
+        }
+    }
 
-    // Render Effects
-    for(int i = 0;i < game->animated_effects_count;i++) {
-        struct animated_effect_t* explosion = &game->animated_effects[i];
+    // one draw per sprite sheet
+    struct sprite3d_t* opaque_sprites[] = {
+        game->sprite_imp,
+        game->sprite_arch,
+        game->sprite_pickup_health,
+        game->sprite_pickup_ammo,
+        game->sprite_pickup_armor,
+        game->sprite_pickup_pistol,
+    };
 
-        mat4_identity(&cb_object_data.world);
-        mat4_translate(&cb_object_data.world, &explosion->position);
+    struct sprite3d_t* blended_sprites[] = {
+        game->sprite_spawn,
+        game->sprite_explosion,
+        game->sprite_blood,
+        game->sprite_projectile,
+    };
 
-        constant_buffer_update(game->cb_object, &cb_object_data);
+    gpu_timer_begin(game->gpu_timer, GPU_PASS_SPRITES, "gpu sprites");
 
-        sprite3d_render(explosion->sprite, explosion->frame);
+    for(int i = 0;i < sizeof(opaque_sprites) / sizeof(opaque_sprites[0]);i++) {
+        sprite3d_flush(opaque_sprites[i], game->uniforms);
     }
 
+    gpu_timer_end(game->gpu_timer);
+    gpu_timer_begin(game->gpu_timer, GPU_PASS_EFFECTS, "gpu effects");
 
-    // Render Projectiles
-    for(int i = 0;i < game->player_projectiles_count;i++) {
-
-        struct projectile_t* projectile = &game->player_projectiles[i];
-
-        mat4_identity(&cb_object_data.world);
-        mat4_translate(&cb_object_data.world, &projectile->position);
-
-        constant_buffer_update(game->cb_object, &cb_object_data);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
-        sprite3d_render(projectile->sprite, 0);
+    for(int i = 0;i < sizeof(blended_sprites) / sizeof(blended_sprites[0]);i++) {
+        sprite3d_flush(blended_sprites[i], game->uniforms);
     }
 
     glDisable(GL_BLEND);
 
+    gpu_timer_end(game->gpu_timer);
+
+    PROFILE_END();
 }
 
-void render_hud_quad_frame(struct texture_t* tex, float x, float y, float width, float height, int frame_w, int frame_h, float frame) {
-    // Set a texture as well
-    glBindTexture(GL_TEXTURE_2D, tex->texture_id);
+// The HUD images are all in game->hud_atlas, every quad of a layer goes in one draw
 
-    float tw = (float)frame_w / tex->width;
-    float th = (float)frame_h / tex->height;
-    // TODO: Only row based frames works
-    int numPerRow = tex->width / frame_w;
+// A frame of a sheet image, the frames go left to right and then top to bottom.
+// Past the last frame it stays on the last one, like sprite3d.vert.
+void render_hud_quad_frame(int layer, int image, float x, float y, float width, float height, int frame_w, int frame_h, float frame) {
+    struct atlas_rect_t* rect = &game->hud_atlas.rects[image];
+    int per_row = rect->width / frame_w;
+    int rows = rect->height / frame_h;
+    if (per_row * rows == 0) {
+        // the image failed to load, or is smaller than a frame
+        return;
+    }
 
     int frame_index = (int)frame;
+    if (frame_index > per_row * rows - 1) {
+        frame_index = per_row * rows - 1;
+    }
+    if (frame_index < 0) {
+        frame_index = 0;
+    }
 
-    float tx = (frame_index % numPerRow) * tw;
-    float ty = (frame_index / numPerRow + 1) * th;
-
-    struct vertex_t quad_varray[] = {
-        {.pos = {x,  y + height, 0.0f}, .uv = {tx, ty + th}},
-        {.pos = {x,  y, 0.0f}, .uv = {tx, ty}},
-        {.pos = {x + width,  y + height, 0.0f}, .uv = {tx + tw, ty + th}},
-        {.pos = {x + width,  y, 0.0f}, .uv = {tx + tw, ty}},
-    };
-
-    glBufferSubData(GL_ARRAY_BUFFER, 0, 4 * sizeof(struct vertex_t), quad_varray);
+    struct vec4_t uv_rect = atlas_uv_rect(&game->hud_atlas, image, (frame_index % per_row) * frame_w,
+                                          (frame_index / per_row) * frame_h, frame_w, frame_h);
 
-    glDrawElements(GL_TRIANGLES, game->quad_ibuf->count, GL_UNSIGNED_INT, 0);
+    sprite_batch_push(game->hud_batch, layer, &game->hud_atlas.texture, x, y, width, height, uv_rect, 1.0f);
 }
 
-void render_hud_quad(struct texture_t* tex, float x, float y, float width, float height) {
-    // Set a texture as well
-    glBindTexture(GL_TEXTURE_2D, tex->texture_id);
-
-    struct vertex_t quad_varray[] = {
-        {.pos = {x,  y + height, 0.0f}, .uv = {0.0f, 1.0f}},
-        {.pos = {x,  y, 0.0f}, .uv = {0.0f, 0.0f}},
-        {.pos = {x + width,  y + height, 0.0f}, .uv = {1.0f, 1.0f}},
-        {.pos = {x + width,  y, 0.0f}, .uv = {1.0f, 0.0f}}
-    };
-
-    glBufferSubData(GL_ARRAY_BUFFER, 0, 4 * sizeof(struct vertex_t), quad_varray);
-
-    glDrawElements(GL_TRIANGLES, game->quad_ibuf->count, GL_UNSIGNED_INT, 0);
+void render_hud_quad_opacity(int layer, int image, float x, float y, float width, float height, float opacity) {
+    sprite_batch_push(game->hud_batch, layer, &game->hud_atlas.texture, x, y, width, height,
+                      game->hud_atlas.rects[image].uv_rect, opacity);
 }
 
-void render_digit(struct texture_t* tex, float x, float y, float width, float height, int number) {
-    // Set a texture as well
-    glBindTexture(GL_TEXTURE_2D, tex->texture_id);
-
-    int frame_w = 8;
-    int frame_h = 7;
-
-    float tw = (float)frame_w / tex->width;
-    float th = (float)frame_h / tex->height;
-    // TODO: Only row based frames works
-    int numPerRow = tex->width / frame_w;
+void render_hud_quad(int layer, int image, float x, float y, float width, float height) {
+    render_hud_quad_opacity(layer, image, x, y, width, height, 1.0f);
+}
 
+void render_digit(int layer, float x, float y, float width, float height, int number) {
     assert(number >= 0 && number <= 9);
 
-    int frame_index = number;
-
-    float tx = (frame_index % numPerRow) * tw;
-    float ty = (frame_index / numPerRow + 1) * th;
-
-    struct vertex_t quad_varray[] = {
-        {.pos = {x,  y + height, 0.0f}, .uv = {tx, ty + th}},
-        {.pos = {x,  y, 0.0f}, .uv = {tx, ty}},
-        {.pos = {x + width,  y + height, 0.0f}, .uv = {tx + tw, ty + th}},
-        {.pos = {x + width,  y, 0.0f}, .uv = {tx + tw, ty}},
-    };
-
-    glBufferSubData(GL_ARRAY_BUFFER, 0, 4 * sizeof(struct vertex_t), quad_varray);
-
-    glDrawElements(GL_TRIANGLES, game->quad_ibuf->count, GL_UNSIGNED_INT, 0);
+    render_hud_quad_frame(layer, HUD_IMAGE_FONT, x, y, width, height, 8, 7, number);
 }
 
-void render_number(struct texture_t* tex, float x, float y, float width, float height, int number) {
+void render_number(int layer, float x, float y, float width, float height, int number) {
     const int base = 10;
     int n = number;
     int digits[10];
     int digit_count = 0;
     float nx = x;
     if (number == 0) {
-        render_digit(tex, nx, y, width, height, 0);
+        render_digit(layer, nx, y, width, height, 0);
         return;
     }
     while(n != 0) {
@@ -439,11 +242,52 @@ void render_number(struct texture_t* tex, float x, float y, float width, float h
         n = n / base;
     }
     for(int i = digit_count - 1; i >= 0;--i) {
-        render_digit(tex, nx, y, width, height, digits[i]);
+        render_digit(layer, nx, y, width, height, digits[i]);
         nx += width + 1;
     }
 }
 
+// GPU milliseconds of every pass as a number (in microseconds) and a bar, top right
+void render_gpu_timer() {
+    float x = game->width - 260.0f;
+    float y = 10.0f;
+
+    for(int pass = 0;pass < GPU_PASS_COUNT;pass++) {
+        float ms = game->gpu_timer->ms[pass];
+
+        render_number(HUD_LAYER_TEXT, x, y, 12, 14, (int)(ms * 1000.0f));
+
+        // 100 pixels per millisecond, anything over 1.5 ms is red
+        float bar_width = fminf(ms * 100.0f, 150.0f);
+        render_hud_quad(HUD_LAYER_TEXT, ms > 1.5f ? HUD_IMAGE_RED : HUD_IMAGE_GREEN, x + 90, y, bar_width, 14);
+
+        y += 20.0f;
+    }
+}
+
+// Draws everything queued in the HUD batch, back to front by layer
+void render_hud_flush() {
+    if (game->show_gpu_timer) {
+        render_gpu_timer();
+    }
+
+    gpu_timer_begin(game->gpu_timer, GPU_PASS_HUD, "gpu hud");
+
+    glUseProgram(game->hud_shader);
+
+    // the layers decide what ends up on top, and all of it goes over the world
+    glDisable(GL_DEPTH_TEST);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+    sprite_batch_flush(game->hud_batch, game->uniforms);
+
+    glDisable(GL_BLEND);
+    glEnable(GL_DEPTH_TEST);
+
+    gpu_timer_end(game->gpu_timer);
+}
+
 float weapon_bob_timer = 0.0f;
 float weapon_bob_speed = 15.0f;
 float weapon_bob_amount = 15.0f;
@@ -459,7 +303,7 @@ void render_player() {
 
     if (game->player_weapon_type == WEAPON_HAND) {
         weapon_width = 260 * 2.5f;
-        weapon_height = game->player_hand_texture.height * 2.5f;
+        weapon_height = game->hud_atlas.rects[HUD_IMAGE_HAND].height * 2.5f;
     }
 
     float weapon_x = center_x - (weapon_width / 2.0f) - 30;
@@ -470,11 +314,11 @@ void render_player() {
 
     if (game->player_weapon_type == WEAPON_HAND) {
 
-        render_hud_quad_frame(&game->player_hand_texture, weapon_x, weapon_y,
+        render_hud_quad_frame(HUD_LAYER_WEAPON, HUD_IMAGE_HAND, weapon_x, weapon_y,
                           weapon_width, weapon_height, 260, 77, game->pistol_animation_time);
 
     } else if (game->player_weapon_type == WEAPON_PISTOL) {
-        render_hud_quad_frame(&game->player_pistol_texture, weapon_x, weapon_y,
+        render_hud_quad_frame(HUD_LAYER_WEAPON, HUD_IMAGE_PISTOL, weapon_x, weapon_y,
                         weapon_width, weapon_height, 78, 103, game->pistol_animation_time);
     }
 }
@@ -484,7 +328,7 @@ const float text_big_scale = 5.0f;
 struct menu_item_t {
     float x, y;
     float width, height;
-    struct texture_t* tex;
+    int image;
     int highlight;
 };
 
@@ -494,14 +338,14 @@ struct menu_item_t menus[MENU_COUNT];
 void render_menu_items() {
     for(int i = 0;i < MENU_COUNT;i++) {
         struct menu_item_t* menu = &menus[i];
-        render_hud_quad(menu->tex, menu->x, menu->y, menu->width, menu->height);
+        render_hud_quad(HUD_LAYER_TEXT, menu->image, menu->x, menu->y, menu->width, menu->height);
 
         if (menu->highlight) {
             float skull_scale = 0.6f;
             float skull_y = menu->y - 3;
             float skull_w = 36 * skull_scale;
-            render_hud_quad(&game->menu_skull_texture, menu->x - skull_w, skull_y, skull_w, 50* skull_scale);
-            render_hud_quad(&game->menu_skull_texture, (menu->x + menu->width), skull_y, skull_w, 50* skull_scale);
+            render_hud_quad(HUD_LAYER_TEXT, HUD_IMAGE_MENU_SKULL, menu->x - skull_w, skull_y, skull_w, 50* skull_scale);
+            render_hud_quad(HUD_LAYER_TEXT, HUD_IMAGE_MENU_SKULL, (menu->x + menu->width), skull_y, skull_w, 50* skull_scale);
         }
     }
 }
@@ -510,42 +354,34 @@ void render_menu_paused() {
     float center_x = game->width / 2.0f;
     float center_y = game->height / 2.0f;
 
-    float text_width = game->paused_text_texture.width * text_big_scale;
-    float text_height = game->paused_text_texture.height * text_big_scale;
-    render_hud_quad(&game->paused_text_texture, center_x - (text_width/2), center_y - (text_height/2), text_width, text_height);
+    struct atlas_rect_t* text = &game->hud_atlas.rects[HUD_IMAGE_TEXT_PAUSED];
+    float text_width = text->width * text_big_scale;
+    float text_height = text->height * text_big_scale;
+    render_hud_quad(HUD_LAYER_TEXT, HUD_IMAGE_TEXT_PAUSED, center_x - (text_width/2), center_y - (text_height/2), text_width, text_height);
 
     render_menu_items();
 }
 
 void render_hud() {
-    glUseProgram(game->hud_shader);
-    glActiveTexture(GL_TEXTURE0);
-
-    struct cb_object_data_t cb_object_data;
-
-    cb_object_data.opacity = 1.0f;
-    constant_buffer_update(game->cb_object, &cb_object_data);
-
-    glBindBuffer(GL_ARRAY_BUFFER, game->quad_vbuf->buffer_object);
-    glBindVertexArray(game->quad_vbuf->array_object);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, game->quad_ibuf->buffer_object);
+    PROFILE_BEGIN("render_hud");
 
     float center_x = game->width / 2.0f;
     float center_y = game->height / 2.0f;
 
     if (game->state == GAME_STATE_DEAD) {
-        float text_width = game->dead_text_texture.width * text_big_scale;
-        float text_height = game->dead_text_texture.height * text_big_scale;
+        struct atlas_rect_t* text = &game->hud_atlas.rects[HUD_IMAGE_TEXT_DEAD];
+        float text_width = text->width * text_big_scale;
+        float text_height = text->height * text_big_scale;
         if (game->text_blink_time > 0.3 && game->text_blink_time < 0.8) {
-            render_hud_quad(&game->dead_text_texture, center_x - (text_width/2), center_y - (text_height/2), text_width, text_height);
+            render_hud_quad(HUD_LAYER_TEXT, HUD_IMAGE_TEXT_DEAD, center_x - (text_width/2), center_y - (text_height/2), text_width, text_height);
         }
     } else if (game->state == GAME_STATE_PAUSE) {
         render_menu_paused();
     }
 
     // Draw Skull/Kill count
-    render_number(&game->font_texture, 120, 50, 30, 35, game->player_kill_count);
-    render_hud_quad(&game->skull_texture, 40, 30, 80, 60);
+    render_number(HUD_LAYER_ICONS, 120, 50, 30, 35, game->player_kill_count);
+    render_hud_quad(HUD_LAYER_ICONS, HUD_IMAGE_SKULL, 40, 30, 80, 60);
 
     if (game->state == GAME_STATE_PLAYING || game->state == GAME_STATE_PAUSE) {
 
@@ -557,7 +393,7 @@ void render_hud() {
                 float cross_x = center_x - (cross_width / 2.0f);
                 float cross_y = center_y - (cross_height / 2.0f);
 
-                render_hud_quad(&game->cross_hair_texture, cross_x, cross_y, cross_width, cross_height);
+                render_hud_quad(HUD_LAYER_ICONS, HUD_IMAGE_CROSSHAIR, cross_x, cross_y, cross_width, cross_height);
             }
         }
 
@@ -567,53 +403,39 @@ void render_hud() {
 
     // Draw Ammo, Health
 
-    float ammo_health_width = game->hud_texture_health_ammo.width * 2.5;
-    float ammo_health_height = game->hud_texture_health_ammo.height * 2.5;
+    struct atlas_rect_t* ammo_health = &game->hud_atlas.rects[HUD_IMAGE_HEALTH_AMMO];
+    float ammo_health_width = ammo_health->width * 2.5;
+    float ammo_health_height = ammo_health->height * 2.5;
 
     float ammo_health_x = 50;
 
-    render_number(&game->font_texture, ammo_health_x + 20, game->height - ammo_health_height + 10, 30, 30, game->player_ammo);
+    render_number(HUD_LAYER_ICONS, ammo_health_x + 20, game->height - ammo_health_height + 10, 30, 30, game->player_ammo);
 
-    render_number(&game->font_texture, ammo_health_x + 140, game->height - ammo_health_height + 10, 30, 30, game->player_health);
+    render_number(HUD_LAYER_ICONS, ammo_health_x + 140, game->height - ammo_health_height + 10, 30, 30, game->player_health);
 
-    render_hud_quad(&game->hud_texture_health_ammo, ammo_health_x,
+    render_hud_quad(HUD_LAYER_PANEL, HUD_IMAGE_HEALTH_AMMO, ammo_health_x,
                         game->height - ammo_health_height, ammo_health_width, ammo_health_height);
 
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-
-
     if (game->screen_flash_opacity > 0.0f) {
-        cb_object_data.opacity = game->screen_flash_opacity;
-        constant_buffer_update(game->cb_object, &cb_object_data);
+        int flash_image = -1;
 
         if (game->screen_flash_type == SCREEN_FLASH_RED) {
-            render_hud_quad(&game->red_texture, 0, 0, game->width, game->height);
+            flash_image = HUD_IMAGE_RED;
         } else if (game->screen_flash_type == SCREEN_FLASH_GREEN) {
-            render_hud_quad(&game->green_texture, 0, 0, game->width, game->height);
+            flash_image = HUD_IMAGE_GREEN;
+        }
+
+        if (flash_image >= 0) {
+            render_hud_quad_opacity(HUD_LAYER_FLASH, flash_image, 0, 0, game->width, game->height, game->screen_flash_opacity);
         }
     }
 
-    glDisable(GL_BLEND);
+    render_hud_flush();
 
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
+    PROFILE_END();
 }
 
 void render_score() {
-    glUseProgram(game->hud_shader);
-    glActiveTexture(GL_TEXTURE0);
-
-    struct cb_object_data_t cb_object_data;
-
-    cb_object_data.opacity = 1.0f;
-    constant_buffer_update(game->cb_object, &cb_object_data);
-
-    glBindBuffer(GL_ARRAY_BUFFER, game->quad_vbuf->buffer_object);
-    glBindVertexArray(game->quad_vbuf->array_object);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, game->quad_ibuf->buffer_object);
-
     float center_x = game->width / 2.0f;
     float center_y = game->height / 2.0f;
 
@@ -623,51 +445,42 @@ void render_score() {
     float text_width = 84 * 5;
     float text_height = 10 * 5;
     float text_y = center_y - 120;
-    render_hud_quad(&game->total_kill_text_texture, center_x - (text_width/2), text_y, text_width, text_height);
+    render_hud_quad(HUD_LAYER_ICONS, HUD_IMAGE_TEXT_FINAL_SCORE, center_x - (text_width/2), text_y, text_width, text_height);
 
     float kill_text_width = 40;
     float kill_text_x = center_x - (kill_text_width/2);
     float kill_text_y = text_y + 80;
-    render_number(&game->font_texture, kill_text_x, kill_text_y, kill_text_width, 45, game->player_kill_count);
+    render_number(HUD_LAYER_ICONS, kill_text_x, kill_text_y, kill_text_width, 45, game->player_kill_count);
 
     float skull_width = 80;
     float skull_height = 60;
-    render_hud_quad(&game->skull_texture, kill_text_x - skull_width - 10, kill_text_y - 10, skull_width, skull_height);
+    render_hud_quad(HUD_LAYER_ICONS, HUD_IMAGE_SKULL, kill_text_x - skull_width - 10, kill_text_y - 10, skull_width, skull_height);
 
-    render_hud_quad(&game->menu_texture, 0, 0, game->width, game->height);
+    render_hud_quad(HUD_LAYER_BACKGROUND, HUD_IMAGE_MENU, 0, 0, game->width, game->height);
 
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
+    render_hud_flush();
 }
 
 void render_menu_main() {
-    glUseProgram(game->hud_shader);
-    glActiveTexture(GL_TEXTURE0);
-
-    struct cb_object_data_t cb_object_data;
-
-    cb_object_data.opacity = 1.0f;
-    constant_buffer_update(game->cb_object, &cb_object_data);
-
-    glBindBuffer(GL_ARRAY_BUFFER, game->quad_vbuf->buffer_object);
-    glBindVertexArray(game->quad_vbuf->array_object);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, game->quad_ibuf->buffer_object);
-
     const float center_x = game->width / 2.0f;
     const float center_y = game->height / 2.0f;
 
-    float h = game->dev_texture.height * 1.5;
+    struct atlas_rect_t* dev = &game->hud_atlas.rects[HUD_IMAGE_DEV];
+    float h = dev->height * 1.5;
 
-    render_hud_quad(&game->dev_texture, 5, game->height - h - 5, game->dev_texture.width * 1.5, h);
+    render_hud_quad(HUD_LAYER_ICONS, HUD_IMAGE_DEV, 5, game->height - h - 5, dev->width * 1.5, h);
 
     render_menu_items();
 
-    render_hud_quad(&game->menu_texture, 0, 0, game->width, game->height);
+    render_hud_quad(HUD_LAYER_BACKGROUND, HUD_IMAGE_MENU, 0, 0, game->width, game->height);
 
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
+    render_hud_flush();
+}
+
+// screen position of a menu item, for scripted input
+void game_menu_item_center(int index, float* x, float* y) {
+    *x = menus[index].x + menus[index].width / 2;
+    *y = menus[index].y + menus[index].height / 2;
 }
 
 void game_menu_items_update(float dt) {
@@ -676,8 +489,8 @@ void game_menu_items_update(float dt) {
         menu->highlight = 0;
     }
 
-    double mouse_x, mouse_y;
-    glfwGetCursorPos(game->window, &mouse_x, &mouse_y);
+    float mouse_x = game->input.mouse_x;
+    float mouse_y = game->input.mouse_y;
 
     for(int i = 0;i < MENU_COUNT;i++) {
         struct menu_item_t* menu = &menus[i];
@@ -699,8 +512,8 @@ void game_menu_update(float dt) {
     const float menu_scale = 3.0f;
     const float menu_gap = 50.0f;
 
-    float menu_play_width = game->menu_play_texture.width * menu_scale;
-    float menu_play_height = game->menu_play_texture.height * menu_scale;
+    float menu_play_width = game->hud_atlas.rects[HUD_IMAGE_TEXT_PLAY].width * menu_scale;
+    float menu_play_height = game->hud_atlas.rects[HUD_IMAGE_TEXT_PLAY].height * menu_scale;
     float menu_play_x = center_x - (menu_play_width/2);
     float menu_play_y = center_y - menu_gap;
 
@@ -708,10 +521,10 @@ void game_menu_update(float dt) {
     menus[0].y = menu_play_y;
     menus[0].width = menu_play_width;
     menus[0].height = menu_play_height;
-    menus[0].tex = &game->menu_play_texture;
+    menus[0].image = HUD_IMAGE_TEXT_PLAY;
 
-    float menu_quit_width = game->menu_quit_texture.width * menu_scale;
-    float menu_quit_height = game->menu_quit_texture.height * menu_scale;
+    float menu_quit_width = game->hud_atlas.rects[HUD_IMAGE_TEXT_QUIT].width * menu_scale;
+    float menu_quit_height = game->hud_atlas.rects[HUD_IMAGE_TEXT_QUIT].height * menu_scale;
     float menu_quit_x = center_x - (menu_quit_width/2);
     float menu_quit_y = center_y;
 
@@ -719,47 +532,47 @@ void game_menu_update(float dt) {
     menus[1].y = menu_quit_y;
     menus[1].width = menu_quit_width;
     menus[1].height = menu_quit_height;
-    menus[1].tex = &game->menu_quit_texture;
+    menus[1].image = HUD_IMAGE_TEXT_QUIT;
 
     game_menu_items_update(dt);
 
-    if (glfwGetKey(game->window, GLFW_KEY_ESCAPE) == GLFW_PRESS) {
+    if (game->input.keys & INPUT_KEY_ESCAPE) {
         game->quit = 1;
     }
 }
 
-void process_mouse_button(GLFWwindow* window, int button, int action, int mods) {
-    if (button == GLFW_MOUSE_BUTTON_LEFT) {
-        if (action == GLFW_RELEASE) {
-            if (game->state == GAME_STATE_MENU) {
-                if (menus[0].highlight) {
-                    glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
-                    game->state = GAME_STATE_PLAYING;
-                    game_reset();
-                } else if (menus[1].highlight) {
-                    game->quit = 1;
-                }
-            } else if (game->state == GAME_STATE_PAUSE) {
-                if (menus[0].highlight) {
-                    game->state = GAME_STATE_PLAYING;
-                    glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
-                } else if (menus[1].highlight) {
-                    game->state = GAME_STATE_MENU;
-                }
-            } else if (game->state == GAME_STATE_SCORE) {
-                if (menus[0].highlight) {
-                    game->quit = 1;
-                } else if (menus[1].highlight) {
-                    game->state = GAME_STATE_MENU;
-                }
-            }
+// left mouse button released on a menu screen
+void game_menu_click() {
+    if (game->state == GAME_STATE_MENU) {
+        if (menus[0].highlight) {
+            platform_capture_cursor(1);
+            game->state = GAME_STATE_PLAYING;
+            game_reset();
+        } else if (menus[1].highlight) {
+            game->quit = 1;
+        }
+    } else if (game->state == GAME_STATE_PAUSE) {
+        if (menus[0].highlight) {
+            game->state = GAME_STATE_PLAYING;
+            platform_capture_cursor(1);
+        } else if (menus[1].highlight) {
+            game->state = GAME_STATE_MENU;
+        }
+    } else if (game->state == GAME_STATE_SCORE) {
+        if (menus[0].highlight) {
+            game->quit = 1;
+        } else if (menus[1].highlight) {
+            game->state = GAME_STATE_MENU;
         }
     }
 }
 
+// Returns 0 when out of memory
 struct animated_effect_t* game_impact_effect_add(struct vec3_t* p, int type) {
-    struct animated_effect_t* explosion = &game->animated_effects[game->animated_effects_count];
-    game->animated_effects_count++;
+    struct animated_effect_t* explosion = pool_alloc(&game->animated_effects);
+    if (!explosion) {
+        return 0;
+    }
 
     if (type == EFFECT_IMPACT) {
         explosion->sprite = game->sprite_explosion;
@@ -781,17 +594,11 @@ struct animated_effect_t* game_impact_effect_add(struct vec3_t* p, int type) {
     return explosion;
 }
 
-void game_impact_effect_remove(int index) {
-    int count = game->animated_effects_count - 1;
-    for(int i = index; i < count; i++) {
-        game->animated_effects[i] = game->animated_effects[i + 1];
-    }
-    game->animated_effects_count--;
-}
-
 void game_pickup_add(struct vec3_t* p, char type) {
-    struct pickup_object_t* obj = &game->pickup_objects[game->pickup_objects_count];
-    game->pickup_objects_count++;
+    struct pickup_object_t* obj = pool_alloc(&game->pickup_objects);
+    if (!obj) {
+        return;
+    }
 
     obj->type = type;
     obj->position = *p;
@@ -815,58 +622,65 @@ void game_pickup_add(struct vec3_t* p, char type) {
     aabb_translate(&obj->world_aabb, &obj->position);
 }
 
-void game_pickup_remove(int index) {
-    int count = game->pickup_objects_count - 1;
-    for(int i = index; i < count; i++) {
-        game->pickup_objects[i] = game->pickup_objects[i + 1];
-    }
-    game->pickup_objects_count--;
-}
+// Indexes the boxes of the live items of an entity pool, box_offset is where the
+// aabb_t is in the item. Query results are pool slots.
+void game_grid_build(struct spatial_hash_t* hash, struct pool_t* pool, size_t box_offset) {
+    spatial_hash_begin(hash, pool->count);
 
-void game_projectile_remove(int index) {
-    int count = game->player_projectiles_count - 1;
-    for(int i = index; i < count; i++) {
-        game->player_projectiles[i] = game->player_projectiles[i + 1];
+    for(size_t i = 0;i < pool->slot_count;i++) {
+        unsigned char* item = pool_get(pool, i);
+        if (item) {
+            spatial_hash_insert(hash, (struct aabb_t*)(item + box_offset), i);
+        }
     }
-    game->player_projectiles_count--;
-}
 
-void game_demon_remove(int index) {
-    int count = game->demon_count - 1;
-    for(int i = index; i < count; i++) {
-        game->demons[i] = game->demons[i + 1];
-    }
-    game->demon_count--;
+    spatial_hash_end(hash);
 }
 
 float camera_impact = 0.0f;
 
 void player_attack_punch(float dt) {
-    for(int i = 0;i < game->demon_count;i++) {
-        struct demon_t* demon = &game->demons[i];
+    float reach = 4.0f;
+
+    struct aabb_t reach_box;
+    reach_box.min = vec3(game->player_pos.x - reach, game->player_pos.y - reach, game->player_pos.z - reach);
+    reach_box.max = vec3(game->player_pos.x + reach, game->player_pos.y + reach, game->player_pos.z + reach);
+
+    struct demon_store_t* demons = &game->demons;
+
+    struct aabb_soa_t boxes;
+    demon_store_boxes(demons, &boxes);
+    game_demon_hits_reserve();
+    size_t candidate_count = aabb_soa_overlap(&boxes, &reach_box, game->demon_hits);
+
+    for(size_t c = 0;c < candidate_count;c++) {
+        size_t i = game->demon_hits[c];
+        struct vec3_t position = vec3(demons->pos_x[i], demons->pos_y[i], demons->pos_z[i]);
 
         // Simple distance based attack collision with the player
-        float player_dist = vec3_distance(&demon->position, &game->player_pos);
+        float player_dist = vec3_distance(&position, &game->player_pos);
 
-        if (player_dist < 4) {
-            if (demon->type == DEMON_TYPE_IMP) {
-                demon->health -= get_randf(8, 20);
+        if (player_dist < reach) {
+            if (demons->type[i] == DEMON_TYPE_IMP) {
+                demons->health[i] -= rng_float(&game->rng_combat, 8, 20);
             } else {
-                demon->health -= get_randf(1, 5);
+                demons->health[i] -= rng_float(&game->rng_combat, 1, 5);
             }
 
-            struct vec3_t punch_pos = vec3(demon->position.x,
-                                           demon->position.y + ((demon->sprite->scale_h) / 2),
-                                           demon->position.z);
+            struct vec3_t punch_pos = vec3(position.x,
+                                           position.y + ((demons->sprite[i]->scale_h) / 2),
+                                           position.z);
 
             struct animated_effect_t* effect = game_impact_effect_add(&punch_pos, EFFECT_BLOOD);
             //effect->frame = 3;
 
             // Apply backward force
-            struct vec3_t dir = vec3_sub(&game->player_pos, &demon->position);
+            struct vec3_t dir = vec3_sub(&game->player_pos, &position);
             vec3_normalize(&dir);
             struct vec3_t velocity = vec3_mulf(&dir, 10.0f * dt);
-            demon->position = vec3_sub(&demon->position, &velocity);
+            position = vec3_sub(&position, &velocity);
+
+            demon_store_set_position(demons, i, &position);
         }
     }
 }
@@ -881,10 +695,12 @@ void player_attack(float dt) {
         game->pistol_animation_time = 0.0f;
         camera_impact = 0.7f;
     } else {
+        struct projectile_t* projectile = 0;
         if (game->player_ammo > 0) {
-            struct projectile_t* projectile = &game->player_projectiles[game->player_projectiles_count];
-            game->player_projectiles_count++;
+            projectile = pool_alloc(&game->player_projectiles);
+        }
 
+        if (projectile) {
             projectile->sprite = game->sprite_projectile;
 
             projectile->origin.x = game->cam_pos.x;
@@ -904,8 +720,8 @@ void player_attack(float dt) {
             projectile->origin = vec3_add(&projectile->origin, &forward);
 
             projectile->position = projectile->origin;
+            projectile->prev_position = projectile->origin;
             projectile->direction = game->cam_dir;
-            projectile->marked_for_removal = 0;
 
             projectile->world_aabb = projectile->sprite->local_aabb;
             aabb_translate(&projectile->world_aabb, &projectile->position);
@@ -928,11 +744,9 @@ int mouse_down = 0;
 
 void game_play_update_mouse_input(float dt) {
 
-    int state = glfwGetMouseButton(game->window, GLFW_MOUSE_BUTTON_LEFT);
-
-    if (state == GLFW_PRESS) {
+    if (game->input.buttons & INPUT_BUTTON_LEFT) {
         if (!mouse_down) {
-            //printf("shoot idx %d\n", game->player_projectiles_count);
+            //printf("shoot idx %zu\n", game->player_projectiles.count);
             player_attack(dt);
             mouse_down = 1;
         }
@@ -948,24 +762,24 @@ void player_update_movement(float dt) {
 
     struct vec3_t old_pos = game->player_pos;
 
-    if (glfwGetKey(game->window, GLFW_KEY_W) == GLFW_PRESS) {
+    if (game->input.keys & INPUT_KEY_W) {
         struct vec3_t vec = {1.0, 0.0, 1.0};
         struct vec3_t new_dir = vec3_mul(&vec, &game->cam_dir);
         moveDir = vec3_add(&moveDir, &new_dir);
     }
-    if (glfwGetKey(game->window, GLFW_KEY_S) == GLFW_PRESS) {
+    if (game->input.keys & INPUT_KEY_S) {
         struct vec3_t vec = {-1.0, 0.0, -1.0};
         struct vec3_t new_dir = vec3_mul(&vec, &game->cam_dir);
         moveDir = vec3_add(&moveDir, &new_dir);
     }
 
-    if (glfwGetKey(game->window, GLFW_KEY_A) == GLFW_PRESS) {
+    if (game->input.keys & INPUT_KEY_A) {
         struct vec3_t vec = {-1.0, 0.0, -1.0};
 
         struct vec3_t new_dir = vec3_mul(&vec, &game->cam_right);
         moveDir = vec3_add(&moveDir, &new_dir);
     }
-    if (glfwGetKey(game->window, GLFW_KEY_D) == GLFW_PRESS) {
+    if (game->input.keys & INPUT_KEY_D) {
         struct vec3_t vec = {1.0, 0.0, 1.0};
 
         struct vec3_t new_dir = vec3_mul(&vec, &game->cam_right);
@@ -1000,8 +814,8 @@ void game_spawn_enimies(float dt) {
     if (demon_spwan_time > game->demon_spwan_rate) {
         demon_spwan_time = 0.0f;
         // the effect will spawn the demon at a specific frame
-        float spawn_x = get_randf(-20, 20);
-        float spawn_z = get_randf(-20, 20);
+        float spawn_x = rng_float(&game->rng_spawn, -20, 20);
+        float spawn_z = rng_float(&game->rng_spawn, -20, 20);
         float spawn_y = 0.0f;
         struct vec3_t spawn_pos = vec3(spawn_x, spawn_y, spawn_z);
         game_impact_effect_add(&spawn_pos, EFFECT_SPAWN);
@@ -1016,7 +830,7 @@ void game_spawn_enimies(float dt) {
 
 void game_increase_spawn_rate() {
     // Increase spawn rate as we kill ^_^
-    game->demon_spwan_rate -= get_randf(0.03f, 0.1f);
+    game->demon_spwan_rate -= rng_float(&game->rng_spawn, 0.03f, 0.1f);
     // Also, CAP
     if (game->demon_spwan_rate <= 1.5f) {
         game->demon_spwan_rate = 1.5f;
@@ -1024,10 +838,7 @@ void game_increase_spawn_rate() {
 }
 
 void game_play_update_camera(float dt) {
-    double mouse_x, mouse_y;
-    glfwGetCursorPos(game->window, &mouse_x, &mouse_y);
-
-    struct vec2_t mouse_pos = {.x = mouse_x, .y = mouse_y};
+    struct vec2_t mouse_pos = {.x = game->input.mouse_x, .y = game->input.mouse_y};
 
     if (firstMouse) {
         mouse_pos_last = mouse_pos;
@@ -1070,140 +881,404 @@ void game_play_update_camera(float dt) {
     }
 }
 
-void game_play_update_demons(float dt) {
-    int demon_remove_index = -1;
-    for(int i = 0;i < game->demon_count;i++) {
-        struct demon_t* demon = &game->demons[i];
+// Appends a side effect to the buffer of the thread running the job
+void game_event_push(int thread, size_t index, int type, unsigned int arg) {
+    struct game_event_buffer_t* buffer = &game->event_buffers[thread];
 
-        // Make it chase after player!
-        if (demon->state == DEMON_STATE_WALKING) {
-            struct vec3_t dir = vec3_sub(&game->player_pos, &demon->position);
-            vec3_normalize(&dir);
+    if (buffer->count == buffer->capacity) {
+        buffer->capacity = buffer->capacity ? buffer->capacity * 2 : 64;
+        buffer->events = realloc(buffer->events, sizeof(struct game_event_t) * buffer->capacity);
+    }
+
+    struct game_event_t* event = &buffer->events[buffer->count];
+    event->index = index;
+    event->seq = buffer->count;
+    event->type = type;
+    event->arg = arg;
+    buffer->count++;
+}
+
+int game_event_compare(const void* a, const void* b) {
+    const struct game_event_t* ea = a;
+    const struct game_event_t* eb = b;
+    if (ea->index != eb->index) {
+        return (ea->index > eb->index) - (ea->index < eb->index);
+    }
+    // one entity is always handled by one job, so its events share a buffer
+    return (ea->seq > eb->seq) - (ea->seq < eb->seq);
+}
+
+// Applies the events of the last parallel pass in entity order, the way the
+// single threaded loop did them
+void game_apply_events(float dt) {
+    struct demon_store_t* demons = &game->demons;
 
-            struct vec3_t velocity = vec3_mulf(&dir, demon->speed * dt);
+    size_t count = 0;
+    for(int t = 0;t < jobs_thread_count();t++) {
+        count += game->event_buffers[t].count;
+    }
+    if (count == 0) {
+        return;
+    }
 
-            demon->position = vec3_add(&demon->position, &velocity);
+    if (count > game->event_capacity) {
+        game->event_capacity = count * 2;
+        game->events = realloc(game->events, sizeof(struct game_event_t) * game->event_capacity);
+    }
 
-            demon->world_aabb = demon->sprite->local_aabb;
-            aabb_translate(&demon->world_aabb, &demon->position);
+    count = 0;
+    for(int t = 0;t < jobs_thread_count();t++) {
+        struct game_event_buffer_t* buffer = &game->event_buffers[t];
+        if (buffer->count > 0) {
+            memcpy(game->events + count, buffer->events, sizeof(struct game_event_t) * buffer->count);
+            count += buffer->count;
+            buffer->count = 0;
         }
+    }
+
+    qsort(game->events, count, sizeof(struct game_event_t), game_event_compare);
+
+    size_t hit_demon = DEMON_NONE; // a demon takes one projectile per tick
+    int picked_up = 0; // and the player one pickup
+
+    for(size_t e = 0;e < count;e++) {
+        struct game_event_t* event = &game->events[e];
+        size_t i = event->index;
+
+        if (event->type == GAME_EVENT_HIT) {
+            struct projectile_t* projectile = pool_get(&game->player_projectiles, event->arg);
+
+            // taken by a demon before this one
+            if (hit_demon == i || projectile->marked_for_removal) {
+                continue;
+            }
+
+            if (demons->type[i] == DEMON_TYPE_IMP) {
+                demons->health[i] -= rng_float(&game->rng_combat, 18, 50);
+            } else {
+                demons->health[i] -= rng_float(&game->rng_combat, 2, 8);
+            }
+            game_impact_effect_add(&projectile->position, EFFECT_IMPACT);
+
+            projectile->marked_for_removal = 1;
+            hit_demon = i;
+        } else if (event->type == GAME_EVENT_ATTACK) {
+            //if (!game->player_state_taking_damage) {
+                game->player_health -= rng_int(&game->rng_combat, 10, 20);
+                game->player_health = fmax(game->player_health, 0);
+                game->player_state_taking_damage = 1;
+
+                game->screen_flash_opacity = 0.7f;
+                game->screen_flash_type = SCREEN_FLASH_RED;
+            //}
+        } else if (event->type == GAME_EVENT_DROP) {
+            // randomly spawn a pickup object
+            int odds = rng_int(&game->rng_loot, 1, 5);
+
+            if ((odds % 2) == 0) {
+                char pickup_type = rng_int(&game->rng_loot, PICKUP_OBJECT_HEALTH, PICKUP_OBJECT_AMMO);
+                struct vec3_t position = vec3(demons->pos_x[i], demons->pos_y[i], demons->pos_z[i]);
+                game_pickup_add(&position, pickup_type);
+            }
+        } else if (event->type == GAME_EVENT_DEATH) {
+            if (demons->health[i] <= 0 && demons->state[i] != DEMON_STATE_DYING) {
+                game->player_kill_count++;
+                demons->state[i] = DEMON_STATE_DYING;
+
+                // Apply backward force
+                struct vec3_t position = vec3(demons->pos_x[i], demons->pos_y[i], demons->pos_z[i]);
+                struct vec3_t dir = vec3_sub(&game->player_pos, &position);
+                vec3_normalize(&dir);
+                struct vec3_t velocity = vec3_mulf(&dir, 30.0f * dt);
+                position = vec3_sub(&position, &velocity);
+
+                demon_store_set_position(demons, i, &position);
+            }
+        } else if (event->type == GAME_EVENT_SPAWN) {
+            struct animated_effect_t* explosion = pool_get(&game->animated_effects, i);
+            game_spawn_demon(explosion->position.x, explosion->position.y, explosion->position.z);
+        } else if (event->type == GAME_EVENT_PICKUP) {
+            if (picked_up) {
+                continue;
+            }
+            struct pickup_object_t* pickup = pool_get(&game->pickup_objects, event->arg);
+
+            // pickup the object and remove it
+            if (pickup->type == PICKUP_OBJECT_HEALTH) {
+                game->player_health += rng_int(&game->rng_loot, 10, 30);
+                game->player_health = fmin(game->player_health, 100);
+
+                game->screen_flash_opacity = 0.7f;
+                game->screen_flash_type = SCREEN_FLASH_GREEN;
+
+            } else if (pickup->type == PICKUP_OBJECT_AMMO) {
+                game->player_ammo += rng_int(&game->rng_loot, 10, 25);
+                player_switch_weapon(WEAPON_PISTOL);
+
+                game->screen_flash_opacity = 0.7f;
+                game->screen_flash_type = SCREEN_FLASH_GREEN;
+            } else if (pickup->type == PICKUP_OBJECT_ARMOR) {
+                game->player_armor += rng_int(&game->rng_loot, 20, 50);
+                game->player_armor = fmin(game->player_armor, 100);
+
+                game->screen_flash_opacity = 0.7f;
+                game->screen_flash_type = SCREEN_FLASH_GREEN;
+            }
+            pickup->marked_for_removal = 1;
+            picked_up = 1;
+        }
+    }
+}
+
+// Demons [begin, end), only writes their own slots. Everything that touches the
+// player, another entity or a random stream (rng_combat, rng_loot, ...) goes
+// through the event buffer.
+void game_update_demons_job(void* data, size_t begin, size_t end, int thread) {
+    float dt = *(float*)data;
+    struct demon_store_t* demons = &game->demons;
+    struct game_event_buffer_t* buffer = &game->event_buffers[thread];
+
+    // Make them chase after player! Also refreshes their boxes and distances to the player
+    demon_store_chase(demons, begin, end, &game->player_pos, dt);
+
+    for(size_t i = begin;i < end;i++) {
+        int hit = 0;
 
         // Simple distance based attack collision with the player
 
-        if (demon->health > 0) {
-            float player_dist = vec3_distance(&demon->position, &game->player_pos);
+        if (demons->health[i] > 0) {
+            float player_dist = demons->player_dist[i];
 
             if (player_dist < 3.0) {
-                demon->state = DEMON_STATE_ATTACKING;
+                demons->state[i] = DEMON_STATE_ATTACKING;
             } else {
-                demon->state = DEMON_STATE_WALKING;
+                demons->state[i] = DEMON_STATE_WALKING;
             }
 
-            for(int j = 0;j < game->player_projectiles_count;j++) {
+            struct aabb_t world_aabb;
+            demon_store_box(demons, i, &world_aabb);
 
-                struct projectile_t* projectile = &game->player_projectiles[j];
+            // every projectile it touches in index order, the first one no demon
+            // before it took is the hit
+            if (game->projectile_boxes.count <= COLLISION_SWEEP_MAX) {
+                size_t hit_count = aabb_soa_overlap(&game->projectile_boxes, &world_aabb, buffer->results);
 
-                if (projectile->marked_for_removal) {
-                    continue;
+                for(size_t h = 0;h < hit_count;h++) {
+                    game_event_push(thread, i, GAME_EVENT_HIT, game->projectile_slots[buffer->results[h]]);
+                    hit = 1;
                 }
+            } else {
+                size_t candidate_count = spatial_hash_query_into(&game->projectile_grid, &world_aabb,
+                                                                 &buffer->results, &buffer->result_capacity);
 
-                //printf("max %f, %f, %f\n", projectile->world_aabb.max.x, projectile->world_aabb.max.y, projectile->world_aabb.max.z);
-
-                if (aabb_intersect(&demon->world_aabb, &projectile->world_aabb)) {
+                for(size_t c = 0;c < candidate_count;c++) {
+                    unsigned int slot = buffer->results[c];
+                    struct projectile_t* projectile = pool_get(&game->player_projectiles, slot);
 
-                    if (demon->type == DEMON_TYPE_IMP) {
-                        demon->health -= get_randf(18, 50);
-                    } else {
-                        demon->health -= get_randf(2, 8);
+                    if (projectile->marked_for_removal) {
+                        continue;
                     }
-                    game_impact_effect_add(&projectile->position, EFFECT_IMPACT);
 
-                    projectile->marked_for_removal = 1;
-                    break;
+                    if (aabb_intersect(&world_aabb, &projectile->world_aabb)) {
+                        game_event_push(thread, i, GAME_EVENT_HIT, slot);
+                        hit = 1;
+                    }
                 }
             }
         }
 
-        if (demon->state == DEMON_STATE_WALKING) {
-            if (demon->type == DEMON_TYPE_IMP) {
-                if (demon->animation_frame < 3) {
-                    demon->animation_frame += dt * 8.0f;
+        float* animation_frame = &demons->animation_frame[i];
+
+        if (demons->state[i] == DEMON_STATE_WALKING) {
+            if (demons->type[i] == DEMON_TYPE_IMP) {
+                if (*animation_frame < 3) {
+                    *animation_frame += dt * 8.0f;
                 } else {
-                    demon->animation_frame = 0;
+                    *animation_frame = 0;
                 }
             } else {
-                if (demon->animation_reverse) {
-                    demon->animation_frame -= dt * 10.0f;
+                if (demons->animation_reverse[i]) {
+                    *animation_frame -= dt * 10.0f;
 
-                    if (demon->animation_frame < 0) {
-                        demon->animation_frame += dt * 10.0f;
-                        demon->animation_reverse = 0;
+                    if (*animation_frame < 0) {
+                        *animation_frame += dt * 10.0f;
+                        demons->animation_reverse[i] = 0;
                     }
                 } else {
-                    demon->animation_frame += dt * 10.0f;
+                    *animation_frame += dt * 10.0f;
 
-                    if (demon->animation_frame > 3) {
-                        demon->animation_frame -= dt * 10.0f;
-                        demon->animation_reverse = 1;
+                    if (*animation_frame > 3) {
+                        *animation_frame -= dt * 10.0f;
+                        demons->animation_reverse[i] = 1;
                     }
                 }
             }
-        } else if (demon->state == DEMON_STATE_ATTACKING) {
-            if ( demon->animation_frame < 4) {
-                 demon->animation_frame = 4;
+        } else if (demons->state[i] == DEMON_STATE_ATTACKING) {
+            if ( *animation_frame < 4) {
+                 *animation_frame = 4;
             }
-            if (demon->animation_frame < 7) {
-                demon->animation_frame += dt * 15.0f;
+            if (*animation_frame < 7) {
+                *animation_frame += dt * 15.0f;
             } else {
                 // Perform the action at the end of the animation
-                //if (!game->player_state_taking_damage) {
-                    game->player_health -= get_rand(10, 20);
-                    game->player_health = fmax(game->player_health, 0);
-                    game->player_state_taking_damage = 1;
-
-                    game->screen_flash_opacity = 0.7f;
-                    game->screen_flash_type = SCREEN_FLASH_RED;
-                //}
-                demon->animation_frame = 4;
+                game_event_push(thread, i, GAME_EVENT_ATTACK, 0);
+                *animation_frame = 4;
             }
-        } else if (demon->state == DEMON_STATE_DYING) {
-            if ( demon->animation_frame < 7) {
-                 demon->animation_frame = 7;
+        } else if (demons->state[i] == DEMON_STATE_DYING) {
+            if ( *animation_frame < 7) {
+                 *animation_frame = 7;
             }
-            if (demon->animation_frame < 10) {
-                demon->animation_frame += dt * 12.0f;
+            if (*animation_frame < 10) {
+                *animation_frame += dt * 12.0f;
             } else {
-                demon->animation_frame = 10;
-                demon_remove_index = i;
+                *animation_frame = 10;
+                demons->marked_for_removal[i] = 1;
 
-                // randomly spawn a pickup object
-                int odds = get_rand(1, 5);
+                game_event_push(thread, i, GAME_EVENT_DROP, 0);
+            }
+        }
 
-                if ((odds % 2) == 0) {
-                    char pickup_type = get_rand(PICKUP_OBJECT_HEALTH, PICKUP_OBJECT_AMMO);
-                    game_pickup_add(&demon->position, pickup_type);
-                }
+        // a hit can take the last health, only known once the hits are applied
+        if (hit || (demons->health[i] <= 0 && demons->state[i] != DEMON_STATE_DYING)) {
+            game_event_push(thread, i, GAME_EVENT_DEATH, 0);
+        }
+    }
+}
+
+// The boxes of the projectiles that can still hit something, in slot order
+void game_projectile_boxes_build() {
+    struct pool_t* pool = &game->player_projectiles;
+
+    aabb_soa_clear(&game->projectile_boxes);
+
+    if (game->projectile_slot_capacity < pool->count) {
+        game->projectile_slot_capacity = pool->count * 2;
+        game->projectile_slots = realloc(game->projectile_slots, sizeof(unsigned int) * game->projectile_slot_capacity);
+    }
+
+    for(size_t i = 0;i < pool->slot_count;i++) {
+        struct projectile_t* projectile = pool_get(pool, i);
+        if (projectile && !projectile->marked_for_removal) {
+            game->projectile_slots[game->projectile_boxes.count] = i;
+            aabb_soa_push(&game->projectile_boxes, &projectile->world_aabb);
+        }
+    }
+}
+
+void game_play_update_demons(float dt) {
+    PROFILE_BEGIN("game_play_update_demons");
+
+    // the projectiles already moved this tick and stay put while the demons update
+    game_projectile_boxes_build();
+
+    if (game->projectile_boxes.count > COLLISION_SWEEP_MAX) {
+        game_grid_build(&game->projectile_grid, &game->player_projectiles, offsetof(struct projectile_t, world_aabb));
+    } else {
+        // room for every projectile in each thread's results
+        for(int t = 0;t < jobs_thread_count();t++) {
+            struct game_event_buffer_t* buffer = &game->event_buffers[t];
+            if (buffer->result_capacity < game->projectile_boxes.count) {
+                buffer->result_capacity = game->projectile_boxes.capacity;
+                buffer->results = realloc(buffer->results, sizeof(unsigned int) * buffer->result_capacity);
             }
         }
+    }
 
-        if (demon->health <= 0) {
-            if (demon->state != DEMON_STATE_DYING) {
-                game->player_kill_count++;
-                demon->state = DEMON_STATE_DYING;
+    parallel_for(game->demons.count, 256, game_update_demons_job, &dt);
+    game_apply_events(dt);
 
-                // Apply backward force
-                struct vec3_t dir = vec3_sub(&game->player_pos, &demon->position);
-                vec3_normalize(&dir);
-                struct vec3_t velocity = vec3_mulf(&dir, 30.0f * dt);
-                demon->position = vec3_sub(&demon->position, &velocity);
+    PROFILE_END();
+}
+
+void game_update_effects_job(void* data, size_t begin, size_t end, int thread) {
+    float dt = *(float*)data;
+
+    for(size_t i = begin;i < end;i++) {
+        struct animated_effect_t* explosion = pool_get(&game->animated_effects, i);
+        if (!explosion) {
+            continue;
+        }
+
+        if (explosion->frame < (explosion->max_frame-1)) {
+            explosion->frame += dt * 25.0f;
+        } else {
+            if (explosion->effect_type == EFFECT_SPAWN) {
+                game_event_push(thread, i, GAME_EVENT_SPAWN, 0);
             }
+            explosion->marked_for_removal = 1;
+        }
+    }
+}
+
+void game_update_projectiles_job(void* data, size_t begin, size_t end, int thread) {
+    float dt = *(float*)data;
+
+    for(size_t i = begin;i < end;i++) {
+        struct projectile_t* projectile = pool_get(&game->player_projectiles, i);
+        if (!projectile) {
+            continue;
+        }
+
+        float speed = 50.0f;
+
+        // Simply travel through the given direction
+        struct vec3_t accelaration = vec3_mulf(&projectile->direction, speed * dt);
+        projectile->position = vec3_add(&projectile->position, &accelaration);
+
+        float distance = vec3_distance(&projectile->origin, &projectile->position);
+
+        if (distance > 100.0f) {
+            projectile->marked_for_removal = 1;
+        }
+
+        projectile->world_aabb = projectile->sprite->local_aabb;
+        aabb_translate(&projectile->world_aabb, &projectile->position);
+    }
+}
+
+#define PICKUP_REACH 2.0f
+
+// Candidates [begin, end) of the pickup grid query
+void game_update_pickups_job(void* data, size_t begin, size_t end, int thread) {
+    for(size_t c = begin;c < end;c++) {
+        unsigned int slot = game->pickup_grid.results[c];
+        struct pickup_object_t* pickup = pool_get(&game->pickup_objects, slot);
+
+        float dist = vec3_distance(&pickup->position, &game->player_pos);
+
+        if (dist < PICKUP_REACH) {
+            game_event_push(thread, c, GAME_EVENT_PICKUP, slot);
         }
     }
+}
+
+// Releases the marked items of an entity pool, marked_offset is where the int flag is
+// in the item. Returns how many were released.
+size_t game_pool_remove_marked(struct pool_t* pool, size_t marked_offset) {
+    size_t removed = 0;
+
+    for(size_t i = 0;i < pool->slot_count;i++) {
+        unsigned char* item = pool_get(pool, i);
+        if (item && *(int*)(item + marked_offset)) {
+            pool_release(pool, i);
+            removed++;
+        }
+    }
+    return removed;
+}
 
-    if (demon_remove_index >= 0) {
+// End of tick, drops everything that was marked during the tick in one sweep per pool.
+// Items never move, so the draw order of the blended effects and projectiles holds
+// for as long as they live. The demons close the gaps but keep their order.
+void game_remove_marked() {
+    size_t demons_removed = demon_store_remove_marked(&game->demons);
+    for(size_t i = 0;i < demons_removed;i++) {
         game_increase_spawn_rate();
-        game_demon_remove(demon_remove_index);
     }
+
+    game_pool_remove_marked(&game->pickup_objects, offsetof(struct pickup_object_t, marked_for_removal));
+    game_pool_remove_marked(&game->animated_effects, offsetof(struct animated_effect_t, marked_for_removal));
+    game_pool_remove_marked(&game->player_projectiles, offsetof(struct projectile_t, marked_for_removal));
 }
 
 // updates while in playing state
@@ -1269,113 +1344,43 @@ void game_play_update(float dt) {
     }
 
     // Update Effects
-    int explosion_remove_index = -1;
-    for(int i = 0;i < game->animated_effects_count;i++) {
-        struct animated_effect_t* explosion = &game->animated_effects[i];
-
-        if (explosion->frame < (explosion->max_frame-1)) {
-            explosion->frame += dt * 25.0f;
-        } else {
-            if (explosion->effect_type == EFFECT_SPAWN) {
-                game_spawn_demon(explosion->position.x, explosion->position.y, explosion->position.z);
-            }
-            explosion_remove_index = i;
-        }
-    }
-
-    if (explosion_remove_index >= 0) {
-        game_impact_effect_remove(explosion_remove_index);
-    }
+    parallel_for(game->animated_effects.slot_count, 256, game_update_effects_job, &dt);
+    game_apply_events(dt);
 
     // Update Projectiles
-    for(int i = 0;i < game->player_projectiles_count;i++) {
-        struct projectile_t* projectile = &game->player_projectiles[i];
-
-        float speed = 50.0f;
-
-        // Simply travel through the given direction
-        struct vec3_t accelaration = vec3_mulf(&projectile->direction, speed * dt);
-        projectile->position = vec3_add(&projectile->position, &accelaration);
-
-        float distance = vec3_distance(&projectile->origin, &projectile->position);
-
-        if (distance > 100.0f) {
-            projectile->marked_for_removal = 1;
-        }
-
-        projectile->world_aabb = projectile->sprite->local_aabb;
-        aabb_translate(&projectile->world_aabb, &projectile->position);
-    }
-
-    // Check for removal
-    int remove_index = -1;
-    for(int i = 0;i < game->player_projectiles_count;i++) {
-        struct projectile_t* projectile = &game->player_projectiles[i];
-        if (projectile->marked_for_removal) {
-            remove_index = i;
-            break;
-        }
-    }
-    if (remove_index >= 0) {
-        game_projectile_remove(remove_index);
-    }
+    parallel_for(game->player_projectiles.slot_count, 256, game_update_projectiles_job, &dt);
 
     // Update Demons
     game_play_update_demons(dt);
 
     // Update Pickup objects and check for interactions
-    int pickup_remove_index = -1;
-    for(int i = 0;i < game->pickup_objects_count;i++) {
-        struct pickup_object_t* pickup = &game->pickup_objects[i];
-
-        float dist = vec3_distance(&pickup->position, &game->player_pos);
-
-        if (dist < 2) {
-            // pickup the object and remove it
-            if (pickup->type == PICKUP_OBJECT_HEALTH) {
-                game->player_health += get_rand(10, 30);
-                game->player_health = fmin(game->player_health, 100);
-
-                game->screen_flash_opacity = 0.7f;
-                game->screen_flash_type = SCREEN_FLASH_GREEN;
-
-            } else if (pickup->type == PICKUP_OBJECT_AMMO) {
-                game->player_ammo += get_rand(10, 25);
-                player_switch_weapon(WEAPON_PISTOL);
+    struct aabb_t pickup_box;
+    pickup_box.min = vec3(game->player_pos.x - PICKUP_REACH, game->player_pos.y - PICKUP_REACH, game->player_pos.z - PICKUP_REACH);
+    pickup_box.max = vec3(game->player_pos.x + PICKUP_REACH, game->player_pos.y + PICKUP_REACH, game->player_pos.z + PICKUP_REACH);
 
-                game->screen_flash_opacity = 0.7f;
-                game->screen_flash_type = SCREEN_FLASH_GREEN;
-            } else if (pickup->type == PICKUP_OBJECT_ARMOR) {
-                game->player_armor += get_rand(20, 50);
-                game->player_armor = fmin(game->player_armor, 100);
+    game_grid_build(&game->pickup_grid, &game->pickup_objects, offsetof(struct pickup_object_t, world_aabb));
+    size_t pickup_candidates = spatial_hash_query(&game->pickup_grid, &pickup_box);
 
-                game->screen_flash_opacity = 0.7f;
-                game->screen_flash_type = SCREEN_FLASH_GREEN;
-            }
-            pickup_remove_index = i;
-            break;
-        }
-    }
+    // the first one in reach is picked up
+    parallel_for(pickup_candidates, 64, game_update_pickups_job, 0);
+    game_apply_events(dt);
 
-    if (pickup_remove_index >= 0) {
-        game_pickup_remove(pickup_remove_index);
-    }
+    game_remove_marked();
 
     // YAY!
     game_spawn_enimies(dt);
 }
 
-void process_key_press(GLFWwindow* window, int key, int scancode, int action, int mods) {
-    if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS) {
-        if (game->state == GAME_STATE_PLAYING) {
-            game->state = GAME_STATE_PAUSE;
-            firstMouse = 1;
-            glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_NORMAL);
-        } else if (game->state == GAME_STATE_PAUSE) {
-            game->state = GAME_STATE_PLAYING;
-            firstMouse = 1;
-            glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
-        }
+// escape pressed, toggles between playing and the pause menu
+void game_toggle_pause() {
+    if (game->state == GAME_STATE_PLAYING) {
+        game->state = GAME_STATE_PAUSE;
+        firstMouse = 1;
+        platform_capture_cursor(0);
+    } else if (game->state == GAME_STATE_PAUSE) {
+        game->state = GAME_STATE_PLAYING;
+        firstMouse = 1;
+        platform_capture_cursor(1);
     }
 }
 
@@ -1386,10 +1391,10 @@ void game_pause_update(float dt) {
     const float menu_scale = 3.0f;
     const float menu_gap = 50.0f;
 
-    float menu_play_width = game->menu_resume_texture.width * menu_scale;
-    float menu_quit_width = game->menu_main_texture.width * menu_scale;
+    float menu_play_width = game->hud_atlas.rects[HUD_IMAGE_TEXT_RESUME].width * menu_scale;
+    float menu_quit_width = game->hud_atlas.rects[HUD_IMAGE_TEXT_MAIN_MENU].width * menu_scale;
 
-    float menu_play_height = game->menu_resume_texture.height * menu_scale;
+    float menu_play_height = game->hud_atlas.rects[HUD_IMAGE_TEXT_RESUME].height * menu_scale;
     float menu_play_x = center_x - ((menu_play_width + menu_quit_width + menu_gap) / 2);
     float menu_play_y = center_y + menu_gap;
 
@@ -1397,9 +1402,9 @@ void game_pause_update(float dt) {
     menus[0].y = menu_play_y;
     menus[0].width = menu_play_width;
     menus[0].height = menu_play_height;
-    menus[0].tex = &game->menu_resume_texture;
+    menus[0].image = HUD_IMAGE_TEXT_RESUME;
 
-    float menu_quit_height = game->menu_main_texture.height * menu_scale;
+    float menu_quit_height = game->hud_atlas.rects[HUD_IMAGE_TEXT_MAIN_MENU].height * menu_scale;
     float menu_quit_x = menu_play_x + menu_play_width + menu_gap;
     float menu_quit_y = menu_play_y;
 
@@ -1407,7 +1412,7 @@ void game_pause_update(float dt) {
     menus[1].y = menu_quit_y;
     menus[1].width = menu_quit_width;
     menus[1].height = menu_quit_height;
-    menus[1].tex = &game->menu_main_texture;
+    menus[1].image = HUD_IMAGE_TEXT_MAIN_MENU;
 
     game_menu_items_update(dt);
 }
@@ -1419,10 +1424,10 @@ void game_state_score_update(float dt) {
     const float menu_scale = 3.0f;
     const float menu_gap = 50.0f;
 
-    float menu_play_width = game->menu_quit_texture.width * menu_scale;
-    float menu_quit_width = game->menu_main_texture.width * menu_scale;
+    float menu_play_width = game->hud_atlas.rects[HUD_IMAGE_TEXT_QUIT].width * menu_scale;
+    float menu_quit_width = game->hud_atlas.rects[HUD_IMAGE_TEXT_MAIN_MENU].width * menu_scale;
 
-    float menu_play_height = game->menu_quit_texture.height * menu_scale;
+    float menu_play_height = game->hud_atlas.rects[HUD_IMAGE_TEXT_QUIT].height * menu_scale;
     float menu_play_x = center_x - ((menu_play_width + menu_quit_width + menu_gap) / 2);
     float menu_play_y = center_y + menu_gap;
 
@@ -1430,9 +1435,9 @@ void game_state_score_update(float dt) {
     menus[0].y = menu_play_y;
     menus[0].width = menu_play_width;
     menus[0].height = menu_play_height;
-    menus[0].tex = &game->menu_quit_texture;
+    menus[0].image = HUD_IMAGE_TEXT_QUIT;
 
-    float menu_quit_height = game->menu_main_texture.height * menu_scale;
+    float menu_quit_height = game->hud_atlas.rects[HUD_IMAGE_TEXT_MAIN_MENU].height * menu_scale;
     float menu_quit_x = menu_play_x + menu_play_width + menu_gap;
     float menu_quit_y = menu_play_y;
 
@@ -1440,12 +1445,42 @@ void game_state_score_update(float dt) {
     menus[1].y = menu_quit_y;
     menus[1].width = menu_quit_width;
     menus[1].height = menu_quit_height;
-    menus[1].tex = &game->menu_main_texture;
+    menus[1].image = HUD_IMAGE_TEXT_MAIN_MENU;
 
     game_menu_items_update(dt);
 }
 
+// Start of a tick, what rendering interpolates from
+void game_save_previous() {
+    demon_store_save_previous(&game->demons);
+
+    for(size_t i = 0;i < game->player_projectiles.slot_count;i++) {
+        struct projectile_t* projectile = pool_get(&game->player_projectiles, i);
+        if (projectile) {
+            projectile->prev_position = projectile->position;
+        }
+    }
+
+    game->prev_cam_pos = game->cam_pos;
+    game->prev_cam_dir = game->cam_dir;
+    game->prev_cam_up = game->cam_up;
+}
+
+// One fixed tick of the simulation, dt is GAME_TICK_DT except for old replays
 void game_update(float dt) {
+    PROFILE_BEGIN("game_update");
+
+    // every state, so a paused or dead game renders still
+    game_save_previous();
+
+    // events queued by the platform since the last frame
+    if (game->input.events & INPUT_EVENT_CLICK) {
+        game_menu_click();
+    }
+    if (game->input.events & INPUT_EVENT_PAUSE) {
+        game_toggle_pause();
+    }
+
     if (game->state == GAME_STATE_PLAYING) {
         game_play_update(dt);
     } else if (game->state == GAME_STATE_PAUSE) {
@@ -1459,16 +1494,49 @@ void game_update(float dt) {
         game->dead_state_wait_time -= dt * 1.5f;
         if (game->dead_state_wait_time < 1.0f) {
             game->state = GAME_STATE_SCORE;
-            glfwSetInputMode(game->window, GLFW_CURSOR, GLFW_CURSOR_NORMAL);
+            platform_capture_cursor(0);
         }
     } else if (game->state == GAME_STATE_MENU) {
         game_menu_update(dt);
     } else if (game->state == GAME_STATE_SCORE) {
         game_state_score_update(dt);
     }
+
+    PROFILE_END();
 }
 
 void game_render() {
+    PROFILE_BEGIN("game_render");
+
+    // Update the frame constant buffer, the camera is between the last two ticks
+    struct vec3_t cam_pos = game->cam_pos;
+    struct vec3_t cam_dir = game->cam_dir;
+    struct vec3_t cam_up = game->cam_up;
+
+    if (game->render_alpha < 1.0f) {
+        cam_pos = vec3_lerp(&game->prev_cam_pos, &game->cam_pos, game->render_alpha);
+        cam_dir = vec3_lerp(&game->prev_cam_dir, &game->cam_dir, game->render_alpha);
+        cam_up = vec3_lerp(&game->prev_cam_up, &game->cam_up, game->render_alpha);
+        vec3_normalize(&cam_dir);
+        vec3_normalize(&cam_up);
+    }
+
+    struct vec3_t cam_lookat = vec3_add(&cam_pos, &cam_dir);
+
+    mat4_identity(&game->cb_frame_data.view);
+    mat4_lookAt(&game->cb_frame_data.view, &cam_pos, &cam_lookat, &cam_up);
+
+    struct mat4_t view_proj;
+    mat4_mul(&view_proj, &game->cb_frame_data.proj, &game->cb_frame_data.view);
+    frustum_from_matrix(&game->frustum, &view_proj);
+
+    game->cb_frame_data.width = game->width;
+    game->cb_frame_data.height = game->height;
+
+    uniform_arena_begin_frame(game->uniforms);
+    gpu_timer_begin_frame(game->gpu_timer);
+    uniform_arena_bind(game->uniforms, 0, &game->cb_frame_data, sizeof(struct cb_frame_data_t));
+
     if (game->state == GAME_STATE_MENU) {
         render_menu_main();
     } else if (game->state == GAME_STATE_TUTORIAL || game->state == GAME_STATE_PLAYING || game->state == GAME_STATE_PAUSE) {
@@ -1480,6 +1548,10 @@ void game_render() {
     } else if (game->state == GAME_STATE_SCORE) {
         render_score();
     }
+
+    uniform_arena_end_frame(game->uniforms);
+
+    PROFILE_END();
 }
 
 void log_error(const char* msg) {
@@ -1494,10 +1566,6 @@ void log_info2(const char* title, const char* msg) {
     printf("LOG: %s: %s\n", title, msg);
 }
 
-void process_mouse_move(GLFWwindow* window, double xPosition, double yPosition) {
-
-}
-
 float skybox_vertices[] = {
     // positions
     -1.0f,  1.0f, -1.0f,
@@ -1549,15 +1617,11 @@ void game_update_projections(int width, int height) {
     mat4_ortho(&game->cb_frame_data.proj_ortho, 0, width, height, 0, -2.1f, 10.0f);
 }
 
-void framebuffer_resize_callback(GLFWwindow* window, int width, int height) {
-    game_update_projections(width, height);
-}
-
 void game_reset() {
-    game->player_projectiles_count = 0;
-    game->animated_effects_count = 0;
-    game->pickup_objects_count = 0;
-    game->demon_count = 0;
+    pool_clear(&game->player_projectiles);
+    pool_clear(&game->animated_effects);
+    pool_clear(&game->pickup_objects);
+    demon_store_clear(&game->demons);
 
     game->pickup_ammo_firsttime = 1;
 
@@ -1585,62 +1649,233 @@ void game_reset() {
 
     game->yaw = 100;
     game->pitch = 0;
+
+    // no jump from the last round's camera
+    game_save_previous();
+}
+
+unsigned int checksum_add(unsigned int hash, void* data, size_t size) {
+    unsigned char* bytes = data;
+    for(size_t i = 0;i < size;i++) {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+    return hash;
 }
 
-int main() {
+// FNV-1a over the gameplay state, two runs of the same replay must agree
+unsigned int game_state_checksum() {
+    unsigned int hash = 2166136261u;
+
+    hash = checksum_add(hash, &game->state, sizeof(game->state));
+    hash = checksum_add(hash, &game->player_pos, sizeof(game->player_pos));
+    hash = checksum_add(hash, &game->player_health, sizeof(game->player_health));
+    hash = checksum_add(hash, &game->player_ammo, sizeof(game->player_ammo));
+    hash = checksum_add(hash, &game->player_kill_count, sizeof(game->player_kill_count));
+    hash = checksum_add(hash, &game->yaw, sizeof(game->yaw));
+    hash = checksum_add(hash, &game->pitch, sizeof(game->pitch));
+
+    struct demon_store_t* demons = &game->demons;
+    for(size_t i = 0;i < demons->count;i++) {
+        struct vec3_t position = vec3(demons->pos_x[i], demons->pos_y[i], demons->pos_z[i]);
+        hash = checksum_add(hash, &position, sizeof(struct vec3_t));
+        hash = checksum_add(hash, &demons->health[i], sizeof(float));
+    }
+    for(size_t i = 0;i < game->player_projectiles.slot_count;i++) {
+        struct projectile_t* projectile = pool_get(&game->player_projectiles, i);
+        if (projectile) {
+            hash = checksum_add(hash, &projectile->position, sizeof(struct vec3_t));
+        }
+    }
+    for(size_t i = 0;i < game->pickup_objects.slot_count;i++) {
+        struct pickup_object_t* pickup = pool_get(&game->pickup_objects, i);
+        if (pickup) {
+            hash = checksum_add(hash, &pickup->position, sizeof(struct vec3_t));
+        }
+    }
+    return hash;
+}
+
+void game_init(int width, int height) {
     game = malloc(sizeof(struct game_t));
+    memset(game, 0, sizeof(struct game_t));
 
-    game->width = 1280;
-    game->height = 720;
+    game->width = width;
+    game->height = height;
     game->quit = 0;
+    game->render_alpha = 1.0f;
 
-	glfwInit();
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 2);
-	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-
-	GLFWwindow* window = glfwCreateWindow(game->width, game->height, "DOOM: DEMON SLAYER (Developed by Shah Farhad Reza)", 0, 0);
-	if (window == 0) {
-		log_error("WINDOW::CREATION");
-		log_error("OpenGL 3.2 Required");
-		glfwTerminate();
-		return -1;
-	}
-	glfwMakeContextCurrent(window);
+    // entity pools, 256 items per chunk
+    demon_store_init(&game->demons, DEMON_BUDGET);
+    pool_init(&game->player_projectiles, "projectiles", sizeof(struct projectile_t), 256, PROJECTILE_BUDGET);
+    pool_init(&game->animated_effects, "effects", sizeof(struct animated_effect_t), 256, EFFECT_BUDGET);
+    pool_init(&game->pickup_objects, "pickups", sizeof(struct pickup_object_t), 256, PICKUP_BUDGET);
 
-	game->window = window;
+    // collision queries, the cells are a bit bigger than a demon
+    spatial_hash_init(&game->projectile_grid, 4.0f);
+    spatial_hash_init(&game->pickup_grid, 4.0f);
 
-	glfwSetFramebufferSizeCallback(window, framebuffer_resize_callback);
-	glfwSetCursorPosCallback(window, process_mouse_move);
-	//glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
-	glfwSetMouseButtonCallback(window, process_mouse_button);
-	glfwSetKeyCallback(window, process_key_press);
+    game_update_projections(game->width, game->height);
 
-	// GLAD
-	if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
-		log_error("Failed to initialize GLAD");
-		return -1;
-	}
+    // the platform seeds again from the command line or the replay
+    game_seed(1);
+
+    game_reset();
+
+    game->state = GAME_STATE_MENU;
+}
+
+// A whole run follows from the seed: the same seed and input give the same game
+void game_seed(unsigned int seed) {
+    rng_seed(&game->rng_spawn, seed, 1);
+    rng_seed(&game->rng_combat, seed, 2);
+    rng_seed(&game->rng_loot, seed, 3);
+}
+
+void game_shutdown() {
+    spatial_hash_free(&game->pickup_grid);
+    spatial_hash_free(&game->projectile_grid);
+
+    aabb_soa_free(&game->projectile_boxes);
+    free(game->projectile_slots);
+    free(game->demon_hits);
+
+    for(int t = 0;t < JOBS_MAX_THREADS;t++) {
+        free(game->event_buffers[t].events);
+        free(game->event_buffers[t].results);
+    }
+    free(game->events);
+
+	pool_destroy(&game->pickup_objects);
+	pool_destroy(&game->animated_effects);
+	pool_destroy(&game->player_projectiles);
+	demon_store_free(&game->demons);
 
-	log_info2("OpenGL", glGetString(GL_VERSION));
+	free(game);
+	game = 0;
+}
 
-	glDisable(GL_CULL_FACE);
-	glEnable(GL_DEPTH_TEST);
+// Queues the textures and the HUD atlas images into batch. Without a batch only
+// the image sizes are read, the menus need them for layout and hit testing even
+// without a GL context
+void game_load_textures(struct texture_batch_t* batch) {
+    struct texture_def_t {
+        struct texture_t* texture;
+        const char* filename;
+    } defs[] = {
+        {&game->texture, "./assets/textures/floor2.png"},
+    };
 
-	struct vertex_t quad_varray[] = {
-        {.pos = {0,  1, 0.0f}, .uv = {0.0f, 1.0f}},
-        {.pos = {0,  0, 0.0f}, .uv = {0.0f, 0.0f}},
-        {.pos = {1,  1, 0.0f}, .uv = {1.0f, 1.0f}},
-        {.pos = {1,  0, 0.0f}, .uv = {1.0f, 0.0f}},
+    const char* hud_images[HUD_IMAGE_COUNT] = {
+        [HUD_IMAGE_MENU] = "./assets/textures/menu.jpg",
+        [HUD_IMAGE_DEV] = "./assets/textures/test.png",
+        [HUD_IMAGE_MENU_SKULL] = "./assets/textures/menu_skull.png",
+        [HUD_IMAGE_TEXT_PLAY] = "./assets/textures/text_play.png",
+        [HUD_IMAGE_TEXT_RESUME] = "./assets/textures/text_resume.png",
+        [HUD_IMAGE_TEXT_MAIN_MENU] = "./assets/textures/text_main_menu.png",
+        [HUD_IMAGE_TEXT_QUIT] = "./assets/textures/text_quit.png",
+        [HUD_IMAGE_CROSSHAIR] = "./assets/textures/crosshair.png",
+        [HUD_IMAGE_HEALTH_AMMO] = "./assets/textures/health_ammo.png",
+        [HUD_IMAGE_FONT] = "./assets/textures/font.png",
+        [HUD_IMAGE_SKULL] = "./assets/textures/skull.png",
+        [HUD_IMAGE_RED] = "./assets/textures/red.png",
+        [HUD_IMAGE_GREEN] = "./assets/textures/green.png",
+        [HUD_IMAGE_TEXT_DEAD] = "./assets/textures/you are dead.png",
+        [HUD_IMAGE_TEXT_FINAL_SCORE] = "./assets/textures/text_final_score.png",
+        [HUD_IMAGE_TEXT_PAUSED] = "./assets/textures/text_paused.png",
+        [HUD_IMAGE_HAND] = "./assets/textures/hand.png",
+        [HUD_IMAGE_PISTOL] = "./assets/textures/pistol.png",
     };
 
-	unsigned int quad_iarray[] = {
-	    0, 1, 2,
-        1, 3, 2
-	};
+    for(int i = 0;i < sizeof(defs) / sizeof(defs[0]);i++) {
+        if (batch) {
+            texture_batch_add(batch, defs[i].texture, defs[i].filename);
+        } else {
+            texture_load_info(defs[i].texture, defs[i].filename);
+        }
+    }
+
+    // packed by atlas_build once the batch is loaded
+    atlas_init(&game->hud_atlas, HUD_IMAGE_COUNT);
+    for(int i = 0;i < HUD_IMAGE_COUNT;i++) {
+        if (batch) {
+            texture_batch_add_atlas(batch, &game->hud_atlas, i, hud_images[i]);
+        } else {
+            atlas_load_info(&game->hud_atlas, i, hud_images[i]);
+        }
+    }
+}
+
+struct game_sprite_def_t {
+    size_t offset; // of the sprite pointer in game_t
+    const char* filename;
+    float scale_w, scale_h;
+    int frame_w, frame_h; // 0 = the whole texture is one frame
+};
+
+struct game_sprite_def_t game_sprite_defs[] = {
+    {offsetof(struct game_t, sprite_imp), "./assets/textures/imp.png", 2.5, 3.2, 40, 57},
+    {offsetof(struct game_t, sprite_arch), "./assets/textures/arch.png", 2.5, 3.5, 40, 56},
+    {offsetof(struct game_t, sprite_projectile), "./assets/textures/projectile.png", 0.5, 0.5, 0, 0},
+    {offsetof(struct game_t, sprite_explosion), "./assets/textures/impact_explosion.png", 1, 1, 50, 47},
+    {offsetof(struct game_t, sprite_blood), "./assets/textures/impact_blood.png", 1, 1, 45, 40},
+    {offsetof(struct game_t, sprite_spawn), "./assets/textures/spawn_effect.png", 3, 3, 40, 37},
+    {offsetof(struct game_t, sprite_pickup_health), "./assets/textures/health.png", 1.3, 1, 0, 0},
+    {offsetof(struct game_t, sprite_pickup_ammo), "./assets/textures/ammo.png", 1.3, 1, 0, 0},
+    {offsetof(struct game_t, sprite_pickup_armor), "./assets/textures/armor.png", 1.3, 1.25, 0, 0},
+    {offsetof(struct game_t, sprite_pickup_pistol), "./assets/textures/pistol_pickup.png", 1.8, 0.9, 0, 0},
+};
+
+_Static_assert(sizeof(game_sprite_defs) / sizeof(game_sprite_defs[0]) == GAME_SPRITE_COUNT, "GAME_SPRITE_COUNT is off");
+
+// Queues the sprite sheets into batch, sheets holds GAME_SPRITE_COUNT textures
+void game_load_sprite_sheets(struct texture_batch_t* batch, struct texture_t* sheets) {
+    for(int i = 0;i < GAME_SPRITE_COUNT;i++) {
+        texture_batch_add(batch, &sheets[i], game_sprite_defs[i].filename);
+    }
+}
+
+// Makes the sprites from the sheets game_load_sprite_sheets loaded. Without
+// sheets they only carry their size/bounding box, that's all the simulation
+// needs, so it can run without a GL context
+void game_load_sprites(struct texture_t* sheets) {
+    for(int i = 0;i < GAME_SPRITE_COUNT;i++) {
+        struct game_sprite_def_t* def = &game_sprite_defs[i];
+        struct sprite3d_t* sprite;
+
+        if (sheets) {
+            sprite = sprite3d_new(&sheets[i], def->scale_w, def->scale_h);
+        } else {
+            sprite = sprite3d_new_headless(def->scale_w, def->scale_h);
+        }
 
-	game->quad_vbuf = vertex_buffer_new(&quad_varray[0], 4);
-	game->quad_ibuf = index_buffer_new(&quad_iarray[0], 6);
+        if (def->frame_w > 0) {
+            sprite3d_set_frames(sprite, def->frame_w, def->frame_h);
+        }
+        *(struct sprite3d_t**)((char*)game + def->offset) = sprite;
+    }
+}
+
+void game_free_sprites() {
+	sprite3d_delete(game->sprite_spawn);
+	sprite3d_delete(game->sprite_blood);
+	sprite3d_delete(game->sprite_explosion);
+	sprite3d_delete(game->sprite_projectile);
+	sprite3d_delete(game->sprite_arch);
+	sprite3d_delete(game->sprite_imp);
+
+	sprite3d_delete(game->sprite_pickup_pistol);
+	sprite3d_delete(game->sprite_pickup_armor);
+	sprite3d_delete(game->sprite_pickup_ammo);
+	sprite3d_delete(game->sprite_pickup_health);
+}
+
+// Returns 0 if any asset failed to load. Everything else is still loaded, so
+// game_free_assets can clean up either way.
+int game_load_assets() {
+    int ok = 1;
+
+    // HUD and menus, grows past this if a frame needs more quads
+    game->hud_batch = sprite_batch_new(256);
 
 	// SkyBox
 
@@ -1658,9 +1893,11 @@ int main() {
 
 	game->sky_vbuf = vertex_buffer_new(&sky_varray[0], 36);
 
-	// Load assets
+	// Load assets, from the asset pack when there is one and the loose files otherwise
+	asset_pack_mount(GAME_ASSET_PACK);
 
 	// Shaders
+	PROFILE_BEGIN("load shaders");
 	game->sky_shader = glsl_shader_program_new(
                                 "./assets/shaders/sky.vert",
                                     "./assets/shaders/sky.frag");
@@ -1676,34 +1913,11 @@ int main() {
     game->hud_shader = glsl_shader_program_new(
                                 "./assets/shaders/hud.vert",
                                     "./assets/shaders/hud.frag");
+    PROFILE_END();
 
-    //texture_convert_dev("./assets/textures/test.png");
-
-    if (!texture_load_dev(&game->dev_texture, "./assets/textures/dev.dat")) {
-        return -1;
-    }
-
-    // Textures
-    texture_load(&game->texture, "./assets/textures/floor2.png");
-    texture_load(&game->menu_texture, "./assets/textures/menu.jpg");
-    texture_load(&game->menu_skull_texture, "./assets/textures/menu_skull.png");
-    texture_load(&game->menu_play_texture, "./assets/textures/text_play.png");
-    texture_load(&game->menu_resume_texture, "./assets/textures/text_resume.png");
-    texture_load(&game->menu_main_texture, "./assets/textures/text_main_menu.png");
-    texture_load(&game->menu_quit_texture, "./assets/textures/text_quit.png");
-    texture_load(&game->cross_hair_texture, "./assets/textures/crosshair.png");
-    texture_load(&game->hud_texture_health_ammo, "./assets/textures/health_ammo.png");
-    texture_load(&game->font_texture, "./assets/textures/font.png");
-    texture_load(&game->skull_texture, "./assets/textures/skull.png");
-    texture_load(&game->red_texture, "./assets/textures/red.png");
-    texture_load(&game->green_texture, "./assets/textures/green.png");
-    texture_load(&game->dead_text_texture, "./assets/textures/you are dead.png");
-    texture_load(&game->total_kill_text_texture, "./assets/textures/text_final_score.png");
-    texture_load(&game->paused_text_texture, "./assets/textures/text_paused.png");
-
-    texture_load(&game->player_hand_texture, "./assets/textures/hand.png");
-    texture_load(&game->player_pistol_texture, "./assets/textures/pistol.png");
+    ok &= game->sky_shader && game->lighting_shader && game->sprite3d_shader && game->hud_shader;
 
+    // Textures, sprite sheets and the sky, decoded in parallel
     const char* sky_textures[] = {
         "./assets/textures/sky/right.png",
         "./assets/textures/sky/left.png",
@@ -1713,146 +1927,50 @@ int main() {
         "./assets/textures/sky/front.png",
     };
 
-    texture_load_cubemap(&game->sky_texture, sky_textures);
-
-    // Scene
-    game->scene = load_obj("./assets/scenes/main.obj");
-
-    // Sprites
-    game->sprite_imp = sprite3d_new("./assets/textures/imp.png", 2.5, 3.2);
-    game->sprite_imp->frame_w = 40;
-    game->sprite_imp->frame_h = 57;
-
-    game->sprite_arch = sprite3d_new("./assets/textures/arch.png", 2.5, 3.5);
-    game->sprite_arch->frame_w = 40;
-    game->sprite_arch->frame_h = 56;
-
-    game->sprite_projectile = sprite3d_new("./assets/textures/projectile.png", 0.5, 0.5);
-
-    game->sprite_explosion = sprite3d_new("./assets/textures/impact_explosion.png", 1, 1);
-    game->sprite_explosion->frame_w = 50;
-    game->sprite_explosion->frame_h = 47;
-
-    game->sprite_blood = sprite3d_new("./assets/textures/impact_blood.png", 1, 1);
-    game->sprite_blood->frame_w = 45;
-    game->sprite_blood->frame_h = 40;
-
-    game->sprite_spawn = sprite3d_new("./assets/textures/spawn_effect.png", 3, 3);
-    game->sprite_spawn->frame_w = 40;
-    game->sprite_spawn->frame_h = 37;
+    struct texture_t sprite_sheets[GAME_SPRITE_COUNT];
 
-    game->sprite_pickup_health = sprite3d_new("./assets/textures/health.png", 1.3, 1);
-    game->sprite_pickup_ammo = sprite3d_new("./assets/textures/ammo.png", 1.3, 1);
-    game->sprite_pickup_armor = sprite3d_new("./assets/textures/armor.png", 1.3, 1.25);
-    game->sprite_pickup_pistol = sprite3d_new("./assets/textures/pistol_pickup.png", 1.8, 0.9);
+    struct texture_batch_t batch;
+    texture_batch_init(&batch);
+    game_load_textures(&batch);
+    game_load_sprite_sheets(&batch, sprite_sheets);
+    texture_batch_add_cubemap(&batch, &game->sky_texture, sky_textures);
 
-    // init demon objects
-    game->demon_alloc = 100; // max demons
-	game->demons = malloc(sizeof(struct demon_t) * game->demon_alloc);
+    ok &= texture_batch_load(&batch);
+    texture_batch_report(&batch);
+    texture_batch_free(&batch);
 
-	// init projectiles
-	game->player_projectiles = malloc(sizeof(struct projectile_t) * MAX_PROJECTTILE);
-	// Effects
-    game->animated_effects = malloc(sizeof(struct animated_effect_t) * MAX_ANIMATED_EFFECTS);
-    // Pickup Objects
-    game->pickup_objects = malloc(sizeof(struct pickup_object_t) * MAX_PICKUP_OBJECT);
-
-    game_update_projections(game->width, game->height);
-
-    struct constant_buffer_t* cb_frame = constant_buffer_new(sizeof(struct cb_frame_data_t));
-    game->cb_object = constant_buffer_new(sizeof(struct cb_object_data_t));
-
-    // We can bind them immediately now
-    // bind frame constant buffer at '0' index
-    glBindBufferBase(GL_UNIFORM_BUFFER, 0, cb_frame->buffer_object);
-    // bind object constant buffer at '1' index
-    glBindBufferBase(GL_UNIFORM_BUFFER, 1, game->cb_object->buffer_object);
-
-    game_reset();
-
-    game->state = GAME_STATE_MENU;
+    ok &= atlas_build(&game->hud_atlas);
 
-    double last_time = glfwGetTime();
-
-	// game loop
-	while (!glfwWindowShouldClose(window)) {
-
-        double current_time = glfwGetTime();
-		// delta time ()
-		double dt = current_time - last_time;
-		last_time = current_time;
-
-		if (game->quit) {
-            break;
-		}
-
-		if (glfwGetKey(window, GLFW_KEY_P) == GLFW_PRESS) {
-		    printf("player %f, %f, %f\n", game->player_pos.x, game->player_pos.y, game->player_pos.z);
-		}
-
-        glfwGetWindowSize(window, &game->width, &game->height);
-        glViewport(0, 0, game->width, game->height);
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
-
-        glClearColor(0.8f, 0.8f, 0.8f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-        game_update(dt);
-
-		// Update the frame constant buffer
-        struct vec3_t cam_lookat = vec3_add(&game->cam_pos, &game->cam_dir);
-
-        mat4_identity(&game->cb_frame_data.view);
-        mat4_lookAt(&game->cb_frame_data.view, &game->cam_pos, &cam_lookat, &game->cam_up);
+    // Scene
+    PROFILE_BEGIN("load_obj");
+    game->scene = load_obj("./assets/scenes/main.obj");
+    PROFILE_END();
 
-        game->cb_frame_data.width = game->width;
-        game->cb_frame_data.height = game->height;
+    if (!game->scene) {
+        log_error("Failed to load the level");
+        ok = 0;
+    }
 
-        constant_buffer_update(cb_frame, &game->cb_frame_data);
+    // Sprites
+    game_load_sprites(sprite_sheets);
 
-        game_render();
+    // everything is on the GPU, nothing points into the pack anymore
+    asset_pack_unmount();
 
-        glfwSwapBuffers(window);
-	    glfwPollEvents();
-	}
+    // frame constants go to binding '0', per object constants to binding '1'
+    game->uniforms = uniform_arena_new(64 * 1024);
 
-	log_info("Cleaning up...");
+    game->gpu_timer = gpu_timer_new();
 
-	free(game->pickup_objects);
-	free(game->animated_effects);
-	free(game->player_projectiles);
-	free(game->demons);
+    return ok;
+}
 
+void game_free_assets() {
 	texture_free(&game->sky_texture);
-	texture_free(&game->paused_text_texture);
-	texture_free(&game->total_kill_text_texture);
-	texture_free(&game->dead_text_texture);
-	texture_free(&game->red_texture);
-	texture_free(&game->green_texture);
 	texture_free(&game->texture);
-	texture_free(&game->font_texture);
-	texture_free(&game->skull_texture);
-	texture_free(&game->cross_hair_texture);
-	texture_free(&game->hud_texture_health_ammo);
-	texture_free(&game->player_pistol_texture);
-	texture_free(&game->player_hand_texture);
-	texture_free(&game->menu_play_texture);
-	texture_free(&game->menu_quit_texture);
-	texture_free(&game->menu_main_texture);
-	texture_free(&game->menu_resume_texture);
-	texture_free(&game->menu_skull_texture);
-	texture_free(&game->menu_texture);
+	atlas_free(&game->hud_atlas);
 
-	sprite3d_delete(game->sprite_spawn);
-	sprite3d_delete(game->sprite_explosion);
-	sprite3d_delete(game->sprite_projectile);
-	sprite3d_delete(game->sprite_arch);
-	sprite3d_delete(game->sprite_imp);
-
-	sprite3d_delete(game->sprite_pickup_pistol);
-	sprite3d_delete(game->sprite_pickup_armor);
-	sprite3d_delete(game->sprite_pickup_ammo);
-	sprite3d_delete(game->sprite_pickup_health);
+	game_free_sprites();
 
 	if (game->scene) {
         index_buffer_delete(game->scene->index_buffer);
@@ -1860,25 +1978,16 @@ int main() {
         free(game->scene);
 	}
 
-    index_buffer_delete(game->quad_ibuf);
-    vertex_buffer_delete(game->quad_vbuf);
+    sprite_batch_delete(game->hud_batch);
 
     vertex_buffer_delete(game->sky_vbuf);
 
-    constant_buffer_delete(game->cb_object);
-	constant_buffer_delete(cb_frame);
+    uniform_arena_delete(game->uniforms);
+    gpu_timer_delete(game->gpu_timer);
 
     glDeleteProgram(game->hud_shader);
     glDeleteProgram(game->sprite3d_shader);
     glDeleteProgram(game->lighting_shader);
     glDeleteProgram(game->sky_shader);
-
-	glfwDestroyWindow(window);
-	glfwTerminate();
-
-	free(game);
-	return 0;
 }
 
-
-
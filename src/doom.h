@@ -4,31 +4,78 @@
 #include <stdlib.h>
 #include <assert.h>
 #include <string.h>
+#include <stdint.h>
 #include <math.h>
 #include <glad/glad.h>
-#include <GLFW/glfw3.h>
 
-struct vec2_t {
-    float x, y;
+#include "vecmath.h"
+
+// Random number generator state, see math.c
+struct rng_t {
+    uint32_t s[4];
 };
 
-struct vec3_t {
-    float x, y, z;
+struct aabb_t {
+    struct vec3_t min, max;
 };
 
-struct vec4_t {
-    float x, y, z, w;
+// Boxes as six float arrays for the batch tests, see cull.c. Owns its arrays
+// when filled by aabb_soa_push, capacity 0 is a view into a store like the
+// demon store.
+struct aabb_soa_t {
+    float* min_x;
+    float* min_y;
+    float* min_z;
+    float* max_x;
+    float* max_y;
+    float* max_z;
+    size_t count, capacity;
 };
 
-struct mat4_t {
-	union {
-		float m[4][4];
-		float M[16];
-	};
+// Six planes (normal, distance) pointing inwards, left, right, bottom, top, near, far
+struct frustum_t {
+    struct vec4_t planes[6];
 };
 
-struct aabb_t {
-    struct vec3_t min, max;
+struct spatial_item_t {
+    int cell_x, cell_z;
+    unsigned int index;
+};
+
+// Uniform grid hashed into buckets, see spatial.c
+struct spatial_hash_t {
+    float cell_size, inv_cell_size;
+    float max_half_x, max_half_z; // largest item half extents of the last build
+
+    unsigned int bucket_count;
+    unsigned int* bucket_start; // bucket_count + 1 offsets into items
+
+    struct spatial_item_t* items; // sorted by bucket
+    struct spatial_item_t* scratch; // in index order
+    size_t item_count, item_capacity;
+
+    unsigned int* results; // of the last query, ascending
+    size_t result_count, result_capacity;
+};
+
+// Chunked pool of fixed size items whose addresses never change, see pool.c
+struct pool_t {
+    const char* name;
+    size_t item_size;
+    size_t chunk_shift; // a chunk holds 1 << chunk_shift items
+
+    unsigned char** chunks;
+    unsigned char** alive; // a flag per slot, next to every chunk
+    size_t chunk_count, chunk_capacity;
+
+    size_t slot_count; // slots handed out so far, loops go up to here
+    size_t count; // live items
+
+    size_t* free_slots;
+    size_t free_count, free_capacity;
+
+    size_t soft_budget; // warns when more items are alive, 0 for none
+    size_t high_water; // most items alive at once
 };
 
 struct vertex_t {
@@ -53,11 +100,146 @@ struct constant_buffer_t {
     size_t size;
 };
 
+// Ring of per-draw uniform data. Each draw appends its constants and binds them
+// with glBindBufferRange; the buffer holds one region per frame in flight and a
+// fence keeps a region from being rewritten until the GPU has read it.
+#define UNIFORM_ARENA_FRAMES 3
+
+struct uniform_arena_t {
+    GLuint buffer_object;
+    size_t region_size;
+    size_t alignment;
+    int region;
+    size_t offset;
+    unsigned char* mapped; // persistent mapping, 0 when orphaning instead
+    GLsync fences[UNIFORM_ARENA_FRAMES];
+};
+
+// GL_TIME_ELAPSED queries around render passes. Each frame records into its
+// own set of queries and reads back the set it is about to reuse, which is
+// GPU_TIMER_FRAMES - 1 frames old by then, so the reads never wait on the GPU.
+#define GPU_TIMER_FRAMES 3
+#define GPU_TIMER_PASSES 8
+
+struct gpu_timer_t {
+    int supported; // timer queries are GL 3.3 or ARB_timer_query
+    GLuint queries[GPU_TIMER_FRAMES][GPU_TIMER_PASSES];
+    unsigned int issued[GPU_TIMER_FRAMES]; // bit per pass queried in that frame
+    int frame;
+    int active; // pass with an open query, -1 for none
+
+    const char* names[GPU_TIMER_PASSES];
+    float ms[GPU_TIMER_PASSES]; // latest results
+};
+
+struct sprite_batch_quad_t {
+    int layer;
+    GLuint texture_id;
+    float opacity;
+    unsigned int order;
+    float x, y, width, height;
+    struct vec4_t uv_rect;
+};
+
+struct sprite_batch_t {
+    struct vertex_buffer_t* vbuf;
+    struct index_buffer_t* ibuf;
+
+    struct sprite_batch_quad_t* quads;
+    struct vertex_t* vertices;
+    size_t quad_count, quad_capacity;
+};
+
 struct texture_t {
     GLuint texture_id;
     size_t width, height;
 };
 
+struct file_map_t {
+    void* data;
+    size_t size;
+};
+
+// A whole asset file, inside the asset pack or a mapped loose file (pack.c)
+struct asset_view_t {
+    const void* data;
+    size_t size;
+    struct file_map_t map; // of the loose file, data is 0 for a pack view
+};
+
+struct pack_entry_t {
+    unsigned long long name_hash;
+    unsigned long long offset; // of the payload in the pack
+    unsigned long long size;
+    unsigned int name_offset; // into the names
+    unsigned int pad;
+};
+
+struct pack_t {
+    struct file_map_t map;
+    struct pack_entry_t* entries; // sorted by name_hash
+    size_t count;
+    const char* names;
+};
+
+// 2D textures get a mip chain cooked into their cache and are sampled with it
+#define TEXTURE_MIPMAP 0
+
+// Pixels as glTexImage2D takes them, the mip levels packed one after the other.
+// Either inside a mapped texture cache or decoded, see texture_image_load.
+struct texture_image_t {
+    unsigned char* pixels;
+    int width, height;
+    int channels;
+    int mip_count;
+    int cached; // the pixels are in view, nothing was decoded
+    struct asset_view_t view; // of the cache, in the pack or a loose file
+};
+
+// Image of a texture atlas, in pixels and as the uv_rect sprite_batch_push takes
+struct atlas_rect_t {
+    int x, y, width, height; // without the padding around it
+    struct vec4_t uv_rect;
+};
+
+// Images packed into one texture and addressed by their index, see atlas.c
+struct atlas_t {
+    struct texture_t texture;
+    struct atlas_rect_t* rects;
+    struct texture_image_t* images; // loaded by a texture batch, until atlas_build
+    size_t count;
+};
+
+// One image of a texture batch, see loader.c
+struct texture_batch_image_t {
+    struct texture_t* texture;
+    const char* filename;
+    int face; // cube map face, -1 for a 2D texture
+    struct atlas_t* atlas; // instead of texture, the image becomes atlas image atlas_index
+    int atlas_index;
+
+    struct texture_image_t image; // loaded, until uploaded
+    int thread; // that loaded it
+    double decode_ms, upload_ms;
+};
+
+struct texture_batch_t {
+    struct texture_batch_image_t* images;
+    size_t count, capacity;
+
+    volatile int* ready; // images in the order their decode finished, -1 until written
+    volatile int reserved; // slots of ready taken so far
+    double load_ms;
+};
+
+// CPU side vertex/index arrays, before they become GPU buffers
+struct mesh_data_t {
+    struct vertex_t* vertices;
+    size_t vertex_count;
+    unsigned int* indices;
+    size_t index_count;
+};
+
 // Every individual mesh that have unique mat/texture
 struct mesh_t {
     struct vertex_buffer_t* vertex_buffer;
@@ -65,6 +247,25 @@ struct mesh_t {
     struct texture_t texture;
 };
 
+// Per-instance vertex data of a billboard (attributes 3 and 4 of the quad's VAO)
+struct sprite_instance_t {
+    struct vec3_t position;
+    float frame; // animation frame, looked up in the sheet by sprite3d.vert
+};
+
+// Per object constants, CBPerObject at binding '1'
+struct cb_object_data_t {
+    struct mat4_t world;
+    float opacity;
+};
+
+// Sheet layout of a sprite3d_t, CBSpriteSheet at binding '2'
+struct cb_sprite_sheet_t {
+    struct vec2_t frame_size; // one frame in uv units
+    float columns;
+    float frame_count;
+};
+
 struct sprite3d_t {
     struct texture_t texture;
     struct index_buffer_t* quad_ibuf;
@@ -72,9 +273,51 @@ struct sprite3d_t {
 
     float scale_w, scale_h;
 
+    // frames are laid out left to right, top to bottom
     int frame_w, frame_h;
+    int columns, rows;
 
     struct aabb_t local_aabb;
+
+    // instances queued by sprite3d_push, drawn by sprite3d_flush
+    GLuint instance_buffer;
+    struct sprite_instance_t* instances;
+    size_t instance_count, instance_capacity;
+};
+
+// Keys/buttons held down this frame
+#define INPUT_KEY_W         (1 << 0)
+#define INPUT_KEY_A         (1 << 1)
+#define INPUT_KEY_S         (1 << 2)
+#define INPUT_KEY_D         (1 << 3)
+#define INPUT_KEY_ESCAPE    (1 << 4)
+
+#define INPUT_BUTTON_LEFT   (1 << 0)
+
+// One-shot events that happened since the last frame
+#define INPUT_EVENT_CLICK   (1 << 0) // left mouse button released
+#define INPUT_EVENT_PAUSE   (1 << 1) // escape pressed
+
+// Sampled once per frame by the platform backend (GLFW window or headless),
+// the game code never talks to the window system directly
+struct input_state_t {
+    unsigned int keys;
+    unsigned int buttons;
+    unsigned int events;
+    float mouse_x, mouse_y;
+};
+
+// Implemented by every platform backend
+void platform_capture_cursor(int capture);
+
+struct replay_t {
+    FILE* file; // only while recording
+    int recording;
+    unsigned int seed;
+    int width, height;
+    unsigned int frame_count;
+    unsigned int frame_index;
+    struct replay_frame_t* frames; // only while playing back
 };
 
 #define PI 3.14159265359f
@@ -82,18 +325,110 @@ struct sprite3d_t {
 
 float math_deg_to_rad(float rad);
 
+char strequal(const char *s1, const char *s2);
+
 void log_error(const char* msg);
 void log_info(const char* msg);
 void log_info2(const char* title, const char* msg);
 
-char* read_file_full(const char* filename);
+
+double timer_now(); // seconds, monotonic
+
+// Profiling zones (profiler.c), they compile to nothing without DOOM_PROFILE.
+// Every PROFILE_BEGIN needs its PROFILE_END in the same function.
+#ifdef DOOM_PROFILE
+#define PROFILE_BEGIN(name) profile_begin(name)
+#define PROFILE_END() profile_end()
+#define PROFILE_FRAME() profile_frame()
+#define PROFILE_THREAD_NAME(name) profile_thread_name(name)
+#define PROFILE_COUNTER(name, value) profile_counter(name, value)
+#else
+#define PROFILE_BEGIN(name)
+#define PROFILE_END()
+#define PROFILE_FRAME()
+#define PROFILE_THREAD_NAME(name)
+#define PROFILE_COUNTER(name, value)
+#endif
+
+void profile_begin(const char* name);
+void profile_end();
+void profile_frame();
+void profile_thread_name(const char* name);
+void profile_counter(const char* name, double value);
+int profile_dump(const char* filename, int frames);
+
+int file_map(const char* filename, struct file_map_t* map);
+void file_unmap(struct file_map_t* map);
+int file_stat(const char* filename, unsigned long long* mtime, unsigned long long* size);
+
+typedef void (*file_list_func_t)(const char* path, int is_dir, void* data);
+int file_list(const char* dir, file_list_func_t func, void* data);
+
+extern struct pack_t asset_pack;
+
+const char* pack_name(const char* name);
+int pack_open(struct pack_t* pack, const char* filename);
+void pack_close(struct pack_t* pack);
+struct pack_entry_t* pack_find(struct pack_t* pack, const char* name);
+int pack_view(struct pack_t* pack, const char* name, struct asset_view_t* view);
+int pack_write(const char* filename, const char** names, const char** files, size_t count);
+int asset_pack_mount(const char* filename);
+void asset_pack_unmount();
+int asset_open(const char* name, struct asset_view_t* view);
+int asset_open_packed(const char* name, struct asset_view_t* view);
+int asset_open_loose(const char* name, struct asset_view_t* view);
+void asset_close(struct asset_view_t* view);
+
+// Job system (jobs.c), worker threads with work-stealing deques
+#define JOBS_MAX_THREADS 64
+
+// runs the items [begin, end) on thread 0 (main) to jobs_thread_count() - 1
+typedef void (*job_func_t)(void* data, size_t begin, size_t end, int thread);
+
+void jobs_init(int threads);
+void jobs_shutdown();
+int jobs_thread_count();
+int jobs_thread_index();
+void parallel_for(size_t count, size_t grain, job_func_t func, void* data);
+void parallel_for_async(size_t count, size_t grain, job_func_t func, void* data, volatile int* pending);
+int jobs_run_one();
+void job_yield();
+int job_atomic_add(volatile int* value, int add); // returns the new value
+int job_atomic_load(volatile int* value);
 
 int texture_load(struct texture_t* tex, const char* filename);
-int texture_convert_dev(const char* filename);
-int texture_load_dev(struct texture_t* tex, const char* filename);
+int texture_image_load(struct texture_image_t* image, const char* filename, int channels, int mips);
+int texture_image_cook(struct texture_image_t* image, const char* filename, int channels, int mips);
+void texture_image_free(struct texture_image_t* image);
+int texture_cache_map(const char* filename, int channels, int mips, struct texture_image_t* image);
+int texture_cache_write(const char* filename, struct texture_image_t* image, unsigned long long source_hash);
+int texture_mip_count(int width, int height);
+size_t texture_levels_size(int width, int height, int channels, int mip_count);
+void texture_mip_halve(unsigned char* dst, unsigned char* src, int width, int height, int channels);
+unsigned long long hash_bytes(const void* data, size_t size);
+void texture_upload(struct texture_t* tex, struct texture_image_t* image);
+void texture_cubemap_create(struct texture_t* tex);
+void texture_upload_cubemap_face(struct texture_t* tex, int face, struct texture_image_t* image);
+
+void texture_batch_init(struct texture_batch_t* batch);
+void texture_batch_free(struct texture_batch_t* batch);
+void texture_batch_add(struct texture_batch_t* batch, struct texture_t* tex, const char* filename);
+void texture_batch_add_cubemap(struct texture_batch_t* batch, struct texture_t* tex, const char* filenames[]);
+void texture_batch_add_atlas(struct texture_batch_t* batch, struct atlas_t* atlas, int index, const char* filename);
+int texture_batch_load(struct texture_batch_t* batch);
+void texture_batch_report(struct texture_batch_t* batch);
+int texture_load_info(struct texture_t* tex, const char* filename);
 int texture_load_cubemap(struct texture_t* tex, const char* filenames[]);
 void texture_free(struct texture_t* tex);
 
+void atlas_init(struct atlas_t* atlas, size_t count);
+void atlas_free(struct atlas_t* atlas);
+int atlas_pack(struct atlas_rect_t* rects, size_t count, int padding, int* width, int* height);
+int atlas_build(struct atlas_t* atlas);
+int atlas_load_info(struct atlas_t* atlas, int index, const char* filename);
+struct vec4_t atlas_uv_rect(struct atlas_t* atlas, int index, int x, int y, int width, int height);
+
+GLuint glsl_shader_compile(GLenum type, const char* filename);
 GLuint glsl_shader_program_new(const char* vert_filename, const char* frag_filename);
 
 struct vertex_buffer_t* vertex_buffer_new(struct vertex_t* data, size_t count);
@@ -106,38 +441,89 @@ struct constant_buffer_t* constant_buffer_new(size_t sizeinBytes);
 void constant_buffer_delete(struct constant_buffer_t* buf);
 void constant_buffer_update(struct constant_buffer_t* buf, void* data);
 
-struct sprite3d_t* sprite3d_new(const char* filename, float scale_w, float scale_h);
+struct uniform_arena_t* uniform_arena_new(size_t frame_size);
+void uniform_arena_delete(struct uniform_arena_t* arena);
+void uniform_arena_begin_frame(struct uniform_arena_t* arena);
+void uniform_arena_end_frame(struct uniform_arena_t* arena);
+void uniform_arena_bind(struct uniform_arena_t* arena, GLuint binding, void* data, size_t size);
+
+struct gpu_timer_t* gpu_timer_new();
+void gpu_timer_delete(struct gpu_timer_t* timer);
+void gpu_timer_begin_frame(struct gpu_timer_t* timer);
+void gpu_timer_begin(struct gpu_timer_t* timer, int pass, const char* name);
+void gpu_timer_end(struct gpu_timer_t* timer);
+
+struct sprite3d_t* sprite3d_new(struct texture_t* texture, float scale_w, float scale_h);
+struct sprite3d_t* sprite3d_new_headless(float scale_w, float scale_h);
+void sprite3d_init_bounds(struct sprite3d_t* sprite, float scale_w, float scale_h);
 void sprite3d_delete(struct sprite3d_t* sprite);
-void sprite3d_render(struct sprite3d_t* sprite, float frame);
+void sprite3d_set_frames(struct sprite3d_t* sprite, int frame_w, int frame_h);
+struct sprite_batch_t* sprite_batch_new(size_t quad_capacity);
+void sprite_batch_delete(struct sprite_batch_t* batch);
+void sprite_batch_push(struct sprite_batch_t* batch, int layer, struct texture_t* tex,
+                       float x, float y, float width, float height, struct vec4_t uv_rect, float opacity);
+void sprite_batch_flush(struct sprite_batch_t* batch, struct uniform_arena_t* uniforms);
+
+void sprite3d_push(struct sprite3d_t* sprite, struct vec3_t* position, float frame);
+void sprite3d_flush(struct sprite3d_t* sprite, struct uniform_arena_t* uniforms);
 
-void mat4_identity(struct mat4_t* mat);
 void mat4_perspective(struct mat4_t* mat, float fov, float aspect, float zNear, float zFar);
 void mat4_ortho(struct mat4_t* mat, float left, float right, float bottom, float top, float zNear, float zFar);
 void mat4_lookAt(struct mat4_t* mat, struct vec3_t* eye, struct vec3_t* center, struct vec3_t* up);
 void mat4_set_translation(struct mat4_t* mat, float x, float y, float z);
 
 struct mesh_t* load_obj(const char* filename);
+int obj_parse_file(const char* filename, struct mesh_data_t* data);
+void mesh_data_free(struct mesh_data_t* data);
+int mesh_cache_map(const char* obj_filename, struct asset_view_t* cache, struct mesh_data_t* view);
+int mesh_cache_write(const char* obj_filename, struct mesh_data_t* data);
+void mesh_data_optimize(struct mesh_data_t* data);
+int mesh_cook(const char* obj_filename, struct mesh_data_t* data);
 
 void mat4_inverse(struct mat4_t* mat, struct mat4_t* inv);
-void mat4_translate(struct mat4_t* mat, struct vec3_t* v);
-
-struct vec2_t vec2_sub(struct vec2_t* a, struct vec2_t* b);
-
-struct vec3_t vec3(float x, float y, float z);
-struct vec3_t vec3_add(struct vec3_t* a, struct vec3_t* b);
-struct vec3_t vec3_sub(struct vec3_t* a, struct vec3_t* b);
-struct vec3_t vec3_mul(struct vec3_t* a, struct vec3_t* b);
-struct vec3_t vec3_mulf(struct vec3_t* a, float f);
-struct vec3_t vec3_cross(struct vec3_t* a, struct vec3_t* b);
-float vec3_distance(struct vec3_t* a, struct vec3_t* b);
-void vec3_normalize(struct vec3_t* v);
-
+void mat4_transform_points(struct mat4_t* mat, struct vec3_t* points, struct vec4_t* out, size_t count);
+void vec3_normalize_batch(float* x, float* y, float* z, size_t count);
+
+void pool_init(struct pool_t* pool, const char* name, size_t item_size, size_t chunk_items, size_t soft_budget);
+void pool_destroy(struct pool_t* pool);
+void pool_clear(struct pool_t* pool);
+void* pool_alloc(struct pool_t* pool);
+void pool_release(struct pool_t* pool, size_t slot);
+void* pool_get(struct pool_t* pool, size_t slot);
+void pool_report(struct pool_t* pool);
+
+void spatial_hash_init(struct spatial_hash_t* hash, float cell_size);
+void spatial_hash_free(struct spatial_hash_t* hash);
+void spatial_hash_build(struct spatial_hash_t* hash, struct aabb_t* boxes, size_t count, size_t stride);
+void spatial_hash_begin(struct spatial_hash_t* hash, size_t max_count);
+void spatial_hash_insert(struct spatial_hash_t* hash, struct aabb_t* box, unsigned int index);
+void spatial_hash_end(struct spatial_hash_t* hash);
+size_t spatial_hash_query(struct spatial_hash_t* hash, struct aabb_t* box);
+size_t spatial_hash_query_into(struct spatial_hash_t* hash, struct aabb_t* box, unsigned int** results, size_t* capacity);
 
 void aabb_init(struct aabb_t* aabb);
+int aabb_is_null(struct aabb_t* aabb);
 void aabb_extend(struct aabb_t* aabb, struct vec3_t* p);
 void aabb_translate(struct aabb_t* aabb, struct vec3_t* v);
 int aabb_intersect(struct aabb_t* a, struct aabb_t* b);
 
-int get_rand(int min, int max);
-float get_randf(float a, float b);
+void aabb_soa_free(struct aabb_soa_t* soa);
+void aabb_soa_clear(struct aabb_soa_t* soa);
+void aabb_soa_push(struct aabb_soa_t* soa, struct aabb_t* box);
+size_t aabb_soa_overlap(struct aabb_soa_t* soa, struct aabb_t* box, unsigned int* hits);
+size_t aabb_soa_frustum(struct aabb_soa_t* soa, struct frustum_t* frustum, float pad, unsigned int* hits);
+void frustum_from_matrix(struct frustum_t* frustum, struct mat4_t* view_proj);
+int frustum_test_aabb(struct frustum_t* frustum, struct aabb_t* box, float pad);
+
+struct replay_t* replay_record_begin(const char* filename, unsigned int seed, int width, int height);
+void replay_record_frame(struct replay_t* replay, float dt, struct input_state_t* input);
+struct replay_t* replay_load(const char* filename);
+int replay_next_frame(struct replay_t* replay, float* dt, struct input_state_t* input);
+void replay_close(struct replay_t* replay);
+void frame_times_report(float* times_ms, size_t count, const char* csv_filename);
+
+void rng_seed(struct rng_t* rng, uint64_t seed, uint64_t stream);
+uint32_t rng_next(struct rng_t* rng);
+int rng_int(struct rng_t* rng, int min, int max);
+float rng_float(struct rng_t* rng, float a, float b);
 
@@ -0,0 +1,376 @@
+#pragma once
+
+#include "doom.h"
+
+struct cb_frame_data_t {
+    struct mat4_t proj;
+    struct mat4_t proj_ortho;
+    struct mat4_t view;
+    float width;
+    float height;
+};
+
+#define DEMON_STATE_WALKING 1
+#define DEMON_STATE_ATTACKING 2
+#define DEMON_STATE_DYING 3
+
+#define DEMON_TYPE_IMP 1
+#define DEMON_TYPE_ARCH 2
+
+// Demons are kept as a structure of arrays, the chase kernel in demons.c streams
+// through the hot fields with SIMD. Index order is spawn order. Removing the marked
+// demons compacts the arrays at the end of the tick, so an index is good until then.
+struct demon_store_t {
+    size_t count;
+    size_t capacity;
+    size_t soft_budget; // warns once when it goes over
+    size_t high_water;
+
+    // hot, every demon every tick
+    float* pos_x;
+    float* pos_y;
+    float* pos_z;
+    float* speed;
+    float* health;
+    int* state;
+    float* animation_frame;
+    float* player_dist; // written by demon_store_chase
+
+    // world space bounding box, always local box + position
+    float* min_x;
+    float* min_y;
+    float* min_z;
+    float* max_x;
+    float* max_y;
+    float* max_z;
+
+    // cold
+    float* prev_x; // position at the start of the tick, rendering interpolates from it
+    float* prev_y;
+    float* prev_z;
+    float* local_min_x;
+    float* local_min_y;
+    float* local_min_z;
+    float* local_max_x;
+    float* local_max_y;
+    float* local_max_z;
+    struct sprite3d_t** sprite;
+    int* type;
+    int* animation_reverse;
+    int* marked_for_removal; // removed at the end of the tick
+};
+
+#define DEMON_NONE ((size_t)-1)
+
+// chase kernels, demon_store_chase picks the best one the CPU has
+#define DEMON_KERNEL_SCALAR 0
+#define DEMON_KERNEL_SSE2 1
+#define DEMON_KERNEL_AVX2 2
+
+#define DEMON_BUDGET 100
+#define DEMON_CULL_PAD 1.0f // more than a demon moves in a tick
+
+#define PICKUP_OBJECT_HEALTH 1
+#define PICKUP_OBJECT_AMMO 2
+#define PICKUP_OBJECT_ARMOR 3
+
+struct pickup_object_t {
+    // TODO: Replace with 3D mesh?
+    struct sprite3d_t* sprite;
+
+    struct vec3_t position;
+    struct aabb_t world_aabb; // world space bounding box
+
+    char type;
+    int marked_for_removal;
+};
+
+#define PICKUP_BUDGET 100
+
+struct projectile_t {
+    struct sprite3d_t* sprite;
+    struct vec3_t origin; // where it starts
+    struct vec3_t position; // current position
+    struct vec3_t prev_position; // at the start of the tick, rendering interpolates from it
+    struct vec3_t direction;
+    int marked_for_removal;
+
+    struct aabb_t world_aabb; // world space bounding box
+};
+
+#define PROJECTILE_BUDGET 100
+
+// up to this many projectiles every demon tests all of them with the batch
+// box test, past it a spatial hash narrows them down first
+#define COLLISION_SWEEP_MAX 256
+
+struct animated_effect_t {
+    struct sprite3d_t* sprite;
+    float frame;
+    int max_frame;
+    struct vec3_t position;
+    int effect_type;
+    int marked_for_removal;
+};
+
+#define EFFECT_IMPACT 1
+#define EFFECT_BLOOD 2
+#define EFFECT_SPAWN 3
+
+#define EFFECT_BUDGET 64
+
+#define GAME_STATE_MENU 1
+#define GAME_STATE_TUTORIAL 2
+#define GAME_STATE_PLAYING 3
+#define GAME_STATE_PAUSE 4
+#define GAME_STATE_DEAD 5
+#define GAME_STATE_SCORE 6
+
+#define WEAPON_HAND 1
+#define WEAPON_PISTOL 2
+
+#define SCREEN_FLASH_RED 1
+#define SCREEN_FLASH_GREEN 2
+
+// HUD batch layers, drawn back to front
+#define HUD_LAYER_BACKGROUND 0 // full screen menu backgrounds
+#define HUD_LAYER_FLASH 1 // damage/pickup flash, tints the world but not the HUD
+#define HUD_LAYER_PANEL 2
+#define HUD_LAYER_WEAPON 3
+#define HUD_LAYER_ICONS 4 // crosshair, skull, numbers
+#define HUD_LAYER_TEXT 5 // menu items and full screen texts
+
+// HUD and menu images, the rects of game->hud_atlas
+#define HUD_IMAGE_MENU 0 // full screen menu background
+#define HUD_IMAGE_DEV 1
+#define HUD_IMAGE_MENU_SKULL 2
+#define HUD_IMAGE_TEXT_PLAY 3
+#define HUD_IMAGE_TEXT_RESUME 4
+#define HUD_IMAGE_TEXT_MAIN_MENU 5
+#define HUD_IMAGE_TEXT_QUIT 6
+#define HUD_IMAGE_CROSSHAIR 7
+#define HUD_IMAGE_HEALTH_AMMO 8
+#define HUD_IMAGE_FONT 9 // digits 0-9, 8x7 frames
+#define HUD_IMAGE_SKULL 10
+#define HUD_IMAGE_RED 11
+#define HUD_IMAGE_GREEN 12
+#define HUD_IMAGE_TEXT_DEAD 13
+#define HUD_IMAGE_TEXT_FINAL_SCORE 14
+#define HUD_IMAGE_TEXT_PAUSED 15
+#define HUD_IMAGE_HAND 16 // 260x77 frames
+#define HUD_IMAGE_PISTOL 17 // 78x103 frames
+#define HUD_IMAGE_COUNT 18
+
+// The simulation runs in fixed ticks, rendering interpolates between the last two
+#define GAME_TICK_RATE 60
+#define GAME_TICK_DT (1.0f / GAME_TICK_RATE)
+#define GAME_MAX_TICKS_PER_FRAME 8 // a longer hitch is dropped instead of caught up
+
+// Render passes timed on the GPU, in the order they run
+#define GPU_PASS_SKY 0
+#define GPU_PASS_LEVEL 1
+#define GPU_PASS_SPRITES 2 // demons and pickups
+#define GPU_PASS_EFFECTS 3 // blended effects and projectiles
+#define GPU_PASS_HUD 4
+#define GPU_PASS_COUNT 5
+
+// Side effects of the parallel update passes. Jobs append them to the buffer of
+// their thread, the main thread applies them sorted by entity once the pass is
+// done, so the outcome and what is drawn from the rng_spawn/rng_combat/rng_loot
+// streams don't depend on the thread count.
+#define GAME_EVENT_HIT 1 // demon touches a projectile, arg is the projectile slot
+#define GAME_EVENT_ATTACK 2 // demon finished an attack on the player
+#define GAME_EVENT_DROP 3 // dying demon is gone, may drop a pickup
+#define GAME_EVENT_DEATH 4 // demon may have lost its last health
+#define GAME_EVENT_SPAWN 5 // spawn effect is done, spawns a demon
+#define GAME_EVENT_PICKUP 6 // pickup in reach of the player, arg is the pickup slot
+
+struct game_event_t {
+    unsigned int index; // the entity (or candidate), applied in this order
+    unsigned int seq; // then in the order they were found
+    int type;
+    unsigned int arg;
+};
+
+struct game_event_buffer_t {
+    struct game_event_t* events;
+    size_t count, capacity;
+
+    // spatial queries of this thread
+    unsigned int* results;
+    size_t result_capacity;
+};
+
+struct game_t {
+    int width, height;
+    int quit;
+
+    // Input sampled by the platform backend for the current frame
+    struct input_state_t input;
+
+    struct cb_frame_data_t cb_frame_data;
+
+    struct sprite_batch_t* hud_batch;
+
+    struct vertex_buffer_t* sky_vbuf;
+
+    int state;
+    float yaw;
+    float pitch;
+
+    // Dead State stuffs
+    float text_blink_time;
+
+    // Scenes/Objects
+    struct mesh_t* scene;
+
+    // Entities, the pools grow as needed and the budgets only warn
+    struct demon_store_t demons;
+    struct pool_t pickup_objects;
+    struct pool_t animated_effects;
+    struct pool_t player_projectiles;
+
+    // Spatial hashes for the collision queries, rebuilt before use
+    struct spatial_hash_t projectile_grid;
+    struct spatial_hash_t pickup_grid;
+
+    // Batch box tests (cull.c): the boxes of the projectiles that can still hit
+    // with their pool slots, and the demons the punch reaches or the camera sees
+    struct aabb_soa_t projectile_boxes;
+    unsigned int* projectile_slots;
+    size_t projectile_slot_capacity;
+    unsigned int* demon_hits;
+    size_t demon_hit_capacity;
+
+    // of the frame being rendered, set by game_render
+    struct frustum_t frustum;
+
+    // Random streams, one per subsystem, seeded by game_seed
+    struct rng_t rng_spawn;  // where and what spawns
+    struct rng_t rng_combat; // damage rolls
+    struct rng_t rng_loot;   // drops and pickup amounts
+
+    struct game_event_buffer_t event_buffers[JOBS_MAX_THREADS];
+    struct game_event_t* events; // all threads' events while applying
+    size_t event_capacity;
+
+    // 3D Sprites
+    struct sprite3d_t* sprite_imp;
+    struct sprite3d_t* sprite_arch;
+    struct sprite3d_t* sprite_projectile;
+    struct sprite3d_t* sprite_explosion;
+    struct sprite3d_t* sprite_spawn;
+    struct sprite3d_t* sprite_blood;
+
+    struct sprite3d_t* sprite_pickup_health;
+    struct sprite3d_t* sprite_pickup_ammo;
+    struct sprite3d_t* sprite_pickup_armor;
+    struct sprite3d_t* sprite_pickup_pistol;
+
+    int pickup_ammo_firsttime;
+
+    // Textures
+    struct texture_t texture;
+    struct texture_t sky_texture;
+
+    // every HUD and menu image (weapons included), by HUD_IMAGE_*
+    struct atlas_t hud_atlas;
+
+    // Shaders
+    GLuint sky_shader;
+    GLuint lighting_shader;
+    GLuint sprite3d_shader;
+    GLuint hud_shader;
+
+    // Constant Buffers
+    struct uniform_arena_t* uniforms;
+
+    // how far the render is between the last two ticks, 0 (previous) to 1 (last),
+    // set by the platform before game_render
+    float render_alpha;
+
+    struct gpu_timer_t* gpu_timer;
+    int show_gpu_timer; // overlay with the GPU time of every pass
+
+    // Screen Effect
+    float screen_flash_opacity;
+    int screen_flash_type;
+
+    // player
+    struct vec3_t cam_up;
+    struct vec3_t cam_right;
+    struct vec3_t cam_dir;
+    struct vec3_t cam_pos;
+    struct vec3_t prev_cam_up; // camera at the start of the tick
+    struct vec3_t prev_cam_dir;
+    struct vec3_t prev_cam_pos;
+    struct vec3_t player_pos;
+    struct vec3_t player_velocity;
+    float player_height;
+    int player_health;
+    int player_ammo;
+    int player_armor;
+    int player_state_attacking;
+    int player_kill_count;
+    int player_state_taking_damage;
+
+    int player_weapon_type;
+
+    float pistol_animation_time;
+
+    float demon_spwan_rate;
+    float dead_state_wait_time;
+};
+
+extern struct game_t* game;
+
+void game_init(int width, int height);
+void game_shutdown();
+void game_seed(unsigned int seed);
+
+#define GAME_ASSET_PACK "./assets.pak" // doom_sim --pack makes it
+
+int game_load_assets();
+#define GAME_SPRITE_COUNT 10 // game_sprite_defs in doom.c
+
+void game_load_textures(struct texture_batch_t* batch);
+void game_load_sprite_sheets(struct texture_batch_t* batch, struct texture_t* sheets);
+void game_load_sprites(struct texture_t* sheets);
+void game_free_sprites();
+void game_free_assets();
+
+void game_reset();
+void game_update(float dt);
+void game_render();
+void game_update_projections(int width, int height);
+unsigned int game_state_checksum();
+void game_menu_item_center(int index, float* x, float* y);
+
+size_t game_spawn_demon(float x, float y, float z);
+void player_switch_weapon(int weapon);
+
+// demons.c
+void demon_store_init(struct demon_store_t* store, size_t soft_budget);
+void demon_store_free(struct demon_store_t* store);
+void demon_store_clear(struct demon_store_t* store);
+size_t demon_store_add(struct demon_store_t* store);
+size_t demon_store_remove_marked(struct demon_store_t* store);
+void demon_store_box(struct demon_store_t* store, size_t i, struct aabb_t* box);
+void demon_store_boxes(struct demon_store_t* store, struct aabb_soa_t* boxes);
+void demon_store_set_sprite(struct demon_store_t* store, size_t i, struct sprite3d_t* sprite);
+void demon_store_set_position(struct demon_store_t* store, size_t i, struct vec3_t* position);
+void demon_store_save_previous(struct demon_store_t* store);
+void demon_store_report(struct demon_store_t* store);
+int demon_kernel_best();
+const char* demon_kernel_name(int kernel);
+void demon_store_chase_kernel(struct demon_store_t* store, int kernel, size_t begin, size_t end, struct vec3_t* target, float dt);
+void demon_store_chase(struct demon_store_t* store, size_t begin, size_t end, struct vec3_t* target, float dt);
+
+// bench.c
+void bench_obj_load(int max_triangles);
+void bench_collision(int count);
+void bench_demons(int count);
+void bench_rng(int count);
+void bench_math(int count);
+void bench_boxes(int count);
+void bench_pack(const char* filename);
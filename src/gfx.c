@@ -1,67 +1,58 @@
 #include "doom.h"
 
-GLuint glsl_shader_program_new(const char* vert_filename, const char* frag_filename) {
-
-    log_info("Reading vertex shader file...");
-    const GLchar* vert_code = read_file_full(vert_filename);
+// Compiles one stage, 0 if the file can't be read or doesn't compile. The view
+// of the source is closed and a failed shader deleted on every way out.
+GLuint glsl_shader_compile(GLenum type, const char* filename) {
+    struct asset_view_t file;
 
-    if (!vert_code) {
-        log_error("Failed to read vertex shader file.");
+    if (!asset_open(filename, &file)) {
+        log_info2("Failed to read shader file", filename);
         return 0;
     }
 
-    GLuint vert_shader_id = glCreateShader(GL_VERTEX_SHADER);
+    GLuint shader_id = glCreateShader(type);
+
+    // straight from the mapping, the length stands in for the terminating 0
+    log_info2("Compiling shader", filename);
+    const GLchar* code = file.data;
+    GLint length = file.size;
+    glShaderSource(shader_id, 1, &code, &length);
+	glCompileShader(shader_id);
 
-    log_info("Compiling vertex shader...");
-    glShaderSource(vert_shader_id, 1, &vert_code, NULL);
-	glCompileShader(vert_shader_id);
+	asset_close(&file);
 
 	GLint Result = GL_FALSE;
 	int InfoLogLength;
 
 	// Check Shader
-	log_info("Checking vertex shader...");
-	glGetShaderiv(vert_shader_id, GL_COMPILE_STATUS, &Result);
-	glGetShaderiv(vert_shader_id, GL_INFO_LOG_LENGTH, &InfoLogLength);
+	glGetShaderiv(shader_id, GL_COMPILE_STATUS, &Result);
+	glGetShaderiv(shader_id, GL_INFO_LOG_LENGTH, &InfoLogLength);
 	if (InfoLogLength > 0) {
-        char* VertexShaderErrorMessage = malloc(sizeof(char) * (InfoLogLength + 1));
-		glGetShaderInfoLog(vert_shader_id, InfoLogLength, NULL, &VertexShaderErrorMessage[0]);
-		printf("VSHADER ERROR: %s\n", &VertexShaderErrorMessage[0]);
-		free(VertexShaderErrorMessage);
-		glDeleteShader(vert_shader_id);
+        char* ErrorMessage = malloc(sizeof(char) * (InfoLogLength + 1));
+		glGetShaderInfoLog(shader_id, InfoLogLength, NULL, &ErrorMessage[0]);
+		printf("SHADER ERROR %s: %s\n", filename, &ErrorMessage[0]);
+		free(ErrorMessage);
+		glDeleteShader(shader_id);
 		return 0;
 	}
 
-	free(vert_code);
-
-	log_info("Reading fragment shader file...");
-	const GLchar* frag_code = read_file_full(frag_filename);
+	return shader_id;
+}
 
-	if (!frag_code) {
-        log_error("Failed to read fragment shader file.");
+GLuint glsl_shader_program_new(const char* vert_filename, const char* frag_filename) {
+    GLuint vert_shader_id = glsl_shader_compile(GL_VERTEX_SHADER, vert_filename);
+    if (!vert_shader_id) {
         return 0;
     }
 
-	GLuint frag_shader_id = glCreateShader(GL_FRAGMENT_SHADER);
-
-    log_info("Compiling fragment shader...");
-    glShaderSource(frag_shader_id, 1, &frag_code, NULL);
-	glCompileShader(frag_shader_id);
-
-	// Check Shader
-	log_info("Checking fragment shader...");
-	glGetShaderiv(frag_shader_id, GL_COMPILE_STATUS, &Result);
-	glGetShaderiv(frag_shader_id, GL_INFO_LOG_LENGTH, &InfoLogLength);
-	if (InfoLogLength > 0) {
-        char* VertexShaderErrorMessage = malloc(sizeof(char) * (InfoLogLength + 1));
-		glGetShaderInfoLog(frag_shader_id, InfoLogLength, NULL, &VertexShaderErrorMessage[0]);
-		printf("FSHADER ERROR: %s\n", &VertexShaderErrorMessage[0]);
-		free(VertexShaderErrorMessage);
-		glDeleteShader(frag_shader_id);
-		return 0;
-	}
+    GLuint frag_shader_id = glsl_shader_compile(GL_FRAGMENT_SHADER, frag_filename);
+    if (!frag_shader_id) {
+        glDeleteShader(vert_shader_id);
+        return 0;
+    }
 
-	free(frag_code);
+	GLint Result = GL_FALSE;
+	int InfoLogLength;
 
 	GLuint program_id = glCreateProgram();
 	glAttachShader(program_id, vert_shader_id);
@@ -78,8 +69,11 @@ GLuint glsl_shader_program_new(const char* vert_filename, const char* frag_filen
 		//assert(0);
 	}
 
+	// the program keeps what it linked, the shader objects aren't needed anymore
 	glDetachShader(program_id, vert_shader_id);
 	glDetachShader(program_id, frag_shader_id);
+	glDeleteShader(vert_shader_id);
+	glDeleteShader(frag_shader_id);
 
 	return program_id;
 }
@@ -168,3 +162,198 @@ void constant_buffer_update(struct constant_buffer_t* buf, void* data) {
     glBindBuffer(GL_UNIFORM_BUFFER, 0);
 }
 
+size_t align_up(size_t value, size_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+// frame_size is how much uniform data a single frame may append
+struct uniform_arena_t* uniform_arena_new(size_t frame_size) {
+    struct uniform_arena_t* arena = malloc(sizeof(struct uniform_arena_t));
+    memset(arena, 0, sizeof(struct uniform_arena_t));
+
+    GLint alignment = 0;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+
+    arena->alignment = alignment > 16 ? alignment : 16;
+    arena->region_size = align_up(frame_size, arena->alignment);
+
+    glGenBuffers(1, &arena->buffer_object);
+    glBindBuffer(GL_UNIFORM_BUFFER, arena->buffer_object);
+
+    if (GLAD_GL_VERSION_4_4 || GLAD_GL_ARB_buffer_storage) {
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        size_t size = arena->region_size * UNIFORM_ARENA_FRAMES;
+
+        glBufferStorage(GL_UNIFORM_BUFFER, size, 0, flags);
+        arena->mapped = glMapBufferRange(GL_UNIFORM_BUFFER, 0, size, flags);
+    } else {
+        // a single region, orphaned at the start of every frame
+        glBufferData(GL_UNIFORM_BUFFER, arena->region_size, 0, GL_STREAM_DRAW);
+    }
+
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+    return arena;
+}
+
+void uniform_arena_delete(struct uniform_arena_t* arena) {
+    for(int i = 0;i < UNIFORM_ARENA_FRAMES;i++) {
+        if (arena->fences[i]) {
+            glDeleteSync(arena->fences[i]);
+        }
+    }
+
+    if (arena->mapped) {
+        glBindBuffer(GL_UNIFORM_BUFFER, arena->buffer_object);
+        glUnmapBuffer(GL_UNIFORM_BUFFER);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+
+    glDeleteBuffers(1, &arena->buffer_object);
+    free(arena);
+}
+
+void uniform_arena_begin_frame(struct uniform_arena_t* arena) {
+    if (arena->mapped) {
+        arena->region = (arena->region + 1) % UNIFORM_ARENA_FRAMES;
+
+        // only blocks when the CPU gets UNIFORM_ARENA_FRAMES frames ahead of the GPU
+        GLsync fence = arena->fences[arena->region];
+        if (fence) {
+            while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED) {
+            }
+            glDeleteSync(fence);
+            arena->fences[arena->region] = 0;
+        }
+    } else {
+        glBindBuffer(GL_UNIFORM_BUFFER, arena->buffer_object);
+        glBufferData(GL_UNIFORM_BUFFER, arena->region_size, 0, GL_STREAM_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+
+    arena->offset = 0;
+}
+
+void uniform_arena_end_frame(struct uniform_arena_t* arena) {
+    if (arena->mapped) {
+        arena->fences[arena->region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+}
+
+// Appends data to this frame's region and binds it to the uniform block binding point
+void uniform_arena_bind(struct uniform_arena_t* arena, GLuint binding, void* data, size_t size) {
+    PROFILE_BEGIN("uniform_arena_bind");
+
+    // std140 blocks are sized in vec4 steps, the bound range has to cover that
+    size_t range = align_up(size, 16);
+    size_t offset = align_up(arena->offset, arena->alignment);
+
+    if (offset + range > arena->region_size) {
+        // out of room for this frame: wait for the GPU and start the region over
+        log_error("Uniform arena is full");
+        glFinish();
+        offset = 0;
+    }
+
+    size_t base = arena->region * arena->region_size;
+
+    if (arena->mapped) {
+        memcpy(arena->mapped + base + offset, data, size);
+    } else {
+        // the buffer was orphaned this frame and ranges are never reused within it
+        glBindBuffer(GL_UNIFORM_BUFFER, arena->buffer_object);
+        void* ptr = glMapBufferRange(GL_UNIFORM_BUFFER, offset, range,
+                                     GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+        memcpy(ptr, data, size);
+        glUnmapBuffer(GL_UNIFORM_BUFFER);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+
+    glBindBufferRange(GL_UNIFORM_BUFFER, binding, arena->buffer_object, base + offset, range);
+
+    arena->offset = offset + range;
+
+    PROFILE_END();
+}
+
+
+struct gpu_timer_t* gpu_timer_new() {
+    struct gpu_timer_t* timer = malloc(sizeof(struct gpu_timer_t));
+    memset(timer, 0, sizeof(struct gpu_timer_t));
+
+    timer->active = -1;
+    timer->supported = GLAD_GL_VERSION_3_3 || GLAD_GL_ARB_timer_query;
+
+    if (timer->supported) {
+        glGenQueries(GPU_TIMER_FRAMES * GPU_TIMER_PASSES, &timer->queries[0][0]);
+    } else {
+        log_info("Timer queries not supported, no GPU pass times");
+    }
+
+    return timer;
+}
+
+void gpu_timer_delete(struct gpu_timer_t* timer) {
+    if (timer->supported) {
+        glDeleteQueries(GPU_TIMER_FRAMES * GPU_TIMER_PASSES, &timer->queries[0][0]);
+    }
+    free(timer);
+}
+
+// Moves on to the next set of queries, collecting the results they hold from GPU_TIMER_FRAMES - 1 frames ago
+void gpu_timer_begin_frame(struct gpu_timer_t* timer) {
+    if (!timer->supported) {
+        return;
+    }
+
+    timer->frame = (timer->frame + 1) % GPU_TIMER_FRAMES;
+
+    unsigned int issued = timer->issued[timer->frame];
+    timer->issued[timer->frame] = 0;
+
+    for(int pass = 0;pass < GPU_TIMER_PASSES;pass++) {
+        if (!(issued & (1u << pass))) {
+            continue;
+        }
+
+        GLuint query = timer->queries[timer->frame][pass];
+
+        // still in flight means the GPU is more than two frames behind, skip the result rather than wait
+        GLint available = 0;
+        glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) {
+            continue;
+        }
+
+        GLuint64 elapsed = 0;
+        glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsed);
+
+        timer->ms[pass] = elapsed / 1000000.0;
+        PROFILE_COUNTER(timer->names[pass], timer->ms[pass]);
+    }
+}
+
+// Time elapsed queries don't nest, a pass has to end before the next one begins
+void gpu_timer_begin(struct gpu_timer_t* timer, int pass, const char* name) {
+    assert(pass >= 0 && pass < GPU_TIMER_PASSES);
+    assert(timer->active < 0);
+
+    if (!timer->supported) {
+        return;
+    }
+
+    timer->names[pass] = name;
+    timer->issued[timer->frame] |= 1u << pass;
+    timer->active = pass;
+
+    glBeginQuery(GL_TIME_ELAPSED, timer->queries[timer->frame][pass]);
+}
+
+void gpu_timer_end(struct gpu_timer_t* timer) {
+    if (!timer->supported) {
+        return;
+    }
+
+    glEndQuery(GL_TIME_ELAPSED);
+    timer->active = -1;
+}
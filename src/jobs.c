@@ -0,0 +1,373 @@
+#include "doom.h"
+
+// Job system: a fixed pool of worker threads with a deque of jobs each
+//
+// A thread pushes and pops jobs at the bottom of its own deque (newest first,
+// still warm in its cache), a thread that runs out steals from the top of the
+// others (oldest first). A job is one range of a parallel_for, so there are only
+// a few per call and a small lock per deque is never the bottleneck. The thread
+// that calls parallel_for works on the jobs too until all of them are done, which
+// also makes a parallel_for inside a job fine.
+//
+// Without jobs_init, or with one thread, parallel_for runs everything in place.
+
+#ifdef _WIN32
+#include <windows.h>
+#define JOBS_THREAD_LOCAL __declspec(thread)
+
+typedef CRITICAL_SECTION job_mutex_t;
+typedef CONDITION_VARIABLE job_cond_t;
+typedef HANDLE job_thread_t;
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#define JOBS_THREAD_LOCAL _Thread_local
+
+typedef pthread_mutex_t job_mutex_t;
+typedef pthread_cond_t job_cond_t;
+typedef pthread_t job_thread_t;
+#endif
+
+#define JOBS_DEQUE_SIZE 256 // jobs per deque, power of two
+
+struct job_t {
+    job_func_t func;
+    void* data;
+    size_t begin, end;
+    volatile int* pending; // jobs of the parallel_for not finished yet
+};
+
+struct job_deque_t {
+    struct job_t jobs[JOBS_DEQUE_SIZE];
+    unsigned int top, bottom; // steal at top, push and pop at bottom
+    job_mutex_t lock;
+};
+
+struct job_deque_t jobs_deques[JOBS_MAX_THREADS];
+job_thread_t jobs_threads[JOBS_MAX_THREADS];
+int jobs_count = 1; // threads including the main thread
+
+// idle workers sleep until jobs get queued
+job_mutex_t jobs_wake_lock;
+job_cond_t jobs_wake;
+volatile int jobs_queued = 0;
+volatile int jobs_quit = 0;
+
+JOBS_THREAD_LOCAL int jobs_thread = 0; // 0 is the main thread
+
+void job_mutex_init(job_mutex_t* m) {
+#ifdef _WIN32
+    InitializeCriticalSection(m);
+#else
+    pthread_mutex_init(m, 0);
+#endif
+}
+
+void job_mutex_destroy(job_mutex_t* m) {
+#ifdef _WIN32
+    DeleteCriticalSection(m);
+#else
+    pthread_mutex_destroy(m);
+#endif
+}
+
+void job_lock(job_mutex_t* m) {
+#ifdef _WIN32
+    EnterCriticalSection(m);
+#else
+    pthread_mutex_lock(m);
+#endif
+}
+
+void job_unlock(job_mutex_t* m) {
+#ifdef _WIN32
+    LeaveCriticalSection(m);
+#else
+    pthread_mutex_unlock(m);
+#endif
+}
+
+int job_atomic_add(volatile int* value, int add) {
+#ifdef _WIN32
+    return InterlockedExchangeAdd((volatile LONG*)value, add) + add;
+#else
+    return __atomic_add_fetch(value, add, __ATOMIC_ACQ_REL);
+#endif
+}
+
+int job_atomic_load(volatile int* value) {
+#ifdef _WIN32
+    int v = *value;
+    MemoryBarrier();
+    return v;
+#else
+    return __atomic_load_n(value, __ATOMIC_ACQUIRE);
+#endif
+}
+
+void job_yield() {
+#ifdef _WIN32
+    SwitchToThread();
+#else
+    sched_yield();
+#endif
+}
+
+// Returns 0 when the deque is full
+int job_push(struct job_deque_t* deque, struct job_t* job) {
+    job_lock(&deque->lock);
+    if (deque->bottom - deque->top == JOBS_DEQUE_SIZE) {
+        job_unlock(&deque->lock);
+        return 0;
+    }
+    // counted before it can be taken, under the same lock the taker holds, so
+    // jobs_queued never goes below 0 and the idle workers keep sleeping
+    job_atomic_add(&jobs_queued, 1);
+    deque->jobs[deque->bottom & (JOBS_DEQUE_SIZE - 1)] = *job;
+    deque->bottom++;
+    job_unlock(&deque->lock);
+    return 1;
+}
+
+int job_pop(struct job_deque_t* deque, struct job_t* job) {
+    int found = 0;
+
+    job_lock(&deque->lock);
+    if (deque->bottom != deque->top) {
+        deque->bottom--;
+        *job = deque->jobs[deque->bottom & (JOBS_DEQUE_SIZE - 1)];
+        job_atomic_add(&jobs_queued, -1);
+        found = 1;
+    }
+    job_unlock(&deque->lock);
+    return found;
+}
+
+int job_steal(struct job_deque_t* deque, struct job_t* job) {
+    int found = 0;
+
+    job_lock(&deque->lock);
+    if (deque->bottom != deque->top) {
+        *job = deque->jobs[deque->top & (JOBS_DEQUE_SIZE - 1)];
+        deque->top++;
+        job_atomic_add(&jobs_queued, -1);
+        found = 1;
+    }
+    job_unlock(&deque->lock);
+    return found;
+}
+
+// Own deque first, then the others starting with the next thread
+int job_find(int thread, struct job_t* job) {
+    if (job_pop(&jobs_deques[thread], job)) {
+        return 1;
+    }
+    for(int i = 1;i < jobs_count;i++) {
+        if (job_steal(&jobs_deques[(thread + i) % jobs_count], job)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void job_run(struct job_t* job, int thread) {
+    job->func(job->data, job->begin, job->end, thread);
+    job_atomic_add(job->pending, -1);
+}
+
+#ifdef _WIN32
+DWORD WINAPI job_worker(LPVOID param)
+#else
+void* job_worker(void* param)
+#endif
+{
+    jobs_thread = (int)(size_t)param;
+
+    char name[32];
+    snprintf(name, sizeof(name), "worker %d", jobs_thread);
+    PROFILE_THREAD_NAME(name);
+
+    struct job_t job;
+
+    while (!job_atomic_load(&jobs_quit)) {
+        if (job_find(jobs_thread, &job)) {
+            job_run(&job, jobs_thread);
+            continue;
+        }
+
+        job_lock(&jobs_wake_lock);
+        while (job_atomic_load(&jobs_queued) == 0 && !job_atomic_load(&jobs_quit)) {
+#ifdef _WIN32
+            SleepConditionVariableCS(&jobs_wake, &jobs_wake_lock, INFINITE);
+#else
+            pthread_cond_wait(&jobs_wake, &jobs_wake_lock);
+#endif
+        }
+        job_unlock(&jobs_wake_lock);
+    }
+    return 0;
+}
+
+void jobs_wake_workers() {
+    job_lock(&jobs_wake_lock);
+#ifdef _WIN32
+    WakeAllConditionVariable(&jobs_wake);
+#else
+    pthread_cond_broadcast(&jobs_wake);
+#endif
+    job_unlock(&jobs_wake_lock);
+}
+
+int jobs_cpu_count() {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors;
+#else
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? count : 1;
+#endif
+}
+
+// threads counts the main thread, 0 for one thread per core
+void jobs_init(int threads) {
+    if (threads <= 0) {
+        threads = jobs_cpu_count();
+    }
+    if (threads > JOBS_MAX_THREADS) {
+        threads = JOBS_MAX_THREADS;
+    }
+
+    jobs_count = threads;
+    jobs_queued = 0;
+    jobs_quit = 0;
+
+    job_mutex_init(&jobs_wake_lock);
+#ifdef _WIN32
+    InitializeConditionVariable(&jobs_wake);
+#else
+    pthread_cond_init(&jobs_wake, 0);
+#endif
+
+    for(int i = 0;i < jobs_count;i++) {
+        jobs_deques[i].top = 0;
+        jobs_deques[i].bottom = 0;
+        job_mutex_init(&jobs_deques[i].lock);
+    }
+
+    for(int i = 1;i < jobs_count;i++) {
+#ifdef _WIN32
+        jobs_threads[i] = CreateThread(0, 0, job_worker, (LPVOID)(size_t)i, 0, 0);
+#else
+        pthread_create(&jobs_threads[i], 0, job_worker, (void*)(size_t)i);
+#endif
+    }
+
+    printf("jobs: %d threads\n", jobs_count);
+}
+
+void jobs_shutdown() {
+    job_atomic_add(&jobs_quit, 1);
+    jobs_wake_workers();
+
+    for(int i = 1;i < jobs_count;i++) {
+#ifdef _WIN32
+        WaitForSingleObject(jobs_threads[i], INFINITE);
+        CloseHandle(jobs_threads[i]);
+#else
+        pthread_join(jobs_threads[i], 0);
+#endif
+    }
+
+    for(int i = 0;i < jobs_count;i++) {
+        job_mutex_destroy(&jobs_deques[i].lock);
+    }
+    job_mutex_destroy(&jobs_wake_lock);
+#ifndef _WIN32
+    pthread_cond_destroy(&jobs_wake);
+#endif
+
+    jobs_count = 1;
+}
+
+int jobs_thread_count() {
+    return jobs_count;
+}
+
+int jobs_thread_index() {
+    return jobs_thread;
+}
+
+// Queues func over [0, count) in ranges of about grain items and returns right
+// away. *pending is the number of ranges not done yet, it is 0 once every range
+// ran. The caller can help with jobs_run_one while it waits, and must not leave
+// before *pending is 0. With one thread everything runs before it returns.
+void parallel_for_async(size_t count, size_t grain, job_func_t func, void* data, volatile int* pending) {
+    *pending = 0;
+
+    if (count == 0) {
+        return;
+    }
+    if (grain == 0) {
+        grain = 1;
+    }
+
+    size_t ranges = (count + grain - 1) / grain;
+
+    if (jobs_count <= 1 || ranges <= 1) {
+        func(data, 0, count, jobs_thread);
+        return;
+    }
+
+    // no point in more ranges than the deque holds
+    if (ranges > JOBS_DEQUE_SIZE / 2) {
+        ranges = JOBS_DEQUE_SIZE / 2;
+        grain = (count + ranges - 1) / ranges;
+        ranges = (count + grain - 1) / grain;
+    }
+
+    job_atomic_add(pending, ranges);
+    struct job_deque_t* deque = &jobs_deques[jobs_thread];
+
+    for(size_t r = 0;r < ranges;r++) {
+        struct job_t job;
+        job.func = func;
+        job.data = data;
+        job.begin = r * grain;
+        job.end = job.begin + grain < count ? job.begin + grain : count;
+        job.pending = pending;
+
+        // a full deque (deeply nested calls) runs the range here
+        if (!job_push(deque, &job)) {
+            job_run(&job, jobs_thread);
+        }
+    }
+
+    jobs_wake_workers();
+}
+
+// Runs one queued job on the calling thread, 0 when there was none
+int jobs_run_one() {
+    struct job_t job;
+    if (job_find(jobs_thread, &job)) {
+        job_run(&job, jobs_thread);
+        return 1;
+    }
+    return 0;
+}
+
+// Calls func over [0, count) in ranges of about grain items, spread over all threads.
+// Returns when every range is done. Which thread runs which range changes from call
+// to call, results must not depend on it.
+void parallel_for(size_t count, size_t grain, job_func_t func, void* data) {
+    volatile int pending;
+    parallel_for_async(count, grain, func, data, &pending);
+
+    // help out until the last range is done, stealing runs other calls' jobs too
+    while (job_atomic_load(&pending) > 0) {
+        if (!jobs_run_one()) {
+            job_yield();
+        }
+    }
+}
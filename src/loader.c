@@ -0,0 +1,189 @@
+#include "doom.h"
+
+// Texture batch: decodes every image on the job workers, uploads on the GL thread
+//
+// texture_batch_load queues one decode job per image and does not wait for them:
+// the calling thread (the one with the GL context) takes the decoded images off
+// a queue and uploads them while the others are still decoding, and decodes
+// itself when nothing is ready. Each finished decode reserves the next queue
+// slot and then writes its image into it, the uploads follow the slots in order
+// and wait for a reserved slot to be written.
+//
+// With one thread the decodes all run first and the uploads after. An image
+// with an up to date texture cache is only mapped, not decoded, see
+// texture_image_load. Atlas images are handed to their atlas instead of being
+// uploaded, atlas_build packs them once the batch is loaded.
+
+void texture_batch_init(struct texture_batch_t* batch) {
+    memset(batch, 0, sizeof(struct texture_batch_t));
+}
+
+void texture_batch_free(struct texture_batch_t* batch) {
+    for(size_t i = 0;i < batch->count;i++) {
+        if (batch->images[i].image.pixels) {
+            texture_image_free(&batch->images[i].image);
+        }
+    }
+    free(batch->images);
+    free((void*)batch->ready);
+    memset(batch, 0, sizeof(struct texture_batch_t));
+}
+
+struct texture_batch_image_t* texture_batch_push(struct texture_batch_t* batch) {
+    if (batch->count == batch->capacity) {
+        batch->capacity = batch->capacity ? batch->capacity * 2 : 32;
+        batch->images = realloc(batch->images, sizeof(struct texture_batch_image_t) * batch->capacity);
+    }
+
+    struct texture_batch_image_t* image = &batch->images[batch->count];
+    memset(image, 0, sizeof(struct texture_batch_image_t));
+    batch->count++;
+    return image;
+}
+
+// tex is filled in by texture_batch_load
+void texture_batch_add(struct texture_batch_t* batch, struct texture_t* tex, const char* filename) {
+    struct texture_batch_image_t* image = texture_batch_push(batch);
+    image->texture = tex;
+    image->filename = filename;
+    image->face = -1;
+}
+
+// The six faces in the order of texture_load_cubemap
+void texture_batch_add_cubemap(struct texture_batch_t* batch, struct texture_t* tex, const char* filenames[]) {
+    for(int face = 0;face < 6;face++) {
+        struct texture_batch_image_t* image = texture_batch_push(batch);
+        image->texture = tex;
+        image->filename = filenames[face];
+        image->face = face;
+    }
+}
+
+// The image becomes atlas image index, the atlas is made by atlas_build
+void texture_batch_add_atlas(struct texture_batch_t* batch, struct atlas_t* atlas, int index, const char* filename) {
+    struct texture_batch_image_t* image = texture_batch_push(batch);
+    image->atlas = atlas;
+    image->atlas_index = index;
+    image->filename = filename;
+    image->face = -1;
+}
+
+void texture_batch_decode_job(void* data, size_t begin, size_t end, int thread) {
+    struct texture_batch_t* batch = data;
+
+    for(size_t i = begin;i < end;i++) {
+        struct texture_batch_image_t* image = &batch->images[i];
+
+        PROFILE_BEGIN("texture decode");
+        double start = timer_now();
+        if (image->face >= 0) {
+            texture_image_load(&image->image, image->filename, 3, 0);
+        } else {
+            texture_image_load(&image->image, image->filename, 4, TEXTURE_MIPMAP);
+        }
+        image->decode_ms = (timer_now() - start) * 1000.0;
+        image->thread = thread;
+        PROFILE_END();
+
+        // slots start at -1, adding index + 1 publishes the image
+        int slot = job_atomic_add(&batch->reserved, 1) - 1;
+        job_atomic_add(&batch->ready[slot], (int)i + 1);
+    }
+}
+
+void texture_batch_upload(struct texture_batch_image_t* image) {
+    double start = timer_now();
+
+    if (!image->image.pixels) {
+        printf("Texture failed to load at path: %s\n", image->filename);
+    } else if (image->atlas) {
+        // the atlas owns the pixels now, the size stays for the report
+        image->atlas->images[image->atlas_index] = image->image;
+        image->image.pixels = NULL;
+    } else if (image->face >= 0) {
+        // the first face to arrive makes the cube map
+        if (image->texture->texture_id == 0) {
+            texture_cubemap_create(image->texture);
+        }
+        texture_upload_cubemap_face(image->texture, image->face, &image->image);
+    } else {
+        texture_upload(image->texture, &image->image);
+    }
+
+    if (image->image.pixels) {
+        texture_image_free(&image->image);
+    }
+    image->upload_ms = (timer_now() - start) * 1000.0;
+}
+
+// Loads every image added so far, returns 0 if any of them failed
+int texture_batch_load(struct texture_batch_t* batch) {
+    PROFILE_BEGIN("texture_batch_load");
+    double start = timer_now();
+
+    for(size_t i = 0;i < batch->count;i++) {
+        struct texture_t* tex = batch->images[i].texture;
+        if (!tex) {
+            continue;
+        }
+        tex->texture_id = 0;
+        tex->width = 0;
+        tex->height = 0;
+    }
+
+    batch->ready = malloc(sizeof(int) * (batch->count ? batch->count : 1));
+    for(size_t i = 0;i < batch->count;i++) {
+        batch->ready[i] = -1;
+    }
+    batch->reserved = 0;
+
+    // one image per job, they differ a lot in size
+    volatile int pending;
+    parallel_for_async(batch->count, 1, texture_batch_decode_job, batch, &pending);
+
+    int failed = 0;
+    size_t uploaded = 0;
+    while (uploaded < batch->count) {
+        int index = job_atomic_load(&batch->ready[uploaded]);
+        if (index >= 0) {
+            struct texture_batch_image_t* image = &batch->images[index];
+            failed |= image->image.pixels == 0;
+            texture_batch_upload(image);
+            uploaded++;
+        } else if (!jobs_run_one()) {
+            job_yield();
+        }
+    }
+
+    // the last jobs can still be finishing their bookkeeping
+    while (job_atomic_load(&pending) > 0) {
+        job_yield();
+    }
+
+    batch->load_ms = (timer_now() - start) * 1000.0;
+    PROFILE_END();
+
+    return !failed;
+}
+
+// Per image decode and upload times of the last texture_batch_load
+void texture_batch_report(struct texture_batch_t* batch) {
+    double decode_ms = 0.0, upload_ms = 0.0;
+    size_t cached = 0;
+
+    printf("%10s %10s %6s %6s %11s  %s\n", "decode ms", "upload ms", "thread", "cache", "size", "file");
+    for(size_t i = 0;i < batch->count;i++) {
+        struct texture_batch_image_t* image = &batch->images[i];
+        char size[32];
+        snprintf(size, sizeof(size), "%dx%d", image->image.width, image->image.height);
+
+        printf("%10.2f %10.2f %6d %6s %11s  %s\n", image->decode_ms, image->upload_ms, image->thread,
+               image->image.cached ? "hit" : "miss", size, image->filename);
+
+        decode_ms += image->decode_ms;
+        upload_ms += image->upload_ms;
+        cached += image->image.cached;
+    }
+    printf("textures: %zu images (%zu cached) in %.2f ms on %d threads (decode %.2f ms, upload %.2f ms)\n",
+           batch->count, cached, batch->load_ms, jobs_thread_count(), decode_ms, upload_ms);
+}
@@ -0,0 +1,312 @@
+#include "game.h"
+#include <time.h>
+#include <GLFW/glfw3.h>
+
+// doom [--seed N] [--record FILE] [--replay FILE [--frame-times CSV]] [--trace FILE]
+//
+// F9 saves the last frames of the profiler to doom_trace.json (profiling builds only),
+// --trace saves them when the game exits. F10 shows the GPU time of every render pass.
+// F8 toggles fast-forward, the simulation runs FAST_FORWARD_SPEED ticks per tick of time.
+//
+// The game updates in fixed ticks of GAME_TICK_DT and renders once per frame in between.
+// A recording stores every tick, a replay plays them back at the recorded pace.
+
+GLFWwindow* window = 0;
+
+// events reported by the GLFW callbacks, handed to the game with the next frame's input
+unsigned int pending_events = 0;
+
+// frames written by a trace dump
+#define TRACE_FRAMES 300
+
+#define FAST_FORWARD_SPEED 8
+int fast_forward = 0;
+
+void platform_capture_cursor(int capture) {
+    glfwSetInputMode(window, GLFW_CURSOR, capture ? GLFW_CURSOR_DISABLED : GLFW_CURSOR_NORMAL);
+}
+
+void platform_poll_input(struct input_state_t* input) {
+    input->keys = 0;
+    input->buttons = 0;
+
+    if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS) {
+        input->keys |= INPUT_KEY_W;
+    }
+    if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS) {
+        input->keys |= INPUT_KEY_A;
+    }
+    if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS) {
+        input->keys |= INPUT_KEY_S;
+    }
+    if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS) {
+        input->keys |= INPUT_KEY_D;
+    }
+    if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS) {
+        input->keys |= INPUT_KEY_ESCAPE;
+    }
+
+    if (glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS) {
+        input->buttons |= INPUT_BUTTON_LEFT;
+    }
+
+    double mouse_x, mouse_y;
+    glfwGetCursorPos(window, &mouse_x, &mouse_y);
+
+    input->mouse_x = mouse_x;
+    input->mouse_y = mouse_y;
+
+    input->events = pending_events;
+    pending_events = 0;
+}
+
+void process_mouse_button(GLFWwindow* window, int button, int action, int mods) {
+    if (button == GLFW_MOUSE_BUTTON_LEFT && action == GLFW_RELEASE) {
+        pending_events |= INPUT_EVENT_CLICK;
+    }
+}
+
+void process_key_press(GLFWwindow* window, int key, int scancode, int action, int mods) {
+    if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS) {
+        pending_events |= INPUT_EVENT_PAUSE;
+    }
+    if (key == GLFW_KEY_F9 && action == GLFW_PRESS) {
+        profile_dump("doom_trace.json", TRACE_FRAMES);
+    }
+    if (key == GLFW_KEY_F8 && action == GLFW_PRESS) {
+        fast_forward = !fast_forward;
+    }
+    if (key == GLFW_KEY_F10 && action == GLFW_PRESS) {
+        game->show_gpu_timer = !game->show_gpu_timer;
+    }
+}
+
+void process_mouse_move(GLFWwindow* window, double xPosition, double yPosition) {
+
+}
+
+void framebuffer_resize_callback(GLFWwindow* window, int width, int height) {
+    game_update_projections(width, height);
+}
+
+int main(int argc, char** argv) {
+    const char* record_filename = 0;
+    const char* replay_filename = 0;
+    const char* frame_times_filename = 0;
+    const char* trace_filename = 0;
+    int seeded = 0;
+    unsigned int seed = 0;
+
+    for(int i = 1;i < argc;i++) {
+        if (strequal(argv[i], "--record") && i + 1 < argc) {
+            record_filename = argv[++i];
+        } else if (strequal(argv[i], "--replay") && i + 1 < argc) {
+            replay_filename = argv[++i];
+        } else if (strequal(argv[i], "--frame-times") && i + 1 < argc) {
+            frame_times_filename = argv[++i];
+        } else if (strequal(argv[i], "--trace") && i + 1 < argc) {
+            trace_filename = argv[++i];
+        } else if (strequal(argv[i], "--seed") && i + 1 < argc) {
+            seed = atoi(argv[++i]);
+            seeded = 1;
+        }
+    }
+
+    struct replay_t* replay = 0;
+    int width = 1280;
+    int height = 720;
+
+    if (replay_filename) {
+        replay = replay_load(replay_filename);
+        if (!replay) {
+            return -1;
+        }
+        // the menus lay out by window size, so it has to match the recording
+        seed = replay->seed;
+        seeded = 1;
+        width = replay->width;
+        height = replay->height;
+    } else if (record_filename && !seeded) {
+        seed = (unsigned int)time(0);
+        seeded = 1;
+    }
+
+    jobs_init(0);
+    game_init(width, height);
+    if (seeded) {
+        game_seed(seed);
+    }
+
+	glfwInit();
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 2);
+	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+
+	window = glfwCreateWindow(game->width, game->height, "DOOM: DEMON SLAYER (Developed by Shah Farhad Reza)", 0, 0);
+	if (window == 0) {
+		log_error("WINDOW::CREATION");
+		log_error("OpenGL 3.2 Required");
+		glfwTerminate();
+		return -1;
+	}
+	glfwMakeContextCurrent(window);
+
+	glfwSetFramebufferSizeCallback(window, framebuffer_resize_callback);
+	glfwSetCursorPosCallback(window, process_mouse_move);
+	//glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+	glfwSetMouseButtonCallback(window, process_mouse_button);
+	glfwSetKeyCallback(window, process_key_press);
+
+	// GLAD
+	if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
+		log_error("Failed to initialize GLAD");
+		return -1;
+	}
+
+	log_info2("OpenGL", glGetString(GL_VERSION));
+
+	glDisable(GL_CULL_FACE);
+	glEnable(GL_DEPTH_TEST);
+
+	PROFILE_BEGIN("game_load_assets");
+	int loaded = game_load_assets();
+	PROFILE_END();
+
+	if (!loaded) {
+        return -1;
+	}
+
+	if (record_filename) {
+        replay = replay_record_begin(record_filename, seed, game->width, game->height);
+	}
+
+	// frame times of a replay run, a frame can run any number of ticks
+	size_t frame_times_count = 0;
+	size_t frame_times_capacity = 0;
+	float* frame_times = 0;
+
+	if (replay && !replay->recording) {
+        frame_times_capacity = replay->frame_count + 1;
+        frame_times = malloc(sizeof(float) * frame_times_capacity);
+	}
+
+    double last_time = glfwGetTime();
+
+    // simulation time not ticked yet
+    double accumulator = 0.0;
+
+    // clicks and pauses wait for the next tick, a frame can have none
+    unsigned int pending_tick_events = 0;
+
+    int replay_done = 0;
+
+	// game loop
+	while (!glfwWindowShouldClose(window) && !replay_done) {
+        PROFILE_FRAME();
+
+        double current_time = glfwGetTime();
+		// delta time ()
+		double dt = current_time - last_time;
+		last_time = current_time;
+
+		if (game->quit) {
+            break;
+		}
+
+		if (glfwGetKey(window, GLFW_KEY_P) == GLFW_PRESS) {
+		    printf("player %f, %f, %f\n", game->player_pos.x, game->player_pos.y, game->player_pos.z);
+		}
+
+        double frame_start = timer_now();
+
+        if (!replay || replay->recording) {
+            glfwGetWindowSize(window, &game->width, &game->height);
+        }
+        glViewport(0, 0, game->width, game->height);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+        glClearColor(0.8f, 0.8f, 0.8f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+        int speed = fast_forward ? FAST_FORWARD_SPEED : 1;
+
+        accumulator += dt * speed;
+        if (accumulator > GAME_TICK_DT * GAME_MAX_TICKS_PER_FRAME * speed) {
+            accumulator = GAME_TICK_DT * GAME_MAX_TICKS_PER_FRAME * speed;
+        }
+
+        if (!replay || replay->recording) {
+            platform_poll_input(&game->input);
+            pending_tick_events |= game->input.events;
+        }
+
+        while (accumulator >= GAME_TICK_DT) {
+            float tick_dt = GAME_TICK_DT;
+
+            if (replay && !replay->recording) {
+                // old recordings have a tick per frame of any length
+                if (!replay_next_frame(replay, &tick_dt, &game->input)) {
+                    replay_done = 1;
+                    break;
+                }
+            } else {
+                game->input.events = pending_tick_events;
+                pending_tick_events = 0;
+            }
+
+            if (replay && replay->recording) {
+                replay_record_frame(replay, tick_dt, &game->input);
+            }
+
+            game_update(tick_dt);
+
+            accumulator -= tick_dt;
+        }
+
+        game->render_alpha = accumulator / GAME_TICK_DT;
+        if (game->render_alpha < 0.0f) {
+            game->render_alpha = 0.0f;
+        }
+
+        game_render();
+
+        PROFILE_BEGIN("glfwSwapBuffers");
+        glfwSwapBuffers(window);
+        PROFILE_END();
+	    glfwPollEvents();
+
+	    if (frame_times) {
+            if (frame_times_count == frame_times_capacity) {
+                frame_times_capacity *= 2;
+                frame_times = realloc(frame_times, sizeof(float) * frame_times_capacity);
+            }
+            frame_times[frame_times_count] = (timer_now() - frame_start) * 1000.0;
+            frame_times_count++;
+	    }
+	}
+
+	if (replay) {
+        if (frame_times) {
+            frame_times_report(frame_times, frame_times_count, frame_times_filename);
+            free(frame_times);
+        }
+        // recording and replay of the same session must print the same value
+        printf("state checksum: %08x\n", game_state_checksum());
+        replay_close(replay);
+	}
+
+	if (trace_filename) {
+        profile_dump(trace_filename, TRACE_FRAMES);
+	}
+
+	log_info("Cleaning up...");
+
+	game_free_assets();
+
+	glfwDestroyWindow(window);
+	glfwTerminate();
+
+	game_shutdown();
+	jobs_shutdown();
+	return 0;
+}
@@ -0,0 +1,288 @@
+#include "game.h"
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+// doom_bench: plays a recorded replay through the full game_render path on an
+// offscreen EGL context, no window and no display needed. On machines without a
+// GPU Mesa gives a surfaceless llvmpipe context.
+//
+//   doom_bench --replay FILE [--frames N] [--frame-times CSV] [--threads N] [--trace FILE]
+//
+// Every frame is rendered into an FBO the size of the recording and finished
+// with glFinish, so the frame time includes the GPU (or llvmpipe) work. Prints
+// frames/sec, the frame time percentiles and the average CPU and GPU time of
+// every render pass.
+
+void platform_capture_cursor(int capture) {
+    // no cursor without a window
+}
+
+EGLDisplay bench_display = EGL_NO_DISPLAY;
+EGLContext bench_context = EGL_NO_CONTEXT;
+
+int bench_create_context() {
+    PFNEGLGETPLATFORMDISPLAYEXTPROC get_platform_display =
+        (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+
+    // surfaceless needs no X/Wayland server and no DRM device
+    if (get_platform_display) {
+        bench_display = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+    }
+    if (bench_display == EGL_NO_DISPLAY) {
+        bench_display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    }
+
+    EGLint major, minor;
+    if (bench_display == EGL_NO_DISPLAY || !eglInitialize(bench_display, &major, &minor)) {
+        log_error("Failed to initialize EGL");
+        return 0;
+    }
+
+    if (!eglBindAPI(EGL_OPENGL_API)) {
+        log_error("EGL has no desktop OpenGL");
+        return 0;
+    }
+
+    EGLint config_attribs[] = {
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_NONE
+    };
+
+    EGLConfig config = 0;
+    EGLint config_count = 0;
+    eglChooseConfig(bench_display, config_attribs, &config, 1, &config_count);
+
+    // the shaders are #version 420
+    EGLint context_attribs[] = {
+        EGL_CONTEXT_MAJOR_VERSION, 4,
+        EGL_CONTEXT_MINOR_VERSION, 2,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        EGL_NONE
+    };
+
+    // surfaceless displays may have no configs, the context doesn't need one as it never gets a surface
+    bench_context = eglCreateContext(bench_display, config_count ? config : EGL_NO_CONFIG_KHR,
+                                     EGL_NO_CONTEXT, context_attribs);
+    if (bench_context == EGL_NO_CONTEXT) {
+        log_error("Failed to create an OpenGL 4.2 core context");
+        return 0;
+    }
+
+    if (!eglMakeCurrent(bench_display, EGL_NO_SURFACE, EGL_NO_SURFACE, bench_context)) {
+        log_error("Failed to make the EGL context current");
+        return 0;
+    }
+
+    if (!gladLoadGLLoader((GLADloadproc)eglGetProcAddress)) {
+        log_error("Failed to initialize GLAD");
+        return 0;
+    }
+
+    log_info2("OpenGL", glGetString(GL_VERSION));
+    log_info2("Renderer", glGetString(GL_RENDERER));
+
+    return 1;
+}
+
+void bench_destroy_context() {
+    eglMakeCurrent(bench_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    eglDestroyContext(bench_display, bench_context);
+    eglTerminate(bench_display);
+}
+
+// Color and depth render target standing in for the window's framebuffer
+GLuint bench_create_framebuffer(int width, int height, GLuint renderbuffers[2]) {
+    GLuint framebuffer;
+    glGenFramebuffers(1, &framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+
+    glGenRenderbuffers(2, renderbuffers);
+
+    glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[0]);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, renderbuffers[0]);
+
+    glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[1]);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, renderbuffers[1]);
+
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        log_error("Offscreen framebuffer is incomplete");
+        glDeleteRenderbuffers(2, renderbuffers);
+        glDeleteFramebuffers(1, &framebuffer);
+        return 0;
+    }
+
+    return framebuffer;
+}
+
+int main(int argc, char** argv) {
+    const char* replay_filename = 0;
+    const char* frame_times_filename = 0;
+    const char* trace_filename = 0;
+    long max_frames = -1;
+    int threads = 0;
+
+    for(int i = 1;i < argc;i++) {
+        if (strequal(argv[i], "--replay") && i + 1 < argc) {
+            replay_filename = argv[++i];
+        } else if (strequal(argv[i], "--frames") && i + 1 < argc) {
+            max_frames = atol(argv[++i]);
+        } else if (strequal(argv[i], "--frame-times") && i + 1 < argc) {
+            frame_times_filename = argv[++i];
+        } else if (strequal(argv[i], "--threads") && i + 1 < argc) {
+            threads = atoi(argv[++i]);
+        } else if (strequal(argv[i], "--trace") && i + 1 < argc) {
+            trace_filename = argv[++i];
+        } else {
+            replay_filename = 0;
+            break;
+        }
+    }
+
+    if (!replay_filename) {
+        printf("usage: %s --replay FILE [--frames N] [--frame-times CSV] [--threads N] [--trace FILE]\n", argv[0]);
+        return -1;
+    }
+
+    struct replay_t* replay = replay_load(replay_filename);
+    if (!replay) {
+        return -1;
+    }
+
+    // stops at the end of the replay
+    long frames = replay->frame_count;
+    if (max_frames >= 0 && max_frames < frames) {
+        frames = max_frames;
+    }
+
+    jobs_init(threads);
+    game_init(replay->width, replay->height);
+    game_seed(replay->seed);
+
+    if (!bench_create_context()) {
+        return -1;
+    }
+
+    GLuint renderbuffers[2];
+    GLuint framebuffer = bench_create_framebuffer(game->width, game->height, renderbuffers);
+    if (!framebuffer) {
+        return -1;
+    }
+
+    glDisable(GL_CULL_FACE);
+    glEnable(GL_DEPTH_TEST);
+
+    PROFILE_BEGIN("game_load_assets");
+    int loaded = game_load_assets();
+    PROFILE_END();
+
+    if (!loaded) {
+        return -1;
+    }
+
+    float* frame_times = malloc(sizeof(float) * (frames + 1));
+    size_t frame_count = 0;
+
+    // CPU side of every frame, split so GPU bound frames show up as a long finish
+    double update_total = 0.0;
+    double render_total = 0.0;
+    double finish_total = 0.0;
+
+    double gpu_totals[GPU_TIMER_PASSES] = {0};
+    size_t gpu_samples = 0;
+
+    double start_time = timer_now();
+
+    while (frame_count < frames) {
+        PROFILE_FRAME();
+
+        double frame_start = timer_now();
+
+        float frame_dt;
+        if (!replay_next_frame(replay, &frame_dt, &game->input)) {
+            break;
+        }
+
+        game_update(frame_dt);
+
+        double update_end = timer_now();
+
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glViewport(0, 0, game->width, game->height);
+
+        glClearColor(0.8f, 0.8f, 0.8f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+        game_render();
+
+        double render_end = timer_now();
+
+        // stands in for the swap, the frame isn't done until the GPU is
+        PROFILE_BEGIN("glFinish");
+        glFinish();
+        PROFILE_END();
+
+        double frame_end = timer_now();
+
+        update_total += update_end - frame_start;
+        render_total += render_end - update_end;
+        finish_total += frame_end - render_end;
+
+        frame_times[frame_count] = (frame_end - frame_start) * 1000.0;
+        frame_count++;
+
+        // the timer results lag behind by GPU_TIMER_FRAMES - 1 frames
+        if (frame_count >= GPU_TIMER_FRAMES) {
+            for(int pass = 0;pass < GPU_TIMER_PASSES;pass++) {
+                gpu_totals[pass] += game->gpu_timer->ms[pass];
+            }
+            gpu_samples++;
+        }
+    }
+
+    double elapsed = timer_now() - start_time;
+
+    printf("renderer: %s, %d x %d\n", glGetString(GL_RENDERER), game->width, game->height);
+    printf("time: %.3f s, %.1f frames/s\n", elapsed, frame_count / elapsed);
+
+    frame_times_report(frame_times, frame_count, frame_times_filename);
+
+    if (frame_count > 0) {
+        printf("cpu ms: update %.3f, render %.3f, finish %.3f\n",
+               update_total * 1000.0 / frame_count, render_total * 1000.0 / frame_count,
+               finish_total * 1000.0 / frame_count);
+    }
+
+    if (gpu_samples > 0 && game->gpu_timer->supported) {
+        printf("gpu ms:");
+        for(int pass = 0;pass < GPU_TIMER_PASSES;pass++) {
+            if (game->gpu_timer->names[pass]) {
+                printf(" %s %.3f", game->gpu_timer->names[pass], gpu_totals[pass] / gpu_samples);
+            }
+        }
+        printf("\n");
+    }
+
+    printf("state checksum: %08x\n", game_state_checksum());
+
+    if (trace_filename) {
+        profile_dump(trace_filename, 300);
+    }
+
+    free(frame_times);
+    replay_close(replay);
+
+    game_free_assets();
+
+    glDeleteRenderbuffers(2, renderbuffers);
+    glDeleteFramebuffers(1, &framebuffer);
+
+    bench_destroy_context();
+
+    game_shutdown();
+    jobs_shutdown();
+    return 0;
+}
@@ -4,36 +4,79 @@ float math_deg_to_rad(float rad) {
     return rad * DEGTORAD;
 }
 
-int get_rand(int min, int max) {
-    return rand()%(max-min + 1) + min;
+// xoshiro128** (Blackman and Vigna), 128 bits of state and 32 bits per call.
+// Every subsystem owns its generator, so the numbers one of them draws never
+// depend on how many the others drew, and nothing is shared between threads.
+
+uint64_t rng_splitmix(uint64_t* x) {
+    uint64_t z = (*x += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
 }
 
-float get_randf(float a, float b) {
-    float random = ((float) rand()) / (float) RAND_MAX;
-    float diff = b - a;
-    float r = random * diff;
-    return a + r;
+// The same seed and stream always give the same numbers, different streams of
+// one seed are unrelated
+void rng_seed(struct rng_t* rng, uint64_t seed, uint64_t stream) {
+    uint64_t x = seed ^ (stream * 0xd1342543de82ef95ull);
+    uint64_t a = rng_splitmix(&x);
+    uint64_t b = rng_splitmix(&x);
+
+    rng->s[0] = (uint32_t)a;
+    rng->s[1] = (uint32_t)(a >> 32);
+    rng->s[2] = (uint32_t)b;
+    rng->s[3] = (uint32_t)(b >> 32);
+
+    // all zero is the one state it never leaves
+    if (!(rng->s[0] | rng->s[1] | rng->s[2] | rng->s[3])) {
+        rng->s[0] = 1;
+    }
 }
 
-struct vec2_t vec2_sub(struct vec2_t* a, struct vec2_t* b) {
-    struct vec2_t out;
-    out.x = a->x - b->x;
-    out.y = a->y - b->y;
-    return out;
+uint32_t rng_rotl(uint32_t x, int k) {
+    return (x << k) | (x >> (32 - k));
 }
 
-struct vec3_t vec3(float x, float y, float z) {
-    struct vec3_t v = {x, y, z};
-    return v;
-};
+uint32_t rng_next(struct rng_t* rng) {
+    uint32_t* s = rng->s;
+    uint32_t result = rng_rotl(s[1] * 5, 7) * 9;
+    uint32_t t = s[1] << 9;
 
-void mat4_identity(struct mat4_t* mat) {
-    memset(mat->M, 0, 16*sizeof(float));
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rng_rotl(s[3], 11);
 
-    mat->m[0][0] = 1.0f;
-    mat->m[1][1] = 1.0f;
-    mat->m[2][2] = 1.0f;
-    mat->m[3][3] = 1.0f;
+    return result;
+}
+
+// Uniform in [min, max], both included. Multiply and shift instead of a modulo
+// (Lemire), the few values that would favour the low end are drawn again.
+int rng_int(struct rng_t* rng, int min, int max) {
+    assert(min <= max);
+    uint32_t range = (uint32_t)max - (uint32_t)min + 1;
+    if (range == 0) {
+        return (int)rng_next(rng); // the whole int range
+    }
+
+    uint64_t m = (uint64_t)rng_next(rng) * range;
+    uint32_t low = (uint32_t)m;
+    if (low < range) {
+        uint32_t threshold = (0u - range) % range;
+        while (low < threshold) {
+            m = (uint64_t)rng_next(rng) * range;
+            low = (uint32_t)m;
+        }
+    }
+    return (int)((uint32_t)min + (uint32_t)(m >> 32));
+}
+
+// Uniform in [a, b), the top 24 bits fill the float mantissa exactly
+float rng_float(struct rng_t* rng, float a, float b) {
+    float random = (rng_next(rng) >> 8) * (1.0f / 16777216.0f);
+    return a + random * (b - a);
 }
 
 void mat4_perspective(struct mat4_t* mat, float fov, float aspect, float zNear, float zFar) {
@@ -60,66 +103,6 @@ void mat4_ortho(struct mat4_t* mat, float left, float right, float bottom, float
     mat->m[3][2] = - (zFar + zNear) / (zFar - zNear);
 }
 
-struct vec3_t vec3_add(struct vec3_t* a, struct vec3_t* b) {
-    struct vec3_t out;
-    out.x = a->x + b->x;
-    out.y = a->y + b->y;
-    out.z = a->z + b->z;
-    return out;
-}
-
-struct vec3_t vec3_sub(struct vec3_t* a, struct vec3_t* b) {
-    struct vec3_t out;
-    out.x = a->x - b->x;
-    out.y = a->y - b->y;
-    out.z = a->z - b->z;
-    return out;
-}
-
-struct vec3_t vec3_mul(struct vec3_t* a, struct vec3_t* b) {
-    struct vec3_t out;
-    out.x = a->x * b->x;
-    out.y = a->y * b->y;
-    out.z = a->z * b->z;
-    return out;
-}
-
-struct vec3_t vec3_mulf(struct vec3_t* a, float f) {
-    struct vec3_t out;
-    out.x = a->x * f;
-    out.y = a->y * f;
-    out.z = a->z * f;
-    return out;
-}
-
-struct vec3_t vec3_cross(struct vec3_t* a, struct vec3_t* b) {
-    struct vec3_t out;
-    out.x = a->y * b->z - a->z * b->y;
-	out.y = a->z * b->x - a->x * b->z;
-	out.z = a->x * b->y - a->y * b->x;
-    return out;
-}
-
-float vec3_dot(struct vec3_t* a, struct vec3_t* b) {
-    return a->x * b->x + a->y * b->y + a->z * b->z;
-}
-
-float vec3_length(struct vec3_t* v) {
-    return sqrt((v->x * v->x) + (v->y * v->y) + (v->z * v->z));
-}
-
-float vec3_distance(struct vec3_t* a, struct vec3_t* b) {
-    struct vec3_t d = vec3_sub(a, b);
-    return vec3_length(&d);
-}
-
-void vec3_normalize(struct vec3_t* v) {
-    float length_of_v = vec3_length(v);
-    v->x = v->x / length_of_v;
-    v->y = v->y / length_of_v;
-    v->z = v->z / length_of_v;
-}
-
 // lookat view-matrix
 void mat4_lookAt(struct mat4_t* mat, struct vec3_t* eye, struct vec3_t* center, struct vec3_t* up) {
     struct vec3_t f = vec3_sub(center, eye);
@@ -153,12 +136,6 @@ void mat4_lookAt(struct mat4_t* mat, struct vec3_t* eye, struct vec3_t* center,
     mat->m[3][3] = 1.0f;
 }
 
-void mat4_translate(struct mat4_t* mat, struct vec3_t* v) {
-    mat->m[3][0] = v->x;
-    mat->m[3][1] = v->y;
-    mat->m[3][2] = v->z;
-}
-
 void mat4_inverse(struct mat4_t* mat, struct mat4_t* inv)
 {
     float m00 = mat->m[0][0], m01 = mat->m[0][1], m02 = mat->m[0][2], m03 = mat->m[0][3];
@@ -232,12 +209,54 @@ void mat4_inverse(struct mat4_t* mat, struct mat4_t* inv)
     inv->M[15] = d33;
 }
 
-struct vec3_t vec3_min(struct vec3_t* v1, struct vec3_t* v2) {
-    return vec3(fmin(v1->x, v2->x), fmin(v1->y, v2->y), fmin(v1->z, v2->z));
+// out[i] = mat * (points[i], 1), four points per step with SSE
+void mat4_transform_points(struct mat4_t* mat, struct vec3_t* points, struct vec4_t* out, size_t count) {
+#ifdef DOOM_SIMD_SSE
+    __m128 c0 = _mm_loadu_ps(mat->m[0]);
+    __m128 c1 = _mm_loadu_ps(mat->m[1]);
+    __m128 c2 = _mm_loadu_ps(mat->m[2]);
+    __m128 c3 = _mm_loadu_ps(mat->m[3]);
+
+    for(size_t i = 0;i < count;i++) {
+        __m128 r = _mm_mul_ps(c0, _mm_set1_ps(points[i].x));
+        r = _mm_add_ps(r, _mm_mul_ps(c1, _mm_set1_ps(points[i].y)));
+        r = _mm_add_ps(r, _mm_mul_ps(c2, _mm_set1_ps(points[i].z)));
+        r = _mm_add_ps(r, c3);
+        _mm_storeu_ps(&out[i].x, r);
+    }
+#else
+    for(size_t i = 0;i < count;i++) {
+        struct vec4_t p = vec4(points[i].x, points[i].y, points[i].z, 1.0f);
+        out[i] = mat4_mul_vec4(mat, &p);
+    }
+#endif
 }
 
-struct vec3_t vec3_max(struct vec3_t* v1, struct vec3_t* v2) {
-    return vec3(fmax(v1->x, v2->x), fmax(v1->y, v2->y), fmax(v1->z, v2->z));
+// Normalizes count vectors stored as separate x, y and z arrays, the same bits
+// as vec3_normalize on each
+void vec3_normalize_batch(float* x, float* y, float* z, size_t count) {
+    size_t i = 0;
+#ifdef DOOM_SIMD_SSE
+    for(;i + 4 <= count;i += 4) {
+        __m128 vx = _mm_loadu_ps(x + i);
+        __m128 vy = _mm_loadu_ps(y + i);
+        __m128 vz = _mm_loadu_ps(z + i);
+
+        __m128 length = _mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, vx), _mm_mul_ps(vy, vy)), _mm_mul_ps(vz, vz));
+        length = _mm_sqrt_ps(length);
+
+        _mm_storeu_ps(x + i, _mm_div_ps(vx, length));
+        _mm_storeu_ps(y + i, _mm_div_ps(vy, length));
+        _mm_storeu_ps(z + i, _mm_div_ps(vz, length));
+    }
+#endif
+    for(;i < count;i++) {
+        struct vec3_t v = vec3(x[i], y[i], z[i]);
+        vec3_normalize(&v);
+        x[i] = v.x;
+        y[i] = v.y;
+        z[i] = v.z;
+    }
 }
 
 void aabb_init(struct aabb_t* aabb) {
@@ -0,0 +1,152 @@
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <dirent.h>
+#endif
+
+#include "doom.h"
+
+// OS services that don't belong to any window system
+
+double timer_now() {
+#ifdef _WIN32
+    static LARGE_INTEGER frequency = {0};
+    LARGE_INTEGER counter;
+    if (frequency.QuadPart == 0) {
+        QueryPerformanceFrequency(&frequency);
+    }
+    QueryPerformanceCounter(&counter);
+    return (double)counter.QuadPart / (double)frequency.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+#endif
+}
+
+// Maps a whole file read-only, the data stays valid until file_unmap
+int file_map(const char* filename, struct file_map_t* map) {
+    map->data = NULL;
+    map->size = 0;
+
+#ifdef _WIN32
+    HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        return 0;
+    }
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+        CloseHandle(file);
+        return 0;
+    }
+
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(file);
+    if (!mapping) {
+        return 0;
+    }
+
+    // the view keeps the mapping alive
+    map->data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+    if (!map->data) {
+        return 0;
+    }
+    map->size = size.QuadPart;
+#else
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        return 0;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return 0;
+    }
+
+    void* data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        return 0;
+    }
+    map->data = data;
+    map->size = st.st_size;
+#endif
+    return 1;
+}
+
+void file_unmap(struct file_map_t* map) {
+    if (map->data) {
+#ifdef _WIN32
+        UnmapViewOfFile(map->data);
+#else
+        munmap(map->data, map->size);
+#endif
+    }
+    map->data = NULL;
+    map->size = 0;
+}
+
+// modification time (seconds) and size, used to tell if a cache is stale
+int file_stat(const char* filename, unsigned long long* mtime, unsigned long long* size) {
+    struct stat st;
+    if (stat(filename, &st) != 0) {
+        return 0;
+    }
+    *mtime = st.st_mtime;
+    *size = st.st_size;
+    return 1;
+}
+
+// Calls func for every entry of dir but "." and "..", with the path "dir/name".
+// Not recursive and in no particular order.
+int file_list(const char* dir, file_list_func_t func, void* data) {
+    char path[1024];
+
+#ifdef _WIN32
+    char pattern[1024];
+    snprintf(pattern, sizeof(pattern), "%s/*", dir);
+
+    WIN32_FIND_DATAA entry;
+    HANDLE find = FindFirstFileA(pattern, &entry);
+    if (find == INVALID_HANDLE_VALUE) {
+        return 0;
+    }
+    do {
+        if (strcmp(entry.cFileName, ".") == 0 || strcmp(entry.cFileName, "..") == 0) {
+            continue;
+        }
+        snprintf(path, sizeof(path), "%s/%s", dir, entry.cFileName);
+        func(path, (entry.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0, data);
+    } while (FindNextFileA(find, &entry));
+    FindClose(find);
+#else
+    DIR* handle = opendir(dir);
+    if (!handle) {
+        return 0;
+    }
+
+    struct dirent* entry;
+    while ((entry = readdir(handle)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+            continue;
+        }
+        snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name);
+
+        struct stat st;
+        int is_dir = stat(path, &st) == 0 && S_ISDIR(st.st_mode);
+        func(path, is_dir, data);
+    }
+    closedir(handle);
+#endif
+    return 1;
+}
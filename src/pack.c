@@ -0,0 +1,321 @@
+#include "doom.h"
+
+// Asset pack: every asset in one file that is mapped once at startup
+//
+//   struct pack_header_t
+//   struct pack_entry_t * entry_count, sorted by name_hash  (at toc_offset)
+//   the names, each 0 terminated                           (at names_offset)
+//   the payloads, each at a multiple of PACK_ALIGN
+//
+// A lookup is a binary search over the table of contents and hands out a view
+// into the mapping, no open, no read and no copy. The names are stored without
+// a leading "./", the way the game asks for them otherwise, and hashed with
+// hash_bytes. The payloads keep the order they were given in, so the assets
+// loaded together sit together.
+//
+// asset_open looks in the mounted pack first and maps the loose file when the
+// asset isn't in it, so the game runs without a pack and a pack can be partial.
+// A pack older than one of the loose files it was made from isn't mounted, so
+// an edited asset is loaded as it is now until the pack is made again.
+
+#define PACK_MAGIC 0x4b415044 // "DPAK"
+#define PACK_VERSION 1
+#define PACK_ALIGN 64 // the cooked textures and meshes keep their alignment
+
+struct pack_header_t {
+    unsigned int magic;
+    unsigned int version;
+    unsigned int entry_count;
+    unsigned int names_size;
+    unsigned long long toc_offset;
+    unsigned long long names_offset;
+};
+
+struct pack_t asset_pack;
+
+// "./assets/x.png" and "assets/x.png" are the same asset
+const char* pack_name(const char* name) {
+    while (name[0] == '.' && name[1] == '/') {
+        name += 2;
+    }
+    return name;
+}
+
+int pack_open(struct pack_t* pack, const char* filename) {
+    memset(pack, 0, sizeof(struct pack_t));
+
+    if (!file_map(filename, &pack->map)) {
+        return 0;
+    }
+
+    unsigned char* base = pack->map.data;
+    size_t size = pack->map.size;
+    struct pack_header_t* header = pack->map.data;
+
+    int valid = size >= sizeof(struct pack_header_t) &&
+                header->magic == PACK_MAGIC &&
+                header->version == PACK_VERSION &&
+                header->toc_offset + (unsigned long long)header->entry_count * sizeof(struct pack_entry_t) <= size &&
+                header->names_size > 0 &&
+                header->names_offset + header->names_size <= size &&
+                base[header->names_offset + header->names_size - 1] == 0;
+
+    if (valid) {
+        struct pack_entry_t* entries = (struct pack_entry_t*)(base + header->toc_offset);
+        for(size_t i = 0;i < header->entry_count && valid;i++) {
+            valid = entries[i].offset + entries[i].size <= size &&
+                    entries[i].name_offset < header->names_size &&
+                    (i == 0 || entries[i - 1].name_hash <= entries[i].name_hash);
+        }
+    }
+
+    if (!valid) {
+        log_info2("Not an asset pack", filename);
+        file_unmap(&pack->map);
+        return 0;
+    }
+
+    pack->entries = (struct pack_entry_t*)(base + header->toc_offset);
+    pack->count = header->entry_count;
+    pack->names = (const char*)(base + header->names_offset);
+    return 1;
+}
+
+void pack_close(struct pack_t* pack) {
+    file_unmap(&pack->map);
+    memset(pack, 0, sizeof(struct pack_t));
+}
+
+// Binary search for the first entry with the hash, equal hashes are next to each other
+struct pack_entry_t* pack_find(struct pack_t* pack, const char* name) {
+    name = pack_name(name);
+    unsigned long long hash = hash_bytes(name, strlen(name));
+
+    size_t low = 0, high = pack->count;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        if (pack->entries[mid].name_hash < hash) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+
+    for(;low < pack->count && pack->entries[low].name_hash == hash;low++) {
+        if (strequal(pack->names + pack->entries[low].name_offset, name)) {
+            return &pack->entries[low];
+        }
+    }
+    return NULL;
+}
+
+// Zero-copy view of an entry, valid until the pack is closed
+int pack_view(struct pack_t* pack, const char* name, struct asset_view_t* view) {
+    memset(view, 0, sizeof(struct asset_view_t));
+
+    struct pack_entry_t* entry = pack_find(pack, name);
+    if (!entry) {
+        return 0;
+    }
+    view->data = (unsigned char*)pack->map.data + entry->offset;
+    view->size = entry->size;
+    return 1;
+}
+
+struct pack_write_item_t {
+    struct pack_entry_t entry;
+    const char* filename;
+    struct file_map_t map;
+};
+
+int pack_write_item_compare(const void* a, const void* b) {
+    unsigned long long hash_a = ((const struct pack_write_item_t*)a)->entry.name_hash;
+    unsigned long long hash_b = ((const struct pack_write_item_t*)b)->entry.name_hash;
+    return hash_a < hash_b ? -1 : hash_a > hash_b;
+}
+
+void pack_write_pad(FILE* f, unsigned long long* offset, unsigned long long to) {
+    static const unsigned char zeros[PACK_ALIGN] = {0};
+    while (*offset < to) {
+        size_t count = to - *offset < PACK_ALIGN ? to - *offset : PACK_ALIGN;
+        fwrite(zeros, 1, count, f);
+        *offset += count;
+    }
+}
+
+// Packs the loose files into filename, found by the names given. files can
+// have the file for each name (a cooked form say), without it the names are
+// the files.
+int pack_write(const char* filename, const char** names, const char** files, size_t count) {
+    struct pack_write_item_t* items = calloc(count ? count : 1, sizeof(struct pack_write_item_t));
+    int ok = 1;
+
+    struct pack_header_t header;
+    memset(&header, 0, sizeof(header));
+    header.magic = PACK_MAGIC;
+    header.version = PACK_VERSION;
+    header.entry_count = count;
+    header.toc_offset = sizeof(struct pack_header_t);
+    header.names_offset = header.toc_offset + count * sizeof(struct pack_entry_t);
+
+    // names and payloads in the order given
+    for(size_t i = 0;i < count && ok;i++) {
+        const char* name = pack_name(names[i]);
+        items[i].filename = files ? files[i] : names[i];
+        items[i].entry.name_hash = hash_bytes(name, strlen(name));
+        items[i].entry.name_offset = header.names_size;
+        header.names_size += strlen(name) + 1;
+
+        if (!file_map(items[i].filename, &items[i].map)) {
+            log_info2("Can't read", items[i].filename);
+            ok = 0;
+        }
+    }
+
+    unsigned long long offset = header.names_offset + header.names_size;
+    for(size_t i = 0;i < count && ok;i++) {
+        offset = (offset + PACK_ALIGN - 1) / PACK_ALIGN * PACK_ALIGN;
+        items[i].entry.offset = offset;
+        items[i].entry.size = items[i].map.size;
+        offset += items[i].map.size;
+    }
+
+    FILE* f = ok ? fopen(filename, "wb") : NULL;
+    if (ok && !f) {
+        log_info2("Can't write asset pack", filename);
+        ok = 0;
+    }
+
+    if (ok) {
+        fwrite(&header, sizeof(header), 1, f);
+
+        // the table of contents is the only part that is sorted
+        struct pack_write_item_t* sorted = malloc(sizeof(struct pack_write_item_t) * (count ? count : 1));
+        memcpy(sorted, items, sizeof(struct pack_write_item_t) * count);
+        qsort(sorted, count, sizeof(struct pack_write_item_t), pack_write_item_compare);
+
+        for(size_t i = 0;i < count;i++) {
+            if (i > 0 && sorted[i - 1].entry.name_hash == sorted[i].entry.name_hash) {
+                // the same file twice, or the one in 2^64 collision pack_find can still tell apart
+                log_info2("Name hash used twice", sorted[i].filename);
+            }
+            fwrite(&sorted[i].entry, sizeof(struct pack_entry_t), 1, f);
+        }
+        free(sorted);
+
+        for(size_t i = 0;i < count;i++) {
+            const char* name = pack_name(names[i]);
+            fwrite(name, 1, strlen(name) + 1, f);
+        }
+
+        unsigned long long written = header.names_offset + header.names_size;
+        for(size_t i = 0;i < count;i++) {
+            pack_write_pad(f, &written, items[i].entry.offset);
+            fwrite(items[i].map.data, 1, items[i].map.size, f);
+            written += items[i].map.size;
+        }
+
+        // fwrite errors stick to the stream, the last of them can show up at fclose
+        ok = !ferror(f);
+        ok &= fclose(f) == 0;
+        if (ok) {
+            printf("%s: %zu assets, %llu bytes\n", filename, count, written);
+        } else {
+            // a cut off pack must not be mounted
+            log_info2("Can't write asset pack", filename);
+            remove(filename);
+        }
+    }
+
+    for(size_t i = 0;i < count;i++) {
+        file_unmap(&items[i].map);
+    }
+    free(items);
+    return ok;
+}
+
+// The first loose file an entry was made from (the image or OBJ of a cooked
+// cache, or the entry's own name) that is newer than the pack, NULL if none is
+const char* pack_stale_source(struct pack_t* pack, unsigned long long pack_mtime) {
+    static const char* cooked_suffixes[] = {".tex", ".mesh"};
+    static char source[512];
+
+    for(size_t i = 0;i < pack->count;i++) {
+        const char* name = pack->names + pack->entries[i].name_offset;
+        size_t length = strlen(name);
+        if (length >= sizeof(source)) {
+            continue;
+        }
+        memcpy(source, name, length + 1);
+
+        for(size_t s = 0;s < sizeof(cooked_suffixes) / sizeof(cooked_suffixes[0]);s++) {
+            size_t suffix_length = strlen(cooked_suffixes[s]);
+            if (length > suffix_length && strequal(source + length - suffix_length, cooked_suffixes[s])) {
+                source[length - suffix_length] = 0;
+                break;
+            }
+        }
+
+        // a shipped game has no loose files, nothing to compare then
+        unsigned long long mtime, size;
+        if (file_stat(source, &mtime, &size) && mtime > pack_mtime) {
+            return source;
+        }
+    }
+    return NULL;
+}
+
+// The pack asset_open looks in first, there is none until this is called. A
+// pack older than any of its loose sources is left alone, see above.
+int asset_pack_mount(const char* filename) {
+    asset_pack_unmount();
+
+    unsigned long long pack_mtime, pack_size;
+    if (!file_stat(filename, &pack_mtime, &pack_size) || !pack_open(&asset_pack, filename)) {
+        return 0;
+    }
+
+    const char* stale = pack_stale_source(&asset_pack, pack_mtime);
+    if (stale) {
+        log_info2("Asset pack is older than an asset, loading the loose files (cook again)", stale);
+        pack_close(&asset_pack);
+        return 0;
+    }
+
+    log_info2("Asset pack mounted", filename);
+    return 1;
+}
+
+void asset_pack_unmount() {
+    pack_close(&asset_pack);
+}
+
+// The asset from the mounted pack only
+int asset_open_packed(const char* name, struct asset_view_t* view) {
+    return pack_view(&asset_pack, name, view);
+}
+
+// The asset from its own file only
+int asset_open_loose(const char* name, struct asset_view_t* view) {
+    memset(view, 0, sizeof(struct asset_view_t));
+
+    if (!file_map(name, &view->map)) {
+        return 0;
+    }
+    view->data = view->map.data;
+    view->size = view->map.size;
+    return 1;
+}
+
+// A whole asset, from the mounted pack or else the loose file. Any thread can
+// open assets, close every view with asset_close.
+int asset_open(const char* name, struct asset_view_t* view) {
+    return asset_open_packed(name, view) || asset_open_loose(name, view);
+}
+
+void asset_close(struct asset_view_t* view) {
+    // pack views belong to the pack
+    file_unmap(&view->map);
+    view->data = NULL;
+    view->size = 0;
+}
@@ -0,0 +1,160 @@
+#include "doom.h"
+
+// Chunked pool of fixed size items
+//
+// Items live in chunks of 2^n slots that are never moved or freed while the
+// pool is alive, so growing the pool keeps every pointer into it valid. Released
+// slots go on a free list and are handed out again before the pool grows. Every
+// slot has an alive flag, loops walk the slots below slot_count and skip the
+// dead ones with pool_get.
+//
+// The soft budget is only a warning: allocating past it still works, it tells
+// you the expected size for the content was wrong.
+
+void pool_init(struct pool_t* pool, const char* name, size_t item_size, size_t chunk_items, size_t soft_budget) {
+    memset(pool, 0, sizeof(struct pool_t));
+
+    pool->name = name;
+    pool->item_size = item_size;
+    pool->soft_budget = soft_budget;
+
+    // power of two, so a slot is found with a shift and a mask
+    pool->chunk_shift = 0;
+    while (((size_t)1 << pool->chunk_shift) < chunk_items) {
+        pool->chunk_shift++;
+    }
+}
+
+void pool_destroy(struct pool_t* pool) {
+    for(size_t i = 0;i < pool->chunk_count;i++) {
+        free(pool->chunks[i]);
+        free(pool->alive[i]);
+    }
+    free(pool->chunks);
+    free(pool->alive);
+    free(pool->free_slots);
+    memset(pool, 0, sizeof(struct pool_t));
+}
+
+// Releases every item, the chunks stay allocated for reuse
+void pool_clear(struct pool_t* pool) {
+    size_t chunk_items = (size_t)1 << pool->chunk_shift;
+    for(size_t i = 0;i < pool->chunk_count;i++) {
+        memset(pool->alive[i], 0, chunk_items);
+    }
+
+    pool->slot_count = 0;
+    pool->count = 0;
+    pool->free_count = 0;
+}
+
+int pool_grow(struct pool_t* pool) {
+    size_t chunk_items = (size_t)1 << pool->chunk_shift;
+
+    if (pool->chunk_count == pool->chunk_capacity) {
+        size_t capacity = pool->chunk_capacity ? pool->chunk_capacity * 2 : 8;
+
+        // only the chunk tables move, never the chunks
+        unsigned char** chunks = realloc(pool->chunks, sizeof(unsigned char*) * capacity);
+        if (!chunks) {
+            return 0;
+        }
+        pool->chunks = chunks;
+
+        unsigned char** alive = realloc(pool->alive, sizeof(unsigned char*) * capacity);
+        if (!alive) {
+            return 0;
+        }
+        pool->alive = alive;
+
+        pool->chunk_capacity = capacity;
+    }
+
+    unsigned char* chunk = malloc(pool->item_size * chunk_items);
+    unsigned char* alive = calloc(chunk_items, 1);
+    if (!chunk || !alive) {
+        free(chunk);
+        free(alive);
+        return 0;
+    }
+
+    pool->chunks[pool->chunk_count] = chunk;
+    pool->alive[pool->chunk_count] = alive;
+    pool->chunk_count++;
+
+    return 1;
+}
+
+// Returns a zeroed item, or 0 when out of memory
+void* pool_alloc(struct pool_t* pool) {
+    size_t slot;
+
+    if (pool->free_count > 0) {
+        pool->free_count--;
+        slot = pool->free_slots[pool->free_count];
+    } else {
+        slot = pool->slot_count;
+
+        if ((slot >> pool->chunk_shift) >= pool->chunk_count && !pool_grow(pool)) {
+            log_info2("Out of memory for pool", pool->name);
+            return 0;
+        }
+        pool->slot_count++;
+    }
+
+    size_t chunk = slot >> pool->chunk_shift;
+    size_t index = slot & (((size_t)1 << pool->chunk_shift) - 1);
+
+    pool->alive[chunk][index] = 1;
+    pool->count++;
+
+    if (pool->count > pool->high_water) {
+        pool->high_water = pool->count;
+
+        // once, the first time it happens
+        if (pool->soft_budget && pool->high_water == pool->soft_budget + 1) {
+            printf("WARNING: pool %s is over its budget of %zu items\n", pool->name, pool->soft_budget);
+        }
+    }
+
+    void* item = pool->chunks[chunk] + index * pool->item_size;
+    memset(item, 0, pool->item_size);
+
+    return item;
+}
+
+void pool_release(struct pool_t* pool, size_t slot) {
+    size_t chunk = slot >> pool->chunk_shift;
+    size_t index = slot & (((size_t)1 << pool->chunk_shift) - 1);
+
+    assert(slot < pool->slot_count && pool->alive[chunk][index]);
+
+    if (pool->free_count == pool->free_capacity) {
+        pool->free_capacity = pool->free_capacity ? pool->free_capacity * 2 : 64;
+        pool->free_slots = realloc(pool->free_slots, sizeof(size_t) * pool->free_capacity);
+    }
+
+    pool->alive[chunk][index] = 0;
+    pool->free_slots[pool->free_count] = slot;
+    pool->free_count++;
+    pool->count--;
+}
+
+// The item in the slot, 0 for a free slot
+void* pool_get(struct pool_t* pool, size_t slot) {
+    size_t chunk = slot >> pool->chunk_shift;
+    size_t index = slot & (((size_t)1 << pool->chunk_shift) - 1);
+
+    if (slot >= pool->slot_count || !pool->alive[chunk][index]) {
+        return 0;
+    }
+    return pool->chunks[chunk] + index * pool->item_size;
+}
+
+void pool_report(struct pool_t* pool) {
+    size_t chunk_items = (size_t)1 << pool->chunk_shift;
+    size_t bytes = pool->chunk_count * chunk_items * (pool->item_size + 1);
+
+    printf("pool %s: %zu live, high water %zu, budget %zu, %zu chunks (%zu KB)\n",
+           pool->name, pool->count, pool->high_water, pool->soft_budget, pool->chunk_count, bytes / 1024);
+}
@@ -0,0 +1,257 @@
+#include "doom.h"
+
+// Scoped timing zones, see PROFILE_BEGIN/PROFILE_END in doom.h
+//
+// Every thread writes finished zones into its own ring, so recording takes
+// no locks: the owning thread is the only writer and publishes its write
+// position after the zone is stored. A dump reads all the rings and writes
+// the zones of the last N frames as Chrome trace events ("X" complete events,
+// microseconds), which chrome://tracing, Perfetto or Speedscope can open.
+//
+// A dump while other threads are recording can see a few of their zones
+// being overwritten, that's accepted for a debug tool.
+
+#ifdef DOOM_PROFILE
+
+#ifdef _WIN32
+#include <windows.h>
+#define PROFILE_THREAD_LOCAL __declspec(thread)
+#else
+#define PROFILE_THREAD_LOCAL _Thread_local
+#endif
+
+#define PROFILE_RING_SIZE (1 << 16) // zones per thread, power of two
+#define PROFILE_MAX_DEPTH 64
+#define PROFILE_MAX_THREADS 64
+#define PROFILE_MAX_FRAMES 1024
+
+struct profile_zone_t {
+    const char* name;
+    double start;
+    double duration; // the value for counters
+    int counter;
+};
+
+struct profile_ring_t {
+    struct profile_zone_t zones[PROFILE_RING_SIZE];
+    volatile unsigned int write; // zones written so far, wraps
+    char name[32];
+
+    // open zones of this thread
+    const char* stack_names[PROFILE_MAX_DEPTH];
+    double stack_starts[PROFILE_MAX_DEPTH];
+    int depth;
+};
+
+struct profile_ring_t* profile_rings[PROFILE_MAX_THREADS];
+volatile int profile_ring_count = 0;
+
+PROFILE_THREAD_LOCAL struct profile_ring_t* profile_thread_ring = 0;
+PROFILE_THREAD_LOCAL int profile_thread_index = -1;
+
+// start times of the recent frames (main thread only)
+double profile_frame_starts[PROFILE_MAX_FRAMES];
+unsigned int profile_frame_count = 0;
+
+double profile_epoch = 0.0; // trace time zero, when the first thread started recording
+
+int profile_atomic_inc(volatile int* value) {
+#ifdef _WIN32
+    return InterlockedIncrement((volatile LONG*)value) - 1;
+#else
+    return __atomic_fetch_add(value, 1, __ATOMIC_ACQ_REL);
+#endif
+}
+
+void profile_publish(volatile unsigned int* write, unsigned int value) {
+#ifdef _WIN32
+    MemoryBarrier();
+    *write = value;
+#else
+    __atomic_store_n(write, value, __ATOMIC_RELEASE);
+#endif
+}
+
+unsigned int profile_acquire(volatile unsigned int* write) {
+#ifdef _WIN32
+    unsigned int value = *write;
+    MemoryBarrier();
+    return value;
+#else
+    return __atomic_load_n(write, __ATOMIC_ACQUIRE);
+#endif
+}
+
+struct profile_ring_t* profile_ring() {
+    if (profile_thread_ring) {
+        return profile_thread_ring;
+    }
+
+    int index = profile_atomic_inc(&profile_ring_count);
+    if (index >= PROFILE_MAX_THREADS) {
+        return 0;
+    }
+
+    if (index == 0) {
+        profile_epoch = timer_now();
+    }
+
+    struct profile_ring_t* ring = malloc(sizeof(struct profile_ring_t));
+    memset(ring, 0, sizeof(struct profile_ring_t));
+    snprintf(ring->name, sizeof(ring->name), index == 0 ? "main" : "thread %d", index);
+
+    profile_thread_ring = ring;
+    profile_thread_index = index;
+    profile_rings[index] = ring;
+
+    return ring;
+}
+
+void profile_thread_name(const char* name) {
+    struct profile_ring_t* ring = profile_ring();
+    if (ring) {
+        snprintf(ring->name, sizeof(ring->name), "%s", name);
+    }
+}
+
+void profile_begin(const char* name) {
+    struct profile_ring_t* ring = profile_ring();
+    if (!ring || ring->depth >= PROFILE_MAX_DEPTH) {
+        return;
+    }
+
+    ring->stack_names[ring->depth] = name;
+    ring->stack_starts[ring->depth] = timer_now();
+    ring->depth++;
+}
+
+void profile_end() {
+    double end = timer_now();
+
+    struct profile_ring_t* ring = profile_thread_ring;
+    if (!ring || ring->depth == 0) {
+        return;
+    }
+    ring->depth--;
+
+    unsigned int write = ring->write;
+    struct profile_zone_t* zone = &ring->zones[write & (PROFILE_RING_SIZE - 1)];
+
+    zone->name = ring->stack_names[ring->depth];
+    zone->start = ring->stack_starts[ring->depth];
+    zone->duration = end - zone->start;
+    zone->counter = 0;
+
+    profile_publish(&ring->write, write + 1);
+}
+
+// A value sampled over time (GPU pass times for example), shown as a graph
+void profile_counter(const char* name, double value) {
+    struct profile_ring_t* ring = profile_ring();
+    if (!ring) {
+        return;
+    }
+
+    unsigned int write = ring->write;
+    struct profile_zone_t* zone = &ring->zones[write & (PROFILE_RING_SIZE - 1)];
+
+    zone->name = name;
+    zone->start = timer_now();
+    zone->duration = value;
+    zone->counter = 1;
+
+    profile_publish(&ring->write, write + 1);
+}
+
+void profile_frame() {
+    double now = timer_now();
+
+    profile_frame_starts[profile_frame_count % PROFILE_MAX_FRAMES] = now;
+    profile_frame_count++;
+}
+
+void profile_json_string(FILE* f, const char* s) {
+    fputc('"', f);
+    for(;*s;s++) {
+        if (*s == '"' || *s == '\\') {
+            fputc('\\', f);
+        }
+        fputc(*s, f);
+    }
+    fputc('"', f);
+}
+
+// Writes the zones of the last frames (up to PROFILE_MAX_FRAMES) as Chrome trace JSON
+int profile_dump(const char* filename, int frames) {
+    FILE* f = fopen(filename, "w");
+    if (!f) {
+        log_info2("Failed to create trace file", filename);
+        return 0;
+    }
+
+    if (frames > PROFILE_MAX_FRAMES - 1) {
+        frames = PROFILE_MAX_FRAMES - 1;
+    }
+
+    // everything that started after the first of the requested frames
+    double window_start = 0.0;
+    if (frames > 0 && profile_frame_count > (unsigned int)frames) {
+        window_start = profile_frame_starts[(profile_frame_count - frames) % PROFILE_MAX_FRAMES];
+    }
+
+    fprintf(f, "{\"traceEvents\":[\n");
+
+    int ring_count = profile_ring_count < PROFILE_MAX_THREADS ? profile_ring_count : PROFILE_MAX_THREADS;
+    size_t zone_count = 0;
+    int first = 1;
+
+    for(int t = 0;t < ring_count;t++) {
+        struct profile_ring_t* ring = profile_rings[t];
+        if (!ring) {
+            continue;
+        }
+
+        fprintf(f, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":", first ? "" : ",\n", t);
+        profile_json_string(f, ring->name);
+        fprintf(f, "}}");
+        first = 0;
+
+        unsigned int write = profile_acquire(&ring->write);
+        unsigned int begin = write > PROFILE_RING_SIZE ? write - PROFILE_RING_SIZE : 0;
+
+        for(unsigned int i = begin;i < write;i++) {
+            struct profile_zone_t* zone = &ring->zones[i & (PROFILE_RING_SIZE - 1)];
+
+            if (zone->start < window_start) {
+                continue;
+            }
+
+            fprintf(f, ",\n{\"name\":");
+            profile_json_string(f, zone->name);
+
+            if (zone->counter) {
+                fprintf(f, ",\"ph\":\"C\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"args\":{\"value\":%f}}", t,
+                        (zone->start - profile_epoch) * 1000000.0, zone->duration);
+            } else {
+                fprintf(f, ",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}", t,
+                        (zone->start - profile_epoch) * 1000000.0, zone->duration * 1000000.0);
+            }
+            zone_count++;
+        }
+    }
+
+    fprintf(f, "\n],\"displayTimeUnit\":\"ms\"}\n");
+    fclose(f);
+
+    printf("Trace saved: %s (%zu zones)\n", filename, zone_count);
+    return 1;
+}
+
+#else
+
+int profile_dump(const char* filename, int frames) {
+    log_info("Built without DOOM_PROFILE, no trace to save");
+    return 0;
+}
+
+#endif
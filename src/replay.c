@@ -0,0 +1,178 @@
+#include <stddef.h>
+#include "doom.h"
+
+// Input recording/replay
+//
+// File layout (little endian):
+//   struct replay_header_t
+//   struct replay_frame_t * frame_count
+//
+// Every frame stores the exact dt handed to game_update and the input state
+// the game saw, so together with the rng seed a replay reproduces the run
+// bit for bit.
+
+#define REPLAY_MAGIC 0x4c505244 // "DRPL"
+#define REPLAY_VERSION 2 // 2: the seed goes to game_seed, not srand
+
+struct replay_header_t {
+    unsigned int magic;
+    unsigned int version;
+    unsigned int seed;
+    int width, height;
+    unsigned int frame_count;
+};
+
+struct replay_frame_t {
+    float dt;
+    float mouse_x, mouse_y;
+    unsigned char keys;
+    unsigned char buttons;
+    unsigned char events;
+    unsigned char pad;
+};
+
+struct replay_t* replay_record_begin(const char* filename, unsigned int seed, int width, int height) {
+    FILE* file = fopen(filename, "wb");
+    if (!file) {
+        log_info2("Failed to create replay file", filename);
+        return NULL;
+    }
+
+    struct replay_t* replay = malloc(sizeof(struct replay_t));
+    memset(replay, 0, sizeof(struct replay_t));
+
+    replay->file = file;
+    replay->recording = 1;
+    replay->seed = seed;
+    replay->width = width;
+    replay->height = height;
+
+    // frame count gets patched in by replay_close
+    struct replay_header_t header = {REPLAY_MAGIC, REPLAY_VERSION, seed, width, height, 0};
+    fwrite(&header, sizeof(header), 1, file);
+
+    return replay;
+}
+
+void replay_record_frame(struct replay_t* replay, float dt, struct input_state_t* input) {
+    struct replay_frame_t frame;
+
+    frame.dt = dt;
+    frame.mouse_x = input->mouse_x;
+    frame.mouse_y = input->mouse_y;
+    frame.keys = input->keys;
+    frame.buttons = input->buttons;
+    frame.events = input->events;
+    frame.pad = 0;
+
+    fwrite(&frame, sizeof(frame), 1, replay->file);
+    replay->frame_count++;
+}
+
+struct replay_t* replay_load(const char* filename) {
+    FILE* file = fopen(filename, "rb");
+    if (!file) {
+        log_info2("Failed to open replay file", filename);
+        return NULL;
+    }
+
+    struct replay_header_t header;
+    if (fread(&header, sizeof(header), 1, file) != 1 ||
+        header.magic != REPLAY_MAGIC || header.version != REPLAY_VERSION) {
+        log_info2("Not a valid replay file", filename);
+        fclose(file);
+        return NULL;
+    }
+
+    struct replay_t* replay = malloc(sizeof(struct replay_t));
+    memset(replay, 0, sizeof(struct replay_t));
+
+    replay->seed = header.seed;
+    replay->width = header.width;
+    replay->height = header.height;
+    replay->frame_count = header.frame_count;
+    replay->frames = malloc(sizeof(struct replay_frame_t) * (header.frame_count + 1));
+
+    size_t read_count = fread(replay->frames, sizeof(struct replay_frame_t), header.frame_count, file);
+    fclose(file);
+
+    if (read_count != header.frame_count) {
+        log_error("Replay file is truncated");
+        replay->frame_count = read_count;
+    }
+
+    printf("Replay loaded: %u frames, seed %u\n", replay->frame_count, replay->seed);
+    return replay;
+}
+
+// returns 0 once all the frames are played
+int replay_next_frame(struct replay_t* replay, float* dt, struct input_state_t* input) {
+    if (replay->frame_index >= replay->frame_count) {
+        return 0;
+    }
+
+    struct replay_frame_t* frame = &replay->frames[replay->frame_index];
+    replay->frame_index++;
+
+    *dt = frame->dt;
+    input->mouse_x = frame->mouse_x;
+    input->mouse_y = frame->mouse_y;
+    input->keys = frame->keys;
+    input->buttons = frame->buttons;
+    input->events = frame->events;
+
+    return 1;
+}
+
+void replay_close(struct replay_t* replay) {
+    if (replay->recording) {
+        fseek(replay->file, offsetof(struct replay_header_t, frame_count), SEEK_SET);
+        fwrite(&replay->frame_count, sizeof(unsigned int), 1, replay->file);
+        fclose(replay->file);
+
+        printf("Replay saved: %u frames\n", replay->frame_count);
+    }
+    free(replay->frames);
+    free(replay);
+}
+
+int float_compare(const void* a, const void* b) {
+    float fa = *(const float*)a;
+    float fb = *(const float*)b;
+    return (fa > fb) - (fa < fb);
+}
+
+// Frame time statistics, so two runs of the same replay can be compared
+void frame_times_report(float* times_ms, size_t count, const char* csv_filename) {
+    if (count == 0) {
+        return;
+    }
+
+    if (csv_filename) {
+        FILE* csv = fopen(csv_filename, "w");
+        if (csv) {
+            fprintf(csv, "frame,ms\n");
+            for(size_t i = 0;i < count;i++) {
+                fprintf(csv, "%zu,%f\n", i, times_ms[i]);
+            }
+            fclose(csv);
+        }
+    }
+
+    float* sorted = malloc(sizeof(float) * count);
+    memcpy(sorted, times_ms, sizeof(float) * count);
+    qsort(sorted, count, sizeof(float), float_compare);
+
+    double total = 0.0;
+    for(size_t i = 0;i < count;i++) {
+        total += sorted[i];
+    }
+
+    printf("frames: %zu, total %.3f ms\n", count, total);
+    printf("frame ms: min %.3f, avg %.3f, p50 %.3f, p95 %.3f, p99 %.3f, max %.3f\n",
+           sorted[0], total / count,
+           sorted[count / 2], sorted[(size_t)(count * 0.95)], sorted[(size_t)(count * 0.99)],
+           sorted[count - 1]);
+
+    free(sorted);
+}
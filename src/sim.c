@@ -0,0 +1,303 @@
+#include "game.h"
+
+// doom_sim: runs the gameplay update loop with no window and no GL context,
+// the input comes from a small scripted bot instead of a player.
+//
+//   doom_sim [--ticks N] [--dt SECONDS] [--horde N] [--seed N] [--threads N] [--trace FILE]
+//   doom_sim --record FILE [--ticks N] [--dt SECONDS] [--seed N]
+//   doom_sim --replay FILE [--frame-times CSV] [--threads N]
+//   doom_sim --bench-obj TRIANGLES
+//   doom_sim --bench-collision COUNT
+//   doom_sim --bench-demons COUNT
+//   doom_sim --bench-rng COUNT
+//   doom_sim --bench-math COUNT
+//   doom_sim --bench-boxes COUNT
+//   doom_sim --pack OUT FILE...
+//   doom_sim --bench-pack PACK
+//
+// Plain runs start playing right away and restart when the player dies.
+// Recordings start from the main menu like the game does, so they can be
+// replayed by the game as well (--horde is ignored when recording).
+// --trace saves the profiler zones of the last ticks as Chrome trace JSON
+// (profiling builds only). --threads sets the threads of the job system, one
+// per core by default; the results are the same for any count.
+// --pack writes the files into an asset pack, the game loads from
+// ./assets.pak when it finds one (run it from the game directory with the
+// paths the game uses, cooked caches like floor2.png.tex and main.obj.mesh
+// included).
+
+void platform_capture_cursor(int capture) {
+    // no cursor without a window
+}
+
+// Walks forward, strafes left/right, turns and keeps shooting (the pistol
+// while it has ammo, see sim_start_round).
+// On the menu/score screens it clicks through to a new game.
+void sim_bot_input(struct input_state_t* input, long tick) {
+    static int last_state = 0;
+
+    input->keys = 0;
+    input->buttons = 0;
+    input->events = 0;
+
+    if (game->state == GAME_STATE_MENU || game->state == GAME_STATE_SCORE) {
+        // "play" on the main menu, "main menu" on the score board
+        int item = game->state == GAME_STATE_MENU ? 0 : 1;
+        game_menu_item_center(item, &input->mouse_x, &input->mouse_y);
+
+        // hovering since the last tick, so the item is highlighted now
+        if (last_state == game->state) {
+            input->events |= INPUT_EVENT_CLICK;
+        }
+        last_state = game->state;
+        return;
+    }
+    last_state = game->state;
+
+    input->keys = INPUT_KEY_W;
+
+    if ((tick / 120) % 2) {
+        input->keys |= INPUT_KEY_A;
+    } else {
+        input->keys |= INPUT_KEY_D;
+    }
+
+    // press and release so every shot is a new click
+    if ((tick % 10) < 5) {
+        input->buttons |= INPUT_BUTTON_LEFT;
+    }
+
+    // turns while strafing one way and holds the aim the other way, turning
+    // all the time the shots spread too thin to kill anything
+    if ((tick / 120) % 2) {
+        input->mouse_x += 3.0f;
+    }
+    input->mouse_y = 360.0f;
+}
+
+// Shots the bot starts every round with, it punches once they are gone
+#define SIM_BOT_AMMO 200
+
+void sim_start_round(int horde) {
+    game_reset();
+    game->state = GAME_STATE_PLAYING;
+
+    // armed, so the runs go through the projectiles, their hits and the drops
+    game->player_ammo = SIM_BOT_AMMO;
+    player_switch_weapon(WEAPON_PISTOL);
+
+    for(int i = 0;i < horde;i++) {
+        game_spawn_demon(rng_float(&game->rng_spawn, -20, 20), 0.0f, rng_float(&game->rng_spawn, -20, 20));
+    }
+}
+
+int main(int argc, char** argv) {
+    long ticks = 10000;
+    float dt = GAME_TICK_DT;
+    int horde = 0;
+    int threads = 0;
+    unsigned int seed = 1;
+    const char* record_filename = 0;
+    const char* replay_filename = 0;
+    const char* frame_times_filename = 0;
+    const char* trace_filename = 0;
+
+    for(int i = 1;i < argc;i++) {
+        if (strequal(argv[i], "--ticks") && i + 1 < argc) {
+            ticks = atol(argv[++i]);
+        } else if (strequal(argv[i], "--dt") && i + 1 < argc) {
+            dt = atof(argv[++i]);
+        } else if (strequal(argv[i], "--horde") && i + 1 < argc) {
+            horde = atoi(argv[++i]);
+        } else if (strequal(argv[i], "--threads") && i + 1 < argc) {
+            threads = atoi(argv[++i]);
+        } else if (strequal(argv[i], "--seed") && i + 1 < argc) {
+            seed = atoi(argv[++i]);
+        } else if (strequal(argv[i], "--record") && i + 1 < argc) {
+            record_filename = argv[++i];
+        } else if (strequal(argv[i], "--replay") && i + 1 < argc) {
+            replay_filename = argv[++i];
+        } else if (strequal(argv[i], "--frame-times") && i + 1 < argc) {
+            frame_times_filename = argv[++i];
+        } else if (strequal(argv[i], "--trace") && i + 1 < argc) {
+            trace_filename = argv[++i];
+        } else if (strequal(argv[i], "--bench-obj") && i + 1 < argc) {
+            bench_obj_load(atoi(argv[++i]));
+            return 0;
+        } else if (strequal(argv[i], "--bench-collision") && i + 1 < argc) {
+            bench_collision(atoi(argv[++i]));
+            return 0;
+        } else if (strequal(argv[i], "--bench-demons") && i + 1 < argc) {
+            bench_demons(atoi(argv[++i]));
+            return 0;
+        } else if (strequal(argv[i], "--bench-rng") && i + 1 < argc) {
+            bench_rng(atoi(argv[++i]));
+            return 0;
+        } else if (strequal(argv[i], "--bench-math") && i + 1 < argc) {
+            bench_math(atoi(argv[++i]));
+            return 0;
+        } else if (strequal(argv[i], "--bench-boxes") && i + 1 < argc) {
+            bench_boxes(atoi(argv[++i]));
+            return 0;
+        } else if (strequal(argv[i], "--pack") && i + 1 < argc) {
+            return pack_write(argv[i + 1], (const char**)&argv[i + 2], NULL, argc - i - 2) ? 0 : -1;
+        } else if (strequal(argv[i], "--bench-pack") && i + 1 < argc) {
+            bench_pack(argv[++i]);
+            return 0;
+        } else {
+            printf("usage: %s [--ticks N] [--dt SECONDS] [--horde N] [--seed N] [--threads N] [--trace FILE]\n", argv[0]);
+            printf("       %s --record FILE [--ticks N] [--dt SECONDS] [--seed N]\n", argv[0]);
+            printf("       %s --replay FILE [--frame-times CSV] [--threads N]\n", argv[0]);
+            printf("       %s --bench-obj TRIANGLES\n", argv[0]);
+            printf("       %s --bench-collision COUNT\n", argv[0]);
+            printf("       %s --bench-demons COUNT\n", argv[0]);
+            printf("       %s --bench-rng COUNT\n", argv[0]);
+            printf("       %s --bench-math COUNT\n", argv[0]);
+            printf("       %s --bench-boxes COUNT\n", argv[0]);
+            printf("       %s --pack OUT FILE...\n", argv[0]);
+            printf("       %s --bench-pack PACK\n", argv[0]);
+            return -1;
+        }
+    }
+
+    struct replay_t* replay = 0;
+    int width = 1280;
+    int height = 720;
+
+    if (replay_filename) {
+        replay = replay_load(replay_filename);
+        if (!replay) {
+            return -1;
+        }
+        seed = replay->seed;
+        width = replay->width;
+        height = replay->height;
+        ticks = replay->frame_count;
+    }
+
+    jobs_init(threads);
+    game_init(width, height);
+    game_seed(seed);
+
+    // a horde that size is expected, only warn past it
+    if (horde > game->demons.soft_budget) {
+        game->demons.soft_budget = horde;
+    }
+
+    // menus need the real texture sizes to lay out like the game
+    game_load_textures(0);
+    game_load_sprites(0);
+
+    if (record_filename) {
+        replay = replay_record_begin(record_filename, seed, width, height);
+        if (!replay) {
+            return -1;
+        }
+    }
+
+    if (!replay) {
+        sim_start_round(horde);
+    }
+
+    float* tick_times = 0;
+    if (replay && !replay->recording) {
+        tick_times = malloc(sizeof(float) * (ticks + 1));
+    }
+
+    int rounds = 1;
+    size_t max_demons = 0;
+    size_t max_projectiles = 0;
+    long total_kills = 0;
+
+    double start_time = timer_now();
+
+    long tick;
+    for(tick = 0;tick < ticks;tick++) {
+        PROFILE_FRAME();
+
+        double tick_start = timer_now();
+        float tick_dt = dt;
+
+        if (replay && !replay->recording) {
+            if (!replay_next_frame(replay, &tick_dt, &game->input)) {
+                break;
+            }
+        } else {
+            sim_bot_input(&game->input, tick);
+        }
+
+        if (replay && replay->recording) {
+            replay_record_frame(replay, tick_dt, &game->input);
+        }
+
+        int kills = game->player_kill_count;
+
+        game_update(tick_dt);
+
+        if (game->player_kill_count < kills) {
+            // a new game was started
+            total_kills += kills;
+        }
+
+        if (game->demons.count > max_demons) {
+            max_demons = game->demons.count;
+        }
+        if (game->player_projectiles.count > max_projectiles) {
+            max_projectiles = game->player_projectiles.count;
+        }
+
+        // the player died, start over right away
+        if (!replay && game->state == GAME_STATE_SCORE) {
+            total_kills += game->player_kill_count;
+            sim_start_round(horde);
+            rounds++;
+        }
+
+        if (tick_times) {
+            tick_times[tick] = (timer_now() - tick_start) * 1000.0;
+        }
+
+        if (game->quit) {
+            tick++;
+            break;
+        }
+    }
+
+    double elapsed = timer_now() - start_time;
+
+    total_kills += game->player_kill_count;
+
+    printf("ticks: %ld (dt %f)\n", tick, dt);
+    printf("time: %.3f s, %.0f ticks/s, %.3f us/tick\n", elapsed, tick / elapsed, (elapsed * 1000000.0) / tick);
+    if (!replay) {
+        printf("rounds: %d, kills: %ld\n", rounds, total_kills);
+    } else {
+        printf("kills: %ld\n", total_kills);
+    }
+    printf("peak demons: %zu, peak projectiles: %zu\n", max_demons, max_projectiles);
+
+    demon_store_report(&game->demons);
+    pool_report(&game->player_projectiles);
+    pool_report(&game->animated_effects);
+    pool_report(&game->pickup_objects);
+
+    if (replay) {
+        if (tick_times) {
+            frame_times_report(tick_times, tick, frame_times_filename);
+            free(tick_times);
+        }
+        printf("state checksum: %08x\n", game_state_checksum());
+        replay_close(replay);
+    }
+
+    if (trace_filename) {
+        profile_dump(trace_filename, 300);
+    }
+
+    game_free_sprites();
+    // only the sizes were read, there is no texture to delete
+    atlas_free(&game->hud_atlas);
+    game_shutdown();
+    jobs_shutdown();
+    return 0;
+}
@@ -0,0 +1,195 @@
+#include "doom.h"
+
+// Uniform spatial hash over the arena floor (x/z), rebuilt from scratch
+//
+// Every item lives in the one cell under the center of its box, the items
+// are counting sorted by bucket so a bucket is a contiguous run. Queries grow
+// the query box by the largest half extent seen while building, which finds
+// every box that can overlap it without inserting items into several cells.
+
+unsigned int spatial_hash_bucket(struct spatial_hash_t* hash, int cell_x, int cell_z) {
+    unsigned int h = ((unsigned int)cell_x * 73856093u) ^ ((unsigned int)cell_z * 19349663u);
+    return h & (hash->bucket_count - 1);
+}
+
+int spatial_hash_cell(struct spatial_hash_t* hash, float v) {
+    return (int)floorf(v * hash->inv_cell_size);
+}
+
+void spatial_hash_init(struct spatial_hash_t* hash, float cell_size) {
+    memset(hash, 0, sizeof(struct spatial_hash_t));
+    hash->cell_size = cell_size;
+    hash->inv_cell_size = 1.0f / cell_size;
+}
+
+void spatial_hash_free(struct spatial_hash_t* hash) {
+    free(hash->bucket_start);
+    free(hash->items);
+    free(hash->scratch);
+    free(hash->results);
+    memset(hash, 0, sizeof(struct spatial_hash_t));
+}
+
+// Building is spatial_hash_begin, a spatial_hash_insert for every box in
+// ascending index order, then spatial_hash_end. max_count bounds the inserts.
+void spatial_hash_begin(struct spatial_hash_t* hash, size_t max_count) {
+    // about two buckets per item keeps the runs short
+    unsigned int bucket_count = 64;
+    while (bucket_count < max_count * 2) {
+        bucket_count *= 2;
+    }
+
+    if (bucket_count != hash->bucket_count) {
+        hash->bucket_count = bucket_count;
+        hash->bucket_start = realloc(hash->bucket_start, sizeof(unsigned int) * (bucket_count + 1));
+    }
+
+    if (max_count > hash->item_capacity) {
+        hash->item_capacity = max_count;
+        hash->items = realloc(hash->items, sizeof(struct spatial_item_t) * max_count);
+        hash->scratch = realloc(hash->scratch, sizeof(struct spatial_item_t) * max_count);
+    }
+
+    hash->item_count = 0;
+    hash->max_half_x = 0.0f;
+    hash->max_half_z = 0.0f;
+
+    memset(hash->bucket_start, 0, sizeof(unsigned int) * (bucket_count + 1));
+}
+
+// Bins the box by its center
+void spatial_hash_insert(struct spatial_hash_t* hash, struct aabb_t* box, unsigned int index) {
+    assert(hash->item_count < hash->item_capacity);
+
+    float half_x = (box->max.x - box->min.x) * 0.5f;
+    float half_z = (box->max.z - box->min.z) * 0.5f;
+
+    hash->max_half_x = fmaxf(hash->max_half_x, half_x);
+    hash->max_half_z = fmaxf(hash->max_half_z, half_z);
+
+    struct spatial_item_t* item = &hash->scratch[hash->item_count];
+    item->cell_x = spatial_hash_cell(hash, box->min.x + half_x);
+    item->cell_z = spatial_hash_cell(hash, box->min.z + half_z);
+    item->index = index;
+
+    hash->bucket_start[spatial_hash_bucket(hash, item->cell_x, item->cell_z) + 1]++;
+    hash->item_count++;
+}
+
+void spatial_hash_end(struct spatial_hash_t* hash) {
+    unsigned int bucket_count = hash->bucket_count;
+    size_t count = hash->item_count;
+
+    for(unsigned int b = 0;b < bucket_count;b++) {
+        hash->bucket_start[b + 1] += hash->bucket_start[b];
+    }
+
+    // scatter, items keep their index order inside a bucket
+    for(size_t i = 0;i < count;i++) {
+        struct spatial_item_t* item = &hash->scratch[i];
+        unsigned int b = spatial_hash_bucket(hash, item->cell_x, item->cell_z);
+
+        // bucket_start[b] is used as the write cursor and ends up at the next bucket's start
+        hash->items[hash->bucket_start[b]] = *item;
+        hash->bucket_start[b]++;
+    }
+
+    // shift the cursors back to the bucket starts
+    for(unsigned int b = bucket_count;b > 0;b--) {
+        hash->bucket_start[b] = hash->bucket_start[b - 1];
+    }
+    hash->bucket_start[0] = 0;
+}
+
+// boxes is an array of count boxes, stride bytes apart (so it can point into an entity array)
+void spatial_hash_build(struct spatial_hash_t* hash, struct aabb_t* boxes, size_t count, size_t stride) {
+    spatial_hash_begin(hash, count);
+
+    unsigned char* p = (unsigned char*)boxes;
+    for(size_t i = 0;i < count;i++) {
+        spatial_hash_insert(hash, (struct aabb_t*)(p + i * stride), i);
+    }
+
+    spatial_hash_end(hash);
+}
+
+void spatial_hash_add_result(unsigned int** results, size_t* count, size_t* capacity, unsigned int index) {
+    if (*count == *capacity) {
+        *capacity = *capacity ? *capacity * 2 : 64;
+        *results = realloc(*results, sizeof(unsigned int) * *capacity);
+    }
+    (*results)[*count] = index;
+    (*count)++;
+}
+
+int spatial_index_compare(const void* a, const void* b) {
+    unsigned int ia = *(const unsigned int*)a;
+    unsigned int ib = *(const unsigned int*)b;
+    return (ia > ib) - (ia < ib);
+}
+
+// Collects the index of every item whose box may overlap the query box into
+// results (grown with realloc), sorted ascending. Callers still do the exact test.
+// Only reads the grid, so threads can query it at the same time with their own buffers.
+size_t spatial_hash_query_into(struct spatial_hash_t* hash, struct aabb_t* box, unsigned int** results, size_t* capacity) {
+    size_t count = 0;
+
+    if (hash->item_count == 0) {
+        return 0;
+    }
+
+    int x0 = spatial_hash_cell(hash, box->min.x - hash->max_half_x);
+    int x1 = spatial_hash_cell(hash, box->max.x + hash->max_half_x);
+    int z0 = spatial_hash_cell(hash, box->min.z - hash->max_half_z);
+    int z1 = spatial_hash_cell(hash, box->max.z + hash->max_half_z);
+
+    double cells = (double)(x1 - x0 + 1) * (double)(z1 - z0 + 1);
+
+    if (cells > hash->bucket_count) {
+        // the query covers more cells than there are buckets, walk the items in index order
+        for(size_t i = 0;i < hash->item_count;i++) {
+            struct spatial_item_t* item = &hash->scratch[i];
+            if (item->cell_x >= x0 && item->cell_x <= x1 && item->cell_z >= z0 && item->cell_z <= z1) {
+                spatial_hash_add_result(results, &count, capacity, item->index);
+            }
+        }
+    } else {
+        for(int z = z0;z <= z1;z++) {
+            for(int x = x0;x <= x1;x++) {
+                unsigned int b = spatial_hash_bucket(hash, x, z);
+
+                for(unsigned int i = hash->bucket_start[b];i < hash->bucket_start[b + 1];i++) {
+                    struct spatial_item_t* item = &hash->items[i];
+                    // other cells can share the bucket
+                    if (item->cell_x == x && item->cell_z == z) {
+                        spatial_hash_add_result(results, &count, capacity, item->index);
+                    }
+                }
+            }
+        }
+    }
+
+    // cells are visited one after another, so the indices only need sorting across cells
+    unsigned int* sorted = *results;
+    if (count > 32) {
+        qsort(sorted, count, sizeof(unsigned int), spatial_index_compare);
+    } else {
+        for(size_t i = 1;i < count;i++) {
+            unsigned int v = sorted[i];
+            size_t j = i;
+            while (j > 0 && sorted[j - 1] > v) {
+                sorted[j] = sorted[j - 1];
+                j--;
+            }
+            sorted[j] = v;
+        }
+    }
+
+    return count;
+}
+
+// spatial_hash_query_into the grid's own results buffer
+size_t spatial_hash_query(struct spatial_hash_t* hash, struct aabb_t* box) {
+    hash->result_count = spatial_hash_query_into(hash, box, &hash->results, &hash->result_capacity);
+    return hash->result_count;
+}
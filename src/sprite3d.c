@@ -1,37 +1,23 @@
+#include <stddef.h>
 #include "doom.h"
 
-struct sprite3d_t* sprite3d_new(const char* filename, float scale_w, float scale_h) {
-    struct sprite3d_t* sprite = malloc(sizeof(struct sprite3d_t));
-    texture_load(&sprite->texture, filename);
-
+// build axis-aligned bounding box of the (camera facing) quad
+void sprite3d_init_bounds(struct sprite3d_t* sprite, float scale_w, float scale_h) {
     sprite->scale_w = scale_w;
     sprite->scale_h = scale_h;
 
-    sprite->frame_w = sprite->texture.width;
-    sprite->frame_h = sprite->texture.height;
-
     float half_w = scale_w / 2.0f;
 
-    // very small z value added only for a proper bounding box intersection
-    struct vertex_t quad_varray[] = {
-        {.pos = {-half_w,  scale_h, 0.0f}, .uv = {0.0f, -1.0f}},
-        {.pos = {-half_w,  0, 0.0f}, .uv = {0.0f, 0.0f}},
-        {.pos = {half_w,  scale_h, 0.0f}, .uv = {1.0f, -1.0f}},
-        {.pos = {half_w,  0, 0.0f}, .uv = {1.0f, 0.0f}},
+    struct vec3_t corners[] = {
+        {-half_w,  scale_h, 0.0f},
+        {-half_w,  0, 0.0f},
+        {half_w,  scale_h, 0.0f},
+        {half_w,  0, 0.0f},
     };
 
-	unsigned int quad_iarray[] = {
-	    0, 1, 2,
-        1, 3, 2
-	};
-
-	sprite->quad_vbuf = vertex_buffer_new(&quad_varray[0], 4);
-	sprite->quad_ibuf = index_buffer_new(&quad_iarray[0], 6);
-
-	// build axis-aligned bounding box
 	aabb_init(&sprite->local_aabb);
 	for(int i = 0;i < 4;i++) {
-	    struct vec3_t pos_bb = quad_varray[i].pos;
+	    struct vec3_t pos_bb = corners[i];
 	    // z value added only for a proper bounding box intersection
         if (i == 0 || i == 1) {
             pos_bb.z = -half_w;
@@ -40,48 +26,142 @@ struct sprite3d_t* sprite3d_new(const char* filename, float scale_w, float scale
         }
         aabb_extend(&sprite->local_aabb, &pos_bb);
 	}
+}
+
+// The sprite takes over the loaded sprite sheet
+struct sprite3d_t* sprite3d_new(struct texture_t* texture, float scale_w, float scale_h) {
+    struct sprite3d_t* sprite = malloc(sizeof(struct sprite3d_t));
+    sprite->texture = *texture;
+
+    // a single frame until sprite3d_set_frames says otherwise
+    sprite3d_set_frames(sprite, sprite->texture.width, sprite->texture.height);
+
+    float half_w = scale_w / 2.0f;
+
+    // uv covers one frame, sprite3d.vert moves it to the instance's frame
+    struct vertex_t quad_varray[] = {
+        {.pos = {-half_w,  scale_h, 0.0f}, .uv = {0.0f, 0.0f}},
+        {.pos = {-half_w,  0, 0.0f}, .uv = {0.0f, 1.0f}},
+        {.pos = {half_w,  scale_h, 0.0f}, .uv = {1.0f, 0.0f}},
+        {.pos = {half_w,  0, 0.0f}, .uv = {1.0f, 1.0f}},
+    };
+
+	unsigned int quad_iarray[] = {
+	    0, 1, 2,
+        1, 3, 2
+	};
+
+	sprite->quad_vbuf = vertex_buffer_new(&quad_varray[0], 4);
+	sprite->quad_ibuf = index_buffer_new(&quad_iarray[0], 6);
+
+	// per-instance position and frame, advanced once per instance
+	glGenBuffers(1, &sprite->instance_buffer);
+
+	glBindVertexArray(sprite->quad_vbuf->array_object);
+	glBindBuffer(GL_ARRAY_BUFFER, sprite->instance_buffer);
+
+	size_t nSize = sizeof(struct sprite_instance_t);
+
+	glEnableVertexAttribArray(3);
+	glEnableVertexAttribArray(4);
+
+	glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, nSize, (void*)offsetof(struct sprite_instance_t, position));
+	glVertexAttribPointer(4, 1, GL_FLOAT, GL_FALSE, nSize, (void*)offsetof(struct sprite_instance_t, frame));
+
+	glVertexAttribDivisor(3, 1);
+	glVertexAttribDivisor(4, 1);
+
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindVertexArray(0);
+
+	sprite->instances = 0;
+	sprite->instance_count = 0;
+	sprite->instance_capacity = 0;
+
+	sprite3d_init_bounds(sprite, scale_w, scale_h);
 
     return sprite;
 };
 
+// CPU only sprite, no texture or buffers, for running the game without a GL context
+struct sprite3d_t* sprite3d_new_headless(float scale_w, float scale_h) {
+    struct sprite3d_t* sprite = malloc(sizeof(struct sprite3d_t));
+    memset(sprite, 0, sizeof(struct sprite3d_t));
+
+    sprite3d_set_frames(sprite, 1, 1);
+
+    sprite3d_init_bounds(sprite, scale_w, scale_h);
+
+    return sprite;
+}
+
 void sprite3d_delete(struct sprite3d_t* sprite) {
-    index_buffer_delete(sprite->quad_ibuf);
-    vertex_buffer_delete(sprite->quad_vbuf);
-    texture_free(&sprite->texture);
+    if (sprite->quad_vbuf) {
+        glDeleteBuffers(1, &sprite->instance_buffer);
+        index_buffer_delete(sprite->quad_ibuf);
+        vertex_buffer_delete(sprite->quad_vbuf);
+        texture_free(&sprite->texture);
+    }
+    free(sprite->instances);
     free(sprite);
 }
 
-void sprite3d_render(struct sprite3d_t* sprite, float frame) {
+// Splits the texture into frame_w x frame_h frames
+void sprite3d_set_frames(struct sprite3d_t* sprite, int frame_w, int frame_h) {
+    sprite->frame_w = frame_w;
+    sprite->frame_h = frame_h;
 
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, sprite->texture.texture_id);
+    sprite->columns = frame_w > 0 ? sprite->texture.width / frame_w : 0;
+    sprite->rows = frame_h > 0 ? sprite->texture.height / frame_h : 0;
 
-    glBindBuffer(GL_ARRAY_BUFFER, sprite->quad_vbuf->buffer_object);
-    glBindVertexArray(sprite->quad_vbuf->array_object);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sprite->quad_ibuf->buffer_object);
+    if (sprite->columns < 1) {
+        sprite->columns = 1;
+    }
+    if (sprite->rows < 1) {
+        sprite->rows = 1;
+    }
+}
 
-    // update VBO for frames/animation
-    float half_w = sprite->scale_w / 2.0f;
+// Queue one billboard at position, drawn with the rest of its sheet by sprite3d_flush
+void sprite3d_push(struct sprite3d_t* sprite, struct vec3_t* position, float frame) {
+    if (sprite->instance_count == sprite->instance_capacity) {
+        sprite->instance_capacity = sprite->instance_capacity ? sprite->instance_capacity * 2 : 64;
+        sprite->instances = realloc(sprite->instances, sizeof(struct sprite_instance_t) * sprite->instance_capacity);
+    }
 
-    float tw = (float)sprite->frame_w / sprite->texture.width;
-    float th = (float)sprite->frame_h / sprite->texture.height;
-    // TODO: Only row based frames works
-    int numPerRow = sprite->texture.width / sprite->frame_w;
+    struct sprite_instance_t* instance = &sprite->instances[sprite->instance_count];
+    sprite->instance_count++;
 
-    int frame_index = (int)frame;
+    instance->position = *position;
+    instance->frame = frame;
+}
 
-    float tx = (frame_index % numPerRow) * tw;
-    float ty = (frame_index / numPerRow + 1) * th;
+// Draws every queued instance of the sprite with a single instanced draw call
+void sprite3d_flush(struct sprite3d_t* sprite, struct uniform_arena_t* uniforms) {
+    if (sprite->instance_count == 0) {
+        return;
+    }
 
-    struct vertex_t quad_varray[] = {
-        {.pos = {-half_w,  sprite->scale_h, 0.0f},  .uv = {tx, ty - th}},
-        {.pos = {-half_w,  0, 0.0f},                .uv = {tx, ty}},
-        {.pos = {half_w,  sprite->scale_h, 0.0f},   .uv = {tx + tw, ty - th}},
-        {.pos = {half_w,  0, 0.0f},                 .uv = {tx + tw, ty}},
-    };
+    struct cb_sprite_sheet_t sheet;
 
-    glBufferSubData(GL_ARRAY_BUFFER, 0, 4 * sizeof(struct vertex_t), quad_varray);
+    sheet.frame_size.x = (float)sprite->frame_w / sprite->texture.width;
+    sheet.frame_size.y = (float)sprite->frame_h / sprite->texture.height;
+    sheet.columns = sprite->columns;
+    sheet.frame_count = sprite->columns * sprite->rows;
 
-    glDrawElements(GL_TRIANGLES, sprite->quad_ibuf->count, GL_UNSIGNED_INT, 0);
-}
+    uniform_arena_bind(uniforms, 2, &sheet, sizeof(struct cb_sprite_sheet_t));
 
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, sprite->texture.texture_id);
+
+    // re-specifying the whole store orphans the one the previous frame's draw may still read
+    glBindBuffer(GL_ARRAY_BUFFER, sprite->instance_buffer);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(struct sprite_instance_t) * sprite->instance_count, sprite->instances, GL_STREAM_DRAW);
+
+    glBindVertexArray(sprite->quad_vbuf->array_object);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sprite->quad_ibuf->buffer_object);
+
+    glDrawElementsInstanced(GL_TRIANGLES, sprite->quad_ibuf->count, GL_UNSIGNED_INT, 0, sprite->instance_count);
+
+    sprite->instance_count = 0;
+}
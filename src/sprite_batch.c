@@ -0,0 +1,176 @@
+#include "doom.h"
+
+// 2D sprite batch for the HUD and menus
+//
+// Quads are collected for the whole frame and drawn back to front by layer,
+// within a layer they are grouped by texture and opacity so each group is a
+// single draw out of one streamed vertex buffer. Quads pushed with the same
+// layer, texture and opacity keep their push order.
+
+void sprite_batch_build_indices(struct sprite_batch_t* batch, size_t quad_capacity) {
+    unsigned int* indices = malloc(sizeof(unsigned int) * quad_capacity * 6);
+
+    for(size_t i = 0;i < quad_capacity;i++) {
+        unsigned int v = i * 4;
+        unsigned int* quad = &indices[i * 6];
+
+        quad[0] = v + 0;
+        quad[1] = v + 1;
+        quad[2] = v + 2;
+        quad[3] = v + 1;
+        quad[4] = v + 3;
+        quad[5] = v + 2;
+    }
+
+    if (batch->ibuf) {
+        index_buffer_delete(batch->ibuf);
+    }
+    batch->ibuf = index_buffer_new(indices, quad_capacity * 6);
+
+    free(indices);
+}
+
+struct sprite_batch_t* sprite_batch_new(size_t quad_capacity) {
+    struct sprite_batch_t* batch = malloc(sizeof(struct sprite_batch_t));
+    memset(batch, 0, sizeof(struct sprite_batch_t));
+
+    batch->quad_capacity = quad_capacity;
+    batch->quads = malloc(sizeof(struct sprite_batch_quad_t) * quad_capacity);
+    batch->vertices = malloc(sizeof(struct vertex_t) * quad_capacity * 4);
+
+    // contents are streamed in by every flush
+    batch->vbuf = vertex_buffer_new(0, quad_capacity * 4);
+    sprite_batch_build_indices(batch, quad_capacity);
+
+    return batch;
+}
+
+void sprite_batch_delete(struct sprite_batch_t* batch) {
+    index_buffer_delete(batch->ibuf);
+    vertex_buffer_delete(batch->vbuf);
+    free(batch->vertices);
+    free(batch->quads);
+    free(batch);
+}
+
+// uv_rect is the offset (xy) and size (zw) of the quad's part of the texture
+void sprite_batch_push(struct sprite_batch_t* batch, int layer, struct texture_t* tex,
+                       float x, float y, float width, float height, struct vec4_t uv_rect, float opacity) {
+    if (batch->quad_count == batch->quad_capacity) {
+        batch->quad_capacity *= 2;
+        batch->quads = realloc(batch->quads, sizeof(struct sprite_batch_quad_t) * batch->quad_capacity);
+        batch->vertices = realloc(batch->vertices, sizeof(struct vertex_t) * batch->quad_capacity * 4);
+    }
+
+    struct sprite_batch_quad_t* quad = &batch->quads[batch->quad_count];
+
+    quad->layer = layer;
+    quad->texture_id = tex->texture_id;
+    quad->opacity = opacity;
+    quad->order = batch->quad_count;
+    quad->x = x;
+    quad->y = y;
+    quad->width = width;
+    quad->height = height;
+    quad->uv_rect = uv_rect;
+
+    batch->quad_count++;
+}
+
+int sprite_batch_quad_compare(const void* a, const void* b) {
+    const struct sprite_batch_quad_t* qa = a;
+    const struct sprite_batch_quad_t* qb = b;
+
+    if (qa->layer != qb->layer) {
+        return qa->layer < qb->layer ? -1 : 1;
+    }
+    if (qa->texture_id != qb->texture_id) {
+        return qa->texture_id < qb->texture_id ? -1 : 1;
+    }
+    if (qa->opacity != qb->opacity) {
+        return qa->opacity < qb->opacity ? -1 : 1;
+    }
+    return (qa->order > qb->order) - (qa->order < qb->order);
+}
+
+// Quads are already in screen space, only the opacity changes
+void sprite_batch_constants(struct uniform_arena_t* uniforms, float opacity) {
+    struct cb_object_data_t cb_object_data;
+
+    mat4_identity(&cb_object_data.world);
+    cb_object_data.opacity = opacity;
+
+    uniform_arena_bind(uniforms, 1, &cb_object_data, sizeof(struct cb_object_data_t));
+}
+
+// Draws every quad pushed since the last flush, expects the HUD shader to be
+// bound. The per object constants of each draw go into uniforms.
+void sprite_batch_flush(struct sprite_batch_t* batch, struct uniform_arena_t* uniforms) {
+    size_t count = batch->quad_count;
+    batch->quad_count = 0;
+
+    if (count == 0) {
+        return;
+    }
+
+    qsort(batch->quads, count, sizeof(struct sprite_batch_quad_t), sprite_batch_quad_compare);
+
+    for(size_t i = 0;i < count;i++) {
+        struct sprite_batch_quad_t* quad = &batch->quads[i];
+        struct vertex_t* v = &batch->vertices[i * 4];
+
+        float x0 = quad->x;
+        float y0 = quad->y;
+        float x1 = quad->x + quad->width;
+        float y1 = quad->y + quad->height;
+
+        float u0 = quad->uv_rect.x;
+        float v0 = quad->uv_rect.y;
+        float u1 = quad->uv_rect.x + quad->uv_rect.z;
+        float v1 = quad->uv_rect.y + quad->uv_rect.w;
+
+        v[0] = (struct vertex_t){.pos = {x0, y1, 0.0f}, .uv = {u0, v1}};
+        v[1] = (struct vertex_t){.pos = {x0, y0, 0.0f}, .uv = {u0, v0}};
+        v[2] = (struct vertex_t){.pos = {x1, y1, 0.0f}, .uv = {u1, v1}};
+        v[3] = (struct vertex_t){.pos = {x1, y0, 0.0f}, .uv = {u1, v0}};
+    }
+
+    if (count * 6 > batch->ibuf->count) {
+        sprite_batch_build_indices(batch, batch->quad_capacity);
+    }
+
+    // re-specifying the store orphans the one the previous flush may still read
+    glBindBuffer(GL_ARRAY_BUFFER, batch->vbuf->buffer_object);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(struct vertex_t) * count * 4, batch->vertices, GL_STREAM_DRAW);
+
+    glBindVertexArray(batch->vbuf->array_object);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, batch->ibuf->buffer_object);
+
+    glActiveTexture(GL_TEXTURE0);
+
+    size_t run_start = 0;
+    for(size_t i = 1;i <= count;i++) {
+        struct sprite_batch_quad_t* first = &batch->quads[run_start];
+
+        if (i < count) {
+            struct sprite_batch_quad_t* quad = &batch->quads[i];
+            if (quad->layer == first->layer && quad->texture_id == first->texture_id && quad->opacity == first->opacity) {
+                continue;
+            }
+        }
+
+        // opacity only changes for overlays, most runs share the bound constants
+        if (run_start == 0 || first->opacity != batch->quads[run_start - 1].opacity) {
+            sprite_batch_constants(uniforms, first->opacity);
+        }
+
+        glBindTexture(GL_TEXTURE_2D, first->texture_id);
+        glDrawElements(GL_TRIANGLES, (i - run_start) * 6, GL_UNSIGNED_INT, (void*)(run_start * 6 * sizeof(unsigned int)));
+
+        run_start = i;
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    glBindVertexArray(0);
+}
@@ -0,0 +1,241 @@
+#pragma once
+
+// Vector and matrix math, inlined into every caller
+//
+// The small ops live here so a vec3_sub in a loop costs a subtract, not a call
+// into math.c. vec4 and mat4 use SSE when the compiler targets it (always the
+// case on x86-64), plain C otherwise or with DOOM_NO_SIMD defined. vec3 stays
+// plain C: three lanes don't pay for the loads and shuffles, and the compiler
+// vectorizes the inlined code in loops on its own.
+//
+// Both paths give the same bits, replays depend on it: only add, sub, mul, div
+// and sqrt in the same order, no FMA and no reciprocal estimates.
+//
+// The batch ops (mat4_transform_points, vec3_normalize_batch) are in math.c.
+
+#include <math.h>
+#include <string.h>
+
+#if !defined(DOOM_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define DOOM_SIMD_SSE 1
+#include <emmintrin.h>
+#endif
+
+#ifdef _MSC_VER
+#define MATH_INLINE static __forceinline
+#else
+#define MATH_INLINE static inline __attribute__((always_inline))
+#endif
+
+struct vec2_t {
+    float x, y;
+};
+
+struct vec3_t {
+    float x, y, z;
+};
+
+struct vec4_t {
+    float x, y, z, w;
+};
+
+// Column major like OpenGL, m[column][row], the translation is m[3]
+struct mat4_t {
+	union {
+		float m[4][4];
+		float M[16];
+	};
+};
+
+MATH_INLINE struct vec2_t vec2_sub(struct vec2_t* a, struct vec2_t* b) {
+    struct vec2_t out;
+    out.x = a->x - b->x;
+    out.y = a->y - b->y;
+    return out;
+}
+
+MATH_INLINE struct vec3_t vec3(float x, float y, float z) {
+    struct vec3_t v = {x, y, z};
+    return v;
+}
+
+MATH_INLINE struct vec3_t vec3_add(struct vec3_t* a, struct vec3_t* b) {
+    return vec3(a->x + b->x, a->y + b->y, a->z + b->z);
+}
+
+MATH_INLINE struct vec3_t vec3_sub(struct vec3_t* a, struct vec3_t* b) {
+    return vec3(a->x - b->x, a->y - b->y, a->z - b->z);
+}
+
+MATH_INLINE struct vec3_t vec3_mul(struct vec3_t* a, struct vec3_t* b) {
+    return vec3(a->x * b->x, a->y * b->y, a->z * b->z);
+}
+
+MATH_INLINE struct vec3_t vec3_mulf(struct vec3_t* a, float f) {
+    return vec3(a->x * f, a->y * f, a->z * f);
+}
+
+MATH_INLINE struct vec3_t vec3_cross(struct vec3_t* a, struct vec3_t* b) {
+    return vec3(a->y * b->z - a->z * b->y,
+                a->z * b->x - a->x * b->z,
+                a->x * b->y - a->y * b->x);
+}
+
+// a at t = 0 and exactly b at t = 1
+MATH_INLINE struct vec3_t vec3_lerp(struct vec3_t* a, struct vec3_t* b, float t) {
+    return vec3(a->x * (1.0f - t) + b->x * t,
+                a->y * (1.0f - t) + b->y * t,
+                a->z * (1.0f - t) + b->z * t);
+}
+
+MATH_INLINE struct vec3_t vec3_min(struct vec3_t* a, struct vec3_t* b) {
+    return vec3(fminf(a->x, b->x), fminf(a->y, b->y), fminf(a->z, b->z));
+}
+
+MATH_INLINE struct vec3_t vec3_max(struct vec3_t* a, struct vec3_t* b) {
+    return vec3(fmaxf(a->x, b->x), fmaxf(a->y, b->y), fmaxf(a->z, b->z));
+}
+
+MATH_INLINE float vec3_dot(struct vec3_t* a, struct vec3_t* b) {
+    return a->x * b->x + a->y * b->y + a->z * b->z;
+}
+
+// sqrtf rounds the same as the double sqrt rounded to float
+MATH_INLINE float vec3_length(struct vec3_t* v) {
+    return sqrtf((v->x * v->x) + (v->y * v->y) + (v->z * v->z));
+}
+
+MATH_INLINE float vec3_distance(struct vec3_t* a, struct vec3_t* b) {
+    struct vec3_t d = vec3_sub(a, b);
+    return vec3_length(&d);
+}
+
+// three divides, not one and three multiplies, that would change the bits
+MATH_INLINE void vec3_normalize(struct vec3_t* v) {
+    float length_of_v = vec3_length(v);
+    v->x = v->x / length_of_v;
+    v->y = v->y / length_of_v;
+    v->z = v->z / length_of_v;
+}
+
+MATH_INLINE struct vec4_t vec4(float x, float y, float z, float w) {
+    struct vec4_t v = {x, y, z, w};
+    return v;
+}
+
+MATH_INLINE struct vec4_t vec4_add(struct vec4_t* a, struct vec4_t* b) {
+    struct vec4_t out;
+#ifdef DOOM_SIMD_SSE
+    _mm_storeu_ps(&out.x, _mm_add_ps(_mm_loadu_ps(&a->x), _mm_loadu_ps(&b->x)));
+#else
+    out = vec4(a->x + b->x, a->y + b->y, a->z + b->z, a->w + b->w);
+#endif
+    return out;
+}
+
+MATH_INLINE struct vec4_t vec4_sub(struct vec4_t* a, struct vec4_t* b) {
+    struct vec4_t out;
+#ifdef DOOM_SIMD_SSE
+    _mm_storeu_ps(&out.x, _mm_sub_ps(_mm_loadu_ps(&a->x), _mm_loadu_ps(&b->x)));
+#else
+    out = vec4(a->x - b->x, a->y - b->y, a->z - b->z, a->w - b->w);
+#endif
+    return out;
+}
+
+MATH_INLINE struct vec4_t vec4_mul(struct vec4_t* a, struct vec4_t* b) {
+    struct vec4_t out;
+#ifdef DOOM_SIMD_SSE
+    _mm_storeu_ps(&out.x, _mm_mul_ps(_mm_loadu_ps(&a->x), _mm_loadu_ps(&b->x)));
+#else
+    out = vec4(a->x * b->x, a->y * b->y, a->z * b->z, a->w * b->w);
+#endif
+    return out;
+}
+
+MATH_INLINE struct vec4_t vec4_mulf(struct vec4_t* a, float f) {
+    struct vec4_t out;
+#ifdef DOOM_SIMD_SSE
+    _mm_storeu_ps(&out.x, _mm_mul_ps(_mm_loadu_ps(&a->x), _mm_set1_ps(f)));
+#else
+    out = vec4(a->x * f, a->y * f, a->z * f, a->w * f);
+#endif
+    return out;
+}
+
+MATH_INLINE float vec4_dot(struct vec4_t* a, struct vec4_t* b) {
+    return ((a->x * b->x + a->y * b->y) + a->z * b->z) + a->w * b->w;
+}
+
+MATH_INLINE void mat4_identity(struct mat4_t* mat) {
+    memset(mat->M, 0, 16*sizeof(float));
+
+    mat->m[0][0] = 1.0f;
+    mat->m[1][1] = 1.0f;
+    mat->m[2][2] = 1.0f;
+    mat->m[3][3] = 1.0f;
+}
+
+MATH_INLINE void mat4_translate(struct mat4_t* mat, struct vec3_t* v) {
+    mat->m[3][0] = v->x;
+    mat->m[3][1] = v->y;
+    mat->m[3][2] = v->z;
+}
+
+// mat * v, the columns weighted by the components of v
+MATH_INLINE struct vec4_t mat4_mul_vec4(struct mat4_t* mat, struct vec4_t* v) {
+    struct vec4_t out;
+#ifdef DOOM_SIMD_SSE
+    __m128 r = _mm_mul_ps(_mm_loadu_ps(mat->m[0]), _mm_set1_ps(v->x));
+    r = _mm_add_ps(r, _mm_mul_ps(_mm_loadu_ps(mat->m[1]), _mm_set1_ps(v->y)));
+    r = _mm_add_ps(r, _mm_mul_ps(_mm_loadu_ps(mat->m[2]), _mm_set1_ps(v->z)));
+    r = _mm_add_ps(r, _mm_mul_ps(_mm_loadu_ps(mat->m[3]), _mm_set1_ps(v->w)));
+    _mm_storeu_ps(&out.x, r);
+#else
+    float* o = &out.x;
+    for(int i = 0;i < 4;i++) {
+        o[i] = ((mat->m[0][i] * v->x + mat->m[1][i] * v->y) + mat->m[2][i] * v->z) + mat->m[3][i] * v->w;
+    }
+#endif
+    return out;
+}
+
+// a * column j of b, the columns of a weighted by the components
+#ifdef DOOM_SIMD_SSE
+MATH_INLINE __m128 mat4_mul_column(__m128 a0, __m128 a1, __m128 a2, __m128 a3, float* b) {
+    __m128 c = _mm_mul_ps(a0, _mm_set1_ps(b[0]));
+    c = _mm_add_ps(c, _mm_mul_ps(a1, _mm_set1_ps(b[1])));
+    c = _mm_add_ps(c, _mm_mul_ps(a2, _mm_set1_ps(b[2])));
+    return _mm_add_ps(c, _mm_mul_ps(a3, _mm_set1_ps(b[3])));
+}
+#endif
+
+// out = a * b, so b applies first: proj * view. out can be a or b.
+MATH_INLINE void mat4_mul(struct mat4_t* out, struct mat4_t* a, struct mat4_t* b) {
+#ifdef DOOM_SIMD_SSE
+    __m128 a0 = _mm_loadu_ps(a->m[0]);
+    __m128 a1 = _mm_loadu_ps(a->m[1]);
+    __m128 a2 = _mm_loadu_ps(a->m[2]);
+    __m128 a3 = _mm_loadu_ps(a->m[3]);
+
+    // every load before the first store
+    __m128 c0 = mat4_mul_column(a0, a1, a2, a3, b->m[0]);
+    __m128 c1 = mat4_mul_column(a0, a1, a2, a3, b->m[1]);
+    __m128 c2 = mat4_mul_column(a0, a1, a2, a3, b->m[2]);
+    __m128 c3 = mat4_mul_column(a0, a1, a2, a3, b->m[3]);
+
+    _mm_storeu_ps(out->m[0], c0);
+    _mm_storeu_ps(out->m[1], c1);
+    _mm_storeu_ps(out->m[2], c2);
+    _mm_storeu_ps(out->m[3], c3);
+#else
+    struct mat4_t r;
+    for(int j = 0;j < 4;j++) {
+        for(int i = 0;i < 4;i++) {
+            r.m[j][i] = ((a->m[0][i] * b->m[j][0] + a->m[1][i] * b->m[j][1]) +
+                         a->m[2][i] * b->m[j][2]) + a->m[3][i] * b->m[j][3];
+        }
+    }
+    *out = r;
+#endif
+}